@@ -4,13 +4,14 @@ set -euo pipefail
 KEYGEN=${KEYGEN:-./keygen}
 ENCRYPT=${ENCRYPT:-./encrypt}
 DECRYPT=${DECRYPT:-./decrypt}
+MERGE=${MERGE:-./merge}
 REBUILD=${REBUILD:-1}
 
 if [[ -f Makefile ]]; then
   if [[ "$REBUILD" == "1" ]]; then
-    make clean && make keygen encrypt decrypt
+    make clean && make keygen encrypt decrypt merge
   else
-    make keygen encrypt decrypt
+    make keygen encrypt decrypt merge
   fi
 fi
 
@@ -62,12 +63,148 @@ for L in "${sizes[@]}"; do
   echo "ok: size $L round-trip"
 done
 
+# 3b) indexed container: full and random-access round-trips
+L=$((7*payload+1)); mk "$L"
+$ENCRYPT -x -i "$tmpdir/in_$L.bin" -o "$tmpdir/x_$L.ssx" >/dev/null
+$DECRYPT -i "$tmpdir/x_$L.ssx" -o "$tmpdir/xout_$L.bin" >/dev/null
+cmp -s "$tmpdir/in_$L.bin" "$tmpdir/xout_$L.bin"
+start=$((payload/2)); len=$((2*payload+3))
+$DECRYPT -i "$tmpdir/x_$L.ssx" -r "$start:$len" -o "$tmpdir/xrange.bin" >/dev/null
+tail -c +"$((start+1))" "$tmpdir/in_$L.bin" | head -c "$len" | cmp -s - "$tmpdir/xrange.bin"
+echo "ok: indexed container full and --range round-trips"
+
+# 3c) compressed container round-trip
+awk -v n="$payload" 'BEGIN { for (i = 0; i < n; i++) print "compressible log line " i % 7 }' > "$tmpdir/log.txt"
+$ENCRYPT -z -i "$tmpdir/log.txt" -o "$tmpdir/log.ssx" >/dev/null
+$DECRYPT -i "$tmpdir/log.ssx" | cmp -s - "$tmpdir/log.txt"
+echo "ok: compressed container round-trip"
+
+# 3d) shard set: merge matches an unsharded run, decrypt takes the set directly
+for i in 0 1 2; do
+  $ENCRYPT -x --shard "$i/3" -i "$tmpdir/in_$L.bin" -o "$tmpdir/shard.$i" >/dev/null
+done
+$MERGE -o "$tmpdir/merged.ssx" "$tmpdir/shard.2" "$tmpdir/shard.0" "$tmpdir/shard.1"
+cmp -s "$tmpdir/merged.ssx" "$tmpdir/x_$L.ssx" || { echo "FAIL: merged shards differ from unsharded run"; exit 1; }
+$DECRYPT -i "$tmpdir/shard.1" -i "$tmpdir/shard.0" -i "$tmpdir/shard.2" | cmp -s - "$tmpdir/in_$L.bin" \
+  || { echo "FAIL: shard set did not decrypt"; exit 1; }
+if $MERGE "$tmpdir/shard.0" "$tmpdir/shard.2" >/dev/null 2>&1; then
+  echo "FAIL: incomplete shard set should be refused"; exit 1
+fi
+for i in 0 1 2; do $DECRYPT -i "$tmpdir/shard.$i"; done | cmp -s - "$tmpdir/in_$L.bin" \
+  || { echo "FAIL: lone shards did not decrypt to their slices"; exit 1; }
+echo "ok: sharded encryption merges and decrypts"
+
+# 3e) batch mode: one key load for many files, each matching a single run
+mkdir -p "$tmpdir/batch" "$tmpdir/benc" "$tmpdir/bdec" "$tmpdir/bz"
+: > "$tmpdir/batch/empty"
+for L in 1 "$payload" $((3*payload+5)) 70000; do head -c "$L" /dev/urandom > "$tmpdir/batch/f$L"; done
+$ENCRYPT --batch "$tmpdir/batch" -o "$tmpdir/benc" -t 3 --trace "$tmpdir/batch.json" >/dev/null
+grep -q '"name":"pool task"' "$tmpdir/batch.json" && grep -q '"name":"pool 0"' "$tmpdir/batch.json" \
+  || { echo "FAIL: pool workers missing from the trace"; exit 1; }
+for f in "$tmpdir"/batch/*; do
+  $ENCRYPT -i "$f" | cmp -s - "$tmpdir/benc/$(basename "$f")" || { echo "FAIL: batch output differs for $f"; exit 1; }
+done
+echo "garbage" > "$tmpdir/benc/zz_bad"
+if $DECRYPT --batch "$tmpdir/benc" -o "$tmpdir/bdec" 2> "$tmpdir/berr"; then
+  echo "FAIL: batch with a malformed file should exit non-zero"; exit 1
+fi
+grep -q "zz_bad: malformed input" "$tmpdir/berr" || { echo "FAIL: malformed file not reported"; exit 1; }
+for f in "$tmpdir"/batch/*; do
+  cmp -s "$f" "$tmpdir/bdec/$(basename "$f")" || { echo "FAIL: batch round-trip differs for $f"; exit 1; }
+done
+ls "$tmpdir"/batch/* > "$tmpdir/blist"
+$ENCRYPT -z --batch "$tmpdir/blist" -o "$tmpdir/bz" >/dev/null
+$ENCRYPT -z -i "$tmpdir/batch/f70000" | cmp -s - "$tmpdir/bz/f70000" || { echo "FAIL: compressed batch output differs"; exit 1; }
+rm "$tmpdir"/bdec/*
+$DECRYPT --batch "$tmpdir/bz" -o "$tmpdir/bdec"
+for f in "$tmpdir"/batch/*; do
+  cmp -s "$f" "$tmpdir/bdec/$(basename "$f")" || { echo "FAIL: compressed batch round-trip differs for $f"; exit 1; }
+done
+echo "ok: batch mode over a directory and a list"
+
+# 3f) block cache: a zero-filled image encrypts and decrypts the same, mostly from cache
+head -c 100000 /dev/zero > "$tmpdir/zeros"
+head -c 700 /dev/urandom >> "$tmpdir/zeros"
+$ENCRYPT -i "$tmpdir/zeros" -o "$tmpdir/zeros.hex"
+$ENCRYPT --cache 256 -v -i "$tmpdir/zeros" -o "$tmpdir/zeros.c.hex" 2> "$tmpdir/cerr"
+cmp -s "$tmpdir/zeros.hex" "$tmpdir/zeros.c.hex" || { echo "FAIL: cached encryption differs"; exit 1; }
+grep -q "Block cache: [1-9][0-9]* hits" "$tmpdir/cerr" || { echo "FAIL: no cache hits reported"; exit 1; }
+$DECRYPT --cache 256 -i "$tmpdir/zeros.hex" | cmp -s - "$tmpdir/zeros" \
+  || { echo "FAIL: cached decryption differs"; exit 1; }
+echo "ok: block cache"
+
+# 3g) live streams: records split into short blocks by the deadline round-trip exactly
+{ printf 'first record\n'; sleep 0.3; printf 'second\n'; sleep 0.3; cat "$tmpdir/zeros"; } \
+  | $ENCRYPT --stream --flush-ms 20 > "$tmpdir/live.hex"
+lines=$(wc -l < "$tmpdir/live.hex")
+[[ "$lines" -gt $(( 100700 / payload + 1 )) ]] || { echo "FAIL: --stream wrote no short blocks"; exit 1; }
+{ printf 'first record\nsecond\n'; cat "$tmpdir/zeros"; } > "$tmpdir/live.want"
+$DECRYPT < "$tmpdir/live.hex" | cmp -s - "$tmpdir/live.want" || { echo "FAIL: --stream output differs"; exit 1; }
+$DECRYPT --stream --flush-ms 0 < "$tmpdir/live.hex" | cmp -s - "$tmpdir/live.want" \
+  || { echo "FAIL: decrypt --stream output differs"; exit 1; }
+if $DECRYPT --flush-ms 10 < "$tmpdir/live.hex" >/dev/null 2>&1; then
+  echo "FAIL: --flush-ms without --stream should exit non-zero"; exit 1
+fi
+# short blocks are indexed: appending and range decryption still find the bytes
+cp "$tmpdir/live.want" "$tmpdir/live.grow"
+printf 'third record\n' >> "$tmpdir/live.grow"
+$ENCRYPT --append -i "$tmpdir/live.grow" -o "$tmpdir/live.hex" >/dev/null
+$DECRYPT -i "$tmpdir/live.hex" | cmp -s - "$tmpdir/live.grow" || { echo "FAIL: --append to a --stream output differs"; exit 1; }
+$DECRYPT -i "$tmpdir/live.hex" -r 13:7 | cmp -s - <(printf 'second\n') \
+  || { echo "FAIL: range of a --stream output differs"; exit 1; }
+# but a base whose blocks are not full cannot line up with a manifest
+$ENCRYPT -x -i "$tmpdir/live.grow" -o "$tmpdir/live.full" --manifest "$tmpdir/live.man" >/dev/null
+if $ENCRYPT -x -i "$tmpdir/live.grow" -o "$tmpdir/live.new" \
+  --base "$tmpdir/live.hex" --base-manifest "$tmpdir/live.man" >/dev/null 2>&1; then
+  echo "FAIL: --base on a --stream output should exit non-zero"; exit 1
+fi
+if $MERGE -o "$tmpdir/live.merged" "$tmpdir/live.hex" >/dev/null 2>&1; then
+  echo "FAIL: merge of a --stream output should exit non-zero"; exit 1
+fi
+echo "ok: live streams"
+
+# 3h) a malformed or missing line fails instead of ending the output early
+L=$((7*payload+1))
+for f in c_$L.hex x_$L.ssx; do
+  sed '3s/^./g/' "$tmpdir/$f" > "$tmpdir/bad.hex"
+  if $DECRYPT -i "$tmpdir/bad.hex" -o "$tmpdir/bad.out" >/dev/null 2>&1; then
+    echo "FAIL: a malformed middle line of $f should exit non-zero"; exit 1
+  fi
+done
+sed '3d' "$tmpdir/x_$L.ssx" > "$tmpdir/bad.hex"
+if $DECRYPT -i "$tmpdir/bad.hex" -o "$tmpdir/bad.out" >/dev/null 2>&1; then
+  echo "FAIL: an indexed ciphertext missing a block should exit non-zero"; exit 1
+fi
+echo "ok: malformed ciphertext rejected"
+
 # 4) missing private key should fail
 if $DECRYPT -n does_not_exist.priv </dev/null >/dev/null 2>&1; then
   echo "FAIL: missing privkey should error"; exit 1
 fi
 echo "ok: missing privkey handled"
 
+# 4b) numeric options are validated, not read as 0
+for bad in "--cache abc" "--cache -5" "--cache 8k"; do
+  if eval "$DECRYPT $bad" </dev/null >/dev/null 2>&1; then
+    echo "FAIL: decrypt $bad should exit non-zero"; exit 1
+  fi
+done
+L=$((7*payload+1))
+$DECRYPT -i "$tmpdir/x_$L.ssx" -r 5:1 >/dev/null || { echo "FAIL: decrypt -r 5:1 should succeed"; exit 1; }
+for bad in -5:10 5:-1 5: :5 +5:1 " 5:1" 5:1x 99999999999999999999:1; do
+  if $DECRYPT -i "$tmpdir/x_$L.ssx" -r "$bad" >/dev/null 2>&1; then
+    echo "FAIL: decrypt -r \"$bad\" should exit non-zero"; exit 1
+  fi
+done
+mkdir -p "$tmpdir/cdir" "$tmpdir/cout"
+if $DECRYPT --cache 64 --batch "$tmpdir/cdir" -o "$tmpdir/cout" >/dev/null 2>&1; then
+  echo "FAIL: decrypt --cache with --batch should exit non-zero"; exit 1
+fi
+if $DECRYPT --cache 64 -i "$tmpdir/x_$L.ssx" -r 5:1 >/dev/null 2>&1; then
+  echo "FAIL: decrypt --cache with -r should exit non-zero"; exit 1
+fi
+echo "ok: bad --cache and -r rejected"
+
 # 5) verbose prints pq then d (to stderr), does not pollute stdout
 echo -n "abc" | $ENCRYPT > "$tmpdir/verb.c"
 out="$($DECRYPT -v -i "$tmpdir/verb.c" -o "$tmpdir/verb.out" 2>&1 >/dev/null)"
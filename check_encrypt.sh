@@ -10,9 +10,9 @@ BITS=${BITS:-1024}
 rebuild=${REBUILD:-1}
 if [[ -f Makefile ]]; then
   if [[ "${rebuild}" == "1" ]]; then
-    make clean && make keygen encrypt
+    make clean && make keygen encrypt sskeyring
   else
-    make keygen encrypt
+    make keygen encrypt sskeyring
   fi
 fi
 
@@ -109,10 +109,146 @@ for L in "${sizes[@]}"; do
   echo "ok: size $L → $got line(s)"
 done
 
+# 3b) several recipients in one pass: each output matches a single-key run
+$KEYGEN -s 2 -b 300 -n "$tmpdir/r1.pub" -d "$tmpdir/r1.priv" >/dev/null
+printf '%s\n' ss.pub "$tmpdir/r1.pub" > "$tmpdir/recipients"
+L=$(( 7*payload+1 ))
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/multi" -R "$tmpdir/recipients" -t 2 >/dev/null
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/single1" -n "$tmpdir/r1.pub" >/dev/null
+cmp -s "$tmpdir/multi.0" "$tmpdir/out_$L.hex" && cmp -s "$tmpdir/multi.1" "$tmpdir/single1" \
+  || { echo "FAIL: multi-recipient output differs from single-key runs"; exit 1; }
+if $ENCRYPT -n ss.pub -n "$tmpdir/r1.pub" </dev/null >/dev/null 2>&1; then
+  echo "FAIL: several recipients without -o should exit non-zero"; exit 1
+fi
+echo "ok: multi-recipient single pass"
+
+# 3c) a tuning profile changes speed, never the output
+L=$(( 7*payload+1 ))
+printf 'backend native\npow_window 3\nthreads 2\nbatch 65536\nio_buffer 4096\n' > "$tmpdir/p.tune"
+out="$(SS_TUNE="$tmpdir/p.tune" $ENCRYPT -v -i "$tmpdir/in_$L.bin" -o "$tmpdir/tuned.hex" 2>&1)"
+grep -q "Tuning profile: $tmpdir/p.tune" <<<"$out" || { echo "FAIL: tuning profile not loaded"; exit 1; }
+cmp -s "$tmpdir/tuned.hex" "$tmpdir/out_$L.hex" || { echo "FAIL: tuned output differs"; exit 1; }
+echo "ok: tuning profile"
+
+# 3d) --append: a grown input re-encrypts only its tail, matching a full run
+L=$(( 7*payload+1 ))
+for x in "" -x; do
+  head -c $(( 3*payload+2 )) "$tmpdir/in_$L.bin" > "$tmpdir/grow.bin"
+  rm -f "$tmpdir/grow.enc"
+  $ENCRYPT $x --append -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null
+  cp "$tmpdir/in_$L.bin" "$tmpdir/grow.bin"
+  $ENCRYPT --append -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null
+  $ENCRYPT $x -i "$tmpdir/grow.bin" -o "$tmpdir/grow.want" >/dev/null
+  cmp -s "$tmpdir/grow.enc" "$tmpdir/grow.want" || { echo "FAIL: appended output differs ($x)"; exit 1; }
+done
+if $ENCRYPT -z --append -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null 2>&1; then
+  echo "FAIL: --append with -z should exit non-zero"; exit 1
+fi
+if $ENCRYPT --append -n "$tmpdir/r1.pub" -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null 2>&1; then
+  echo "FAIL: --append under another key should exit non-zero"; exit 1
+fi
+# a single block is checked too, in either layout
+for x in "" -x; do
+  printf 'hi' > "$tmpdir/grow.bin"
+  $ENCRYPT $x -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null
+  printf ' there' >> "$tmpdir/grow.bin"
+  if $ENCRYPT --append -n "$tmpdir/r1.pub" -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null 2>&1; then
+    echo "FAIL: --append of one block under another key should exit non-zero ($x)"; exit 1
+  fi
+  $ENCRYPT --append -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null
+  $ENCRYPT $x -i "$tmpdir/grow.bin" -o "$tmpdir/grow.want" >/dev/null
+  cmp -s "$tmpdir/grow.enc" "$tmpdir/grow.want" || { echo "FAIL: appended one-block output differs ($x)"; exit 1; }
+done
+# legacy blocks that are not all full cannot be located without an index
+head -c $(( payload+3 )) "$tmpdir/in_$L.bin" > "$tmpdir/grow.bin"
+$ENCRYPT -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null
+tail -c $(( 3*payload )) "$tmpdir/in_$L.bin" > "$tmpdir/grow.tail"
+$ENCRYPT -i "$tmpdir/grow.tail" >> "$tmpdir/grow.enc"
+cat "$tmpdir/grow.tail" "$tmpdir/in_$L.bin" >> "$tmpdir/grow.bin"
+if $ENCRYPT --append -i "$tmpdir/grow.bin" -o "$tmpdir/grow.enc" >/dev/null 2>&1; then
+  echo "FAIL: --append over a short legacy middle block should exit non-zero"; exit 1
+fi
+echo "ok: append mode"
+
+# 3e) --with-priv: the key owner's fast path writes the same bytes
+L=$(( 7*payload+1 ))
+$ENCRYPT --with-priv ss.priv -i "$tmpdir/in_$L.bin" -o "$tmpdir/owner.hex" >/dev/null
+cmp -s "$tmpdir/owner.hex" "$tmpdir/out_$L.hex" || { echo "FAIL: --with-priv output differs"; exit 1; }
+$ENCRYPT -x --with-priv ss.priv -i "$tmpdir/in_$L.bin" -o "$tmpdir/owner.x" >/dev/null
+$ENCRYPT -x -i "$tmpdir/in_$L.bin" -o "$tmpdir/plain.x" >/dev/null
+cmp -s "$tmpdir/owner.x" "$tmpdir/plain.x" || { echo "FAIL: --with-priv -x output differs"; exit 1; }
+if $ENCRYPT --with-priv "$tmpdir/r1.priv" -i "$tmpdir/in_$L.bin" -o "$tmpdir/owner.hex" >/dev/null 2>&1; then
+  echo "FAIL: --with-priv with another key pair's private key should exit non-zero"; exit 1
+fi
+echo "ok: key-owner encryption"
+
+# 3f) --base: unchanged blocks are copied from the previous run, output as a full run
+L=$(( 7*payload+1 ))
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/v1.hex" --manifest "$tmpdir/v1.man" >/dev/null
+cmp -s "$tmpdir/v1.hex" "$tmpdir/out_$L.hex" || { echo "FAIL: --manifest changed the output"; exit 1; }
+cp "$tmpdir/in_$L.bin" "$tmpdir/v2.bin"
+printf 'X' | dd of="$tmpdir/v2.bin" bs=1 seek=$(( 2*payload+3 )) conv=notrunc 2>/dev/null
+out="$($ENCRYPT -v -i "$tmpdir/v2.bin" -o "$tmpdir/v2.hex" --manifest "$tmpdir/v2.man" \
+  --base "$tmpdir/v1.hex" --base-manifest "$tmpdir/v1.man" 2>&1 >/dev/null)"
+grep -q "Blocks reused from base: 7" <<<"$out" || { echo "FAIL: expected 7 of 8 blocks reused"; exit 1; }
+$ENCRYPT -i "$tmpdir/v2.bin" -o "$tmpdir/v2.want" >/dev/null
+cmp -s "$tmpdir/v2.hex" "$tmpdir/v2.want" || { echo "FAIL: incremental output differs from a full run"; exit 1; }
+if $ENCRYPT -i "$tmpdir/v2.bin" -o "$tmpdir/v3.hex" -n "$tmpdir/r1.pub" \
+  --base "$tmpdir/v2.hex" --base-manifest "$tmpdir/v2.man" >/dev/null 2>&1; then
+  echo "FAIL: --base under another key should exit non-zero"; exit 1
+fi
+echo "ok: incremental re-encryption"
+
+# 3g) -K: recipients looked up in a keyring by username or fingerprint
+SSKEYRING=${SSKEYRING:-./sskeyring}
+USER=alice $KEYGEN -s 3 -b 300 -n "$tmpdir/alice.pub" -d "$tmpdir/alice.priv" >/dev/null
+USER=bob $KEYGEN -s 4 -b 300 -n "$tmpdir/bob.pub" -d "$tmpdir/bob.priv" >/dev/null
+$SSKEYRING -o "$tmpdir/ring" "$tmpdir/alice.pub" "$tmpdir/bob.pub"
+fp=$($SSKEYRING -l "$tmpdir/ring" | awk '$3 == "alice" { print $1 }')
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/k1.hex" -n "$tmpdir/bob.pub" >/dev/null
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/k1.ring" -K "$tmpdir/ring" -n bob >/dev/null
+cmp -s "$tmpdir/k1.hex" "$tmpdir/k1.ring" || { echo "FAIL: keyring lookup by username differs"; exit 1; }
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/k2.hex" -n "$tmpdir/alice.pub" >/dev/null
+$ENCRYPT -i "$tmpdir/in_$L.bin" -o "$tmpdir/k2.ring" -K "$tmpdir/ring" -n "$fp" >/dev/null
+cmp -s "$tmpdir/k2.hex" "$tmpdir/k2.ring" || { echo "FAIL: keyring lookup by fingerprint differs"; exit 1; }
+if $ENCRYPT -K "$tmpdir/ring" -n mallory </dev/null >/dev/null 2>&1; then
+  echo "FAIL: a name missing from the keyring should exit non-zero"; exit 1
+fi
+if $SSKEYRING -o "$tmpdir/ring2" "$tmpdir/bob.pub" "$tmpdir/bob.pub" 2>/dev/null; then
+  echo "FAIL: a repeated key should not make a keyring"; exit 1
+fi
+echo "ok: keyring lookup"
+
+# 3h) --stream: a record is written as a short block once the deadline passes
+{ printf 'rec1\n'; sleep 0.3; printf 'rec2\n'; } | $ENCRYPT --stream --flush-ms 20 > "$tmpdir/live.hex"
+[[ $(sed -n '2,/^#index/p' "$tmpdir/live.hex" | grep -vc '^#') -eq 2 ]] || { echo "FAIL: expected one block per record"; exit 1; }
+head -c 6 "$tmpdir/live.hex" | grep -q '^#ssx1' || { echo "FAIL: --stream output should be indexed"; exit 1; }
+if $ENCRYPT --stream -z </dev/null >/dev/null 2>&1; then
+  echo "FAIL: --stream with -z should exit non-zero"; exit 1
+fi
+echo "ok: live stream"
+
 # 4) bad pubkey path
 if $ENCRYPT -n does_not_exist.pub </dev/null >/dev/null 2>&1; then
   echo "FAIL: missing pubkey should exit non-zero"; exit 1
 fi
 echo "ok: missing pubkey handled"
 
+# 5) numeric options are validated, not read as 0
+for bad in "-t abc" "-t -1" "-t 1x" "--cache abc" "--cache ''"; do
+  if eval "$ENCRYPT $bad" </dev/null >/dev/null 2>&1; then
+    echo "FAIL: encrypt $bad should exit non-zero"; exit 1
+  fi
+done
+echo "ok: bad -t/--cache rejected"
+# --cache where it would have no effect is an error, not silently dropped
+mkdir -p "$tmpdir/cdir" "$tmpdir/cout"
+if $ENCRYPT --cache 64 -n ss.pub -n "$tmpdir/r1.pub" -o "$tmpdir/c2" </dev/null >/dev/null 2>&1; then
+  echo "FAIL: --cache with several recipients should exit non-zero"; exit 1
+fi
+if $ENCRYPT --cache 64 --batch "$tmpdir/cdir" -o "$tmpdir/cout" >/dev/null 2>&1; then
+  echo "FAIL: --cache with --batch should exit non-zero"; exit 1
+fi
+echo "ok: --cache outside its single-key paths rejected"
+
 echo "All encrypt checks passed ✅"
@@ -95,6 +95,79 @@ rm -f foo.pub bar.priv
 "$KEYGEN" -n foo.pub -d bar.priv -i 5 -s 42 >/dev/null
 test -f foo.pub && test -f bar.priv && echo "  ok: custom paths & options"
 
+echo "== Prime pool =="
+rm -f t.pool t.pool.lock t.pool.tmp pool.pub pool.priv
+live() { grep -vc '^-' "$1" || true; }
+"$KEYGEN" --fill-pool 2 -b 256 -P t.pool -s 7 >/dev/null
+[ "$(live t.pool)" -eq 4 ] || { echo "  FAIL: pool should hold 4 primes"; exit 1; }
+[ "$(perm_linux t.pool)" = "600" ] || { echo "  FAIL: pool perms should be 600"; exit 1; }
+out="$("$KEYGEN" -P t.pool -b 256 -n pool.pub -d pool.priv -s 8 -v 2>&1)"
+grep -q "2 drawn" <<<"$out" || { echo "  FAIL: keygen did not draw p and q from the pool"; exit 1; }
+[ "$(live t.pool)" -eq 2 ] || { echo "  FAIL: drawn primes not removed"; exit 1; }
+[ "$(wc -l < t.pool | tr -d ' ')" -eq 4 ] || { echo "  FAIL: taking a prime should not rewrite the pool"; exit 1; }
+"$KEYGEN" -P t.pool -b 256 -n pool.pub -d pool.priv >/dev/null
+out="$("$KEYGEN" -P t.pool -b 256 -n pool.pub -d pool.priv -v 2>&1)"
+grep -q ": 0 drawn, 2 searched live" <<<"$out" || { echo "  FAIL: empty pool should fall back to live search"; exit 1; }
+rm -f t.pool t.pool.lock pool.pub pool.priv
+echo "  ok: fill, draw-once and fallback"
+
+# concurrent fills with one -s must not append the same primes
+"$KEYGEN" --fill-pool 3 -b 256 -P t.pool -s 7 >/dev/null &
+"$KEYGEN" --fill-pool 3 -b 256 -P t.pool -s 7 >/dev/null
+wait
+[ "$(live t.pool)" -eq 12 ] || { echo "  FAIL: concurrent fills should add 12 primes"; exit 1; }
+[ -z "$(cut -d' ' -f2 t.pool | sort | uniq -d)" ] || { echo "  FAIL: concurrent fills repeated primes"; exit 1; }
+rm -f t.pool t.pool.lock
+
+# a prime present twice is handed out once
+"$KEYGEN" --fill-pool 1 -b 256 -P t.pool >/dev/null
+head -n 2 t.pool >> t.pool
+"$KEYGEN" -P t.pool -b 256 -n pool.pub -d pool.priv >/dev/null
+[ "$(live t.pool)" -eq 0 ] || { echo "  FAIL: copies of a drawn prime left in the pool"; exit 1; }
+rm -f t.pool t.pool.lock pool.pub pool.priv
+echo "  ok: no prime repeated across fills or draws"
+
+echo "== Trace output =="
+rm -f kg.trace.json
+"$KEYGEN" -b 256 -s 1 -n trace.pub -d trace.priv --trace kg.trace.json >/dev/null
+trace="$(cat kg.trace.json)"
+[[ "$trace" == '{"displayTimeUnit"'*']}' ]] || { echo "  FAIL: trace is not a trace-event document"; exit 1; }
+for span in "make_prime attempt" "miller_rabin round" "make_pub" "write keys"; do
+  grep -q "\"name\":\"$span\"" <<<"$trace" || { echo "  FAIL: trace lacks \"$span\" spans"; exit 1; }
+done
+rm -f kg.trace.json trace.pub trace.priv
+echo "  ok: --trace writes keygen spans"
+
+echo "== Split profiles =="
+out="$("$KEYGEN" -b 256 -s 3 -n split.pub -d split.priv --profile fast -v 2>&1)"
+grep -q "Split profile: fast (p 101 bits" <<<"$out" || { echo "  FAIL: fast profile should take the largest p"; exit 1; }
+grep -q "Decrypt cost: .* us/block (pq 15[56] bits" <<<"$out" || { echo "  FAIL: no decrypt cost for the fast split"; exit 1; }
+out="$("$KEYGEN" -b 256 -s 3 -n split.pub -d split.priv --profile pq=180 -v 2>&1)"
+grep -Eq "Private modulus pq \((179|180) bits\)" <<<"$out" || { echo "  FAIL: pq=180 not met"; exit 1; }
+if "$KEYGEN" -b 256 -n split.pub -d split.priv --profile pq=100 >/dev/null 2>&1; then
+  echo "  FAIL: pq below the safe bounds should fail"; exit 1
+fi
+# the cost is reported without -v, and both messages name the same pq range
+cost="$("$KEYGEN" -b 256 -s 3 -n split.pub -d split.priv --profile fast 2>&1 >/dev/null)"
+grep -q "^Decrypt cost: .* us/block (pq 15[56] bits; -b 256 takes pq=156\.\.206)$" <<<"$cost" \
+  || { echo "  FAIL: --profile without -v should report the decrypt cost and pq range"; exit 1; }
+err="$("$KEYGEN" -b 256 -n split.pub -d split.priv --profile pq=100 2>&1 || true)"
+grep -q "(pq=156\.\.206)" <<<"$err" || { echo "  FAIL: out-of-range pq names another range"; exit 1; }
+for pq in 156 206; do
+  "$KEYGEN" -b 256 -s 3 -n split.pub -d split.priv --profile pq=$pq 2>/dev/null \
+    || { echo "  FAIL: pq=$pq is in the reported range but was refused"; exit 1; }
+done
+for pq in 155 207; do
+  if "$KEYGEN" -b 256 -n split.pub -d split.priv --profile pq=$pq >/dev/null 2>&1; then
+    echo "  FAIL: pq=$pq is outside the reported range but was accepted"; exit 1
+  fi
+done
+if [ -n "$("$KEYGEN" -b 256 -s 3 -n split.pub -d split.priv 2>&1)" ]; then
+  echo "  FAIL: keygen without -v or --profile should be quiet"; exit 1
+fi
+rm -f split.pub split.priv
+echo "  ok: fast and fixed-pq splits, with decrypt cost"
+
 echo "== Negative input tests =="
 if "$KEYGEN" -b notanumber >/dev/null 2>&1; then
   echo "  FAIL: -b notanumber should fail"; exit 1
@@ -102,5 +175,8 @@ fi
 if "$KEYGEN" -s -1 >/dev/null 2>&1; then
   echo "  FAIL: -s -1 should fail"; exit 1
 fi
+if "$KEYGEN" --profile slow >/dev/null 2>&1; then
+  echo "  FAIL: --profile slow should fail"; exit 1
+fi
 
 echo "All keygen checks passed ✅"
@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+# Simple test harness for ./primecheck
+# Usage: ./check_primecheck.sh
+# Env vars:
+#   REBUILD=1  (default) -> runs `make clean && make primecheck`
+#   REBUILD=0             -> just runs `make primecheck`
+#   PRIMECHECK=./primecheck -> path to primecheck
+
+set -euo pipefail
+
+REBUILD="${REBUILD:-1}"
+PRIMECHECK="${PRIMECHECK:-./primecheck}"
+
+# --- build ---
+if [ "$REBUILD" = "1" ] && [ -f Makefile ]; then
+  echo "== Rebuild =="
+  make clean && make primecheck
+elif [ -f Makefile ]; then
+  echo "== Build (no clean) =="
+  make primecheck
+fi
+[ -x "$PRIMECHECK" ] || { echo "primecheck not found/executable at $PRIMECHECK"; exit 1; }
+
+rm -f pc.in pc.out pc.json
+
+echo "== Verdicts in input order =="
+printf '2\n97\n  0x61  \n561\n\n170141183460469231731687303715884105727\n1\n' > pc.in
+"$PRIMECHECK" -i pc.in -o pc.out -s 1
+expected=$'2 prime\n97 prime\n0x61 prime\n561 composite\n170141183460469231731687303715884105727 prime\n1 composite'
+[ "$(cat pc.out)" = "$expected" ] || { echo "  FAIL: unexpected verdicts:"; cat pc.out; exit 1; }
+for t in 1 3; do
+  out="$("$PRIMECHECK" -t "$t" -s 2 < pc.in)"
+  [ "$out" = "$expected" ] || { echo "  FAIL: -t $t changed the results"; exit 1; }
+done
+echo "  ok: primes, composites, hex, blank lines, thread counts"
+
+echo "== Invalid lines =="
+printf '7\n12 34\nabc\n0x\n0x1 f\n9\n' > pc.in
+status=0
+"$PRIMECHECK" -i pc.in -o pc.out -s 1 -j 2> pc.json || status=$?
+[ "$status" -ne 0 ] || { echo "  FAIL: invalid lines should make primecheck fail"; exit 1; }
+expected=$'7 prime\n12 34 invalid\nabc invalid\n0x invalid\n0x1 f invalid\n9 composite'
+[ "$(cat pc.out)" = "$expected" ] || { echo "  FAIL: unexpected verdicts:"; cat pc.out; exit 1; }
+for kv in '"total": 6' '"prime": 1' '"composite": 1' '"invalid": 4' '"trial_division": 1'; do
+  grep -q "$kv" pc.json || { echo "  FAIL: -j summary lacks $kv:"; cat pc.json; exit 1; }
+done
+echo "  ok: invalid verdicts, exit status and -j summary"
+
+echo "== Negative input tests =="
+if "$PRIMECHECK" -t abc < /dev/null >/dev/null 2>&1; then
+  echo "  FAIL: -t abc should fail"; exit 1
+fi
+if "$PRIMECHECK" -r 0 < /dev/null >/dev/null 2>&1; then
+  echo "  FAIL: -r 0 should fail"; exit 1
+fi
+
+rm -f pc.in pc.out pc.json
+echo "All primecheck checks passed ✅"
@@ -1,23 +1,58 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <gmp.h>
 
 #include "numtheory.h"
 #include "randstate.h"
 #include "ss.h"
+#include "ssbatch.h"
+#include "ssio.h"
+#include "trace.h"
+#include "tune.h"
 
-#define OPTIONS "i:o:n:vh"
+#define OPTIONS "i:o:n:r:vh"
+
+#define OPT_TRACE 256
+#define OPT_BATCH 257
+#define OPT_CACHE 258
+#define OPT_STREAM 259
+#define OPT_FLUSH_MS 260
+
+static const struct option long_options[] = {
+    { "range", required_argument, NULL, 'r' },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "batch", required_argument, NULL, OPT_BATCH },
+    { "cache", required_argument, NULL, OPT_CACHE },
+    { "stream", no_argument, NULL, OPT_STREAM },
+    { "flush-ms", required_argument, NULL, OPT_FLUSH_MS },
+    { NULL, 0, NULL, 0 },
+};
 
 int main(int argc, char** argv) {
     FILE *infile = stdin;
     FILE *outfile = stdout;
     FILE *priv;
     char *priv_name = "ss.priv";
+    char *out_name = NULL;
+    char *batch_name = NULL;
     int opt = 0;
     int verb = 0;
+    bool ranged = false;
+    FILE **shards = NULL;       // every -i given; more than one is a shard set
+    size_t nshards = 0;
+    uint64_t range_start = 0, range_len = 0;
+    size_t cache_slots = 0;
+    bool stream = false;
+    long flush_ms = -1;         // -1: not given
+
+    const char *tuned = tune_startup();
 
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'i': {
             infile = fopen(optarg, "r"); 
@@ -25,33 +60,125 @@ int main(int argc, char** argv) {
                 fprintf(stderr, "decrypt - Could not open infile: %s\n", optarg);
                 return EXIT_FAILURE;
             }
+            shards = (FILE **) realloc(shards, (nshards + 1) * sizeof(FILE *));
+            shards[nshards++] = infile;
             break;}
-        case 'o': {
-            outfile = fopen(optarg, "w");
-            if (!outfile) {
-                fprintf(stderr, "decrypt - Could not open outfile: %s\n", optarg);
-                fclose(infile);
+        case 'o': out_name = optarg; break;
+        case 'n': priv_name = optarg; break;
+        case 'r': { // start:len; both decimal, digits only
+            char *mid = NULL, *end = NULL;
+            errno = 0;
+            unsigned long long start = strtoull(optarg, &mid, 10);
+            bool valid = isdigit((unsigned char) optarg[0]) && *mid == ':' && isdigit((unsigned char) mid[1]);
+            unsigned long long len = valid ? strtoull(mid + 1, &end, 10) : 0;
+            if (!valid || *end != '\0' || errno) {
+                fprintf(stderr, "decrypt: invalid -r <start:len>: \"%s\"\n", optarg);
                 return EXIT_FAILURE;
             }
-            break;}
-        case 'n': priv_name = optarg; break;
+            range_start = (uint64_t) start;
+            range_len = (uint64_t) len;
+            ranged = true;
+            break;
+        }
+        case OPT_BATCH: batch_name = optarg; break;
+        case OPT_CACHE: { // slots; digits only
+            char *end = NULL;
+            unsigned long long slots = strtoull(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0') {
+                fprintf(stderr, "decrypt: invalid --cache <slots>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            cache_slots = (size_t) slots;
+            break;
+        }
+        case OPT_STREAM: stream = true; break;
+        case OPT_FLUSH_MS: { // milliseconds; digits only
+            char *end = NULL;
+            unsigned long ms = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || ms > SSIO_FLUSH_MS_MAX) {
+                fprintf(stderr, "decrypt: invalid --flush-ms <ms>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            flush_ms = (long) ms;
+            break;
+        }
+        case OPT_TRACE: {
+            if (!trace_open(optarg)) {
+                fprintf(stderr, "decrypt - Could not open trace file: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
         case 'v': verb = 1; break;
         case 'h':
             printf(
                 "SYNOPSIS\n"
                 "  Decrypts a file using Schmidt-Samoa (SS) private key.\n\n"
                 "USAGE\n"
-                "  decrypt [-hv] [-i infile] [-o outfile] [-n privkey]\n\n"
+                "  decrypt [-hv] [-i infile]... [-o outfile] [-n privkey] [-r start:len]\n"
+                "          [--batch list|dir] [--cache slots] [--stream [--flush-ms ms]]\n"
+                "          [--trace file.json]\n\n"
                 "OPTIONS\n"
-                "  -i infile     Input file (default: stdin).\n"
+                "  -i infile     Input file (default: stdin); repeat to decrypt a\n"
+                "                shard set (encrypt --shard), in any order; a single\n"
+                "                shard decrypts to the input bytes of its slice.\n"
                 "  -o outfile    Output file (default: stdout).\n"
                 "  -n privkey    Private key file (default: ss.priv).\n"
+                "  -r, --range start:len\n"
+                "                Decrypt only bytes [start, start+len) of an indexed\n"
+                "                container (encrypt -x); needs a seekable infile.\n"
+                "  --batch list|dir\n"
+                "                Decrypt every file of a directory, or named one per line\n"
+                "                in list, into the directory given by -o; the key is\n"
+                "                loaded once and files are spread over all threads.\n"
+                "  --cache slots Reuse the plaintext of repeated ciphertext lines, keeping\n"
+                "                up to slots distinct blocks (0 = off, the default; not\n"
+                "                with --batch or -r).\n"
+                "  --stream      Decrypt a live pipe line by line as it arrives, flushing\n"
+                "                the output at most --flush-ms ms (default 100) after\n"
+                "                the first plaintext byte since the last flush.\n"
+                "  --trace file.json\n"
+                "                Write a Chrome trace-event timeline (Perfetto).\n"
                 "  -v            Verbose output.\n"
                 "  -h            Display program usage.\n");
             return 0;
         }
     } // end of switch cases
 
+    if (nshards > 1 && ranged) {
+        fprintf(stderr, "decrypt - -r cannot be used with a shard set; merge it first\n");
+        return EXIT_FAILURE;
+    }
+    if (flush_ms >= 0 && !stream) {
+        fprintf(stderr, "decrypt - --flush-ms needs --stream\n");
+        return EXIT_FAILURE;
+    }
+    if (stream && (nshards > 1 || ranged || batch_name)) {
+        fprintf(stderr, "decrypt - --stream cannot be used with a shard set, -r or --batch\n");
+        return EXIT_FAILURE;
+    }
+    if (batch_name && (nshards > 0 || ranged || !out_name)) {
+        fprintf(stderr, "decrypt - --batch needs -o <outdir> and no -i or -r\n");
+        return EXIT_FAILURE;
+    }
+    if (cache_slots > 0 && (batch_name || ranged)) {
+        fprintf(stderr, "decrypt - --cache cannot be used with --batch or -r\n");
+        return EXIT_FAILURE;
+    }
+    if (out_name && !batch_name) {
+        outfile = fopen(out_name, "w");
+        if (!outfile) {
+            fprintf(stderr, "decrypt - Could not open outfile: %s\n", out_name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (verb && tuned) {
+        fprintf(stderr, "Tuning profile: %s\n", tuned);
+    }
+    tune_buffer(infile);
+    tune_buffer(outfile);
+
     // open private key file
     priv = fopen(priv_name, "r");
     if (!priv) {
@@ -65,7 +192,9 @@ int main(int argc, char** argv) {
     mpz_inits(d, pq, NULL);
 
     // read private key from private key file
+    uint64_t tr = trace_begin();
     ss_read_priv(pq, d, priv);
+    trace_end("key load", "io", tr);
 
     // verbose output
     if (verb) {
@@ -73,13 +202,55 @@ int main(int argc, char** argv) {
         gmp_fprintf(stderr, "Private key d (%zu bits): %Zd\n", mpz_sizeinbase(d, 2), d);
     }
 
-    // decrypt the input file
-    ss_decrypt_file(infile, outfile, d, pq);
+    // repeated ciphertext lines decrypt once
+    ssio_opts opts = { .threads = tune.threads };
+    if (cache_slots > 0) {
+        opts.cache = sscache_create(cache_slots);
+    }
+
+    // decrypt a whole batch, or the input file (legacy or indexed layout)
+    int status = EXIT_SUCCESS;
+    bool ok = true;
+    if (cache_slots > 0 && !opts.cache) {
+        fprintf(stderr, "decrypt - Could not allocate --cache of %zu slots\n", cache_slots);
+        status = EXIT_FAILURE;
+    } else if (batch_name) {
+        size_t count = 0;
+        char **paths = ssbatch_collect(batch_name, &count);
+        ssbatch_opts bo = { .prog = "decrypt", .decrypt = true, .d = d, .pq = pq, .outdir = out_name,
+                            .opts = opts, .verbose = verb };
+        if (!paths) {
+            fprintf(stderr, "decrypt - Could not read batch list or directory: %s\n", batch_name);
+            status = EXIT_FAILURE;
+        } else if (ssbatch_run(paths, count, &bo) > 0) {
+            status = EXIT_FAILURE;      // each failure was reported already
+        }
+        ssbatch_free(paths, count);
+    } else {
+        ok = nshards > 1 ? ssio_decrypt_shards(shards, nshards, outfile, d, pq, &opts)
+           : ranged      ? ssio_decrypt_range(infile, outfile, d, pq, range_start, range_len)
+           : stream      ? ssio_decrypt_live(infile, outfile, d, pq, &opts,
+                                             flush_ms >= 0 ? (unsigned) flush_ms : 100)
+                         : ssio_decrypt_file(infile, outfile, d, pq, &opts);
+    }
+    if (verb && opts.cache) {
+        sscache_print_stats(opts.cache, stderr);
+    }
+    if (!ok) {
+        fprintf(stderr, "decrypt - Malformed%s input\n",
+                nshards > 1 ? " or incomplete shard" : ranged ? " or non-seekable indexed" : "");
+        status = EXIT_FAILURE;
+    }
 
     // close files and clear state
-    if (infile  && infile  != stdin)  fclose(infile);
+    for (size_t i = 0; i < nshards; i++) {
+        fclose(shards[i]);
+    }
+    free(shards);
     if (outfile && outfile != stdout) fclose(outfile);
     fclose(priv);
+    sscache_destroy(opts.cache);
     mpz_clears(d, pq, NULL);
-    return EXIT_SUCCESS;
+    trace_close();
+    return status;
 }
@@ -1,25 +1,105 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
 #include <getopt.h>
+#include <sys/stat.h>
 #include <gmp.h>
 
 #include "numtheory.h"
 #include "randstate.h"
+#include "keyring.h"
 #include "ss.h"
+#include "ssbatch.h"
+#include "ssio.h"
+#include "trace.h"
+#include "tune.h"
 
-#define OPTIONS "i:o:n:vh"
+#define OPTIONS "i:o:n:R:K:t:xzvh"
+
+#define OPT_TRACE 256
+#define OPT_SHARD 257
+#define OPT_BATCH 258
+#define OPT_APPEND 259
+#define OPT_WITH_PRIV 260
+#define OPT_CACHE 261
+#define OPT_MANIFEST 262
+#define OPT_BASE 263
+#define OPT_BASE_MANIFEST 264
+#define OPT_STREAM 265
+#define OPT_FLUSH_MS 266
+
+static const struct option long_options[] = {
+    { "index", no_argument, NULL, 'x' },
+    { "compress", no_argument, NULL, 'z' },
+    { "recipients", required_argument, NULL, 'R' },
+    { "keyring", required_argument, NULL, 'K' },
+    { "threads", required_argument, NULL, 't' },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "shard", required_argument, NULL, OPT_SHARD },
+    { "batch", required_argument, NULL, OPT_BATCH },
+    { "append", no_argument, NULL, OPT_APPEND },
+    { "with-priv", required_argument, NULL, OPT_WITH_PRIV },
+    { "cache", required_argument, NULL, OPT_CACHE },
+    { "manifest", required_argument, NULL, OPT_MANIFEST },
+    { "base", required_argument, NULL, OPT_BASE },
+    { "base-manifest", required_argument, NULL, OPT_BASE_MANIFEST },
+    { "stream", no_argument, NULL, OPT_STREAM },
+    { "flush-ms", required_argument, NULL, OPT_FLUSH_MS },
+    { NULL, 0, NULL, 0 },
+};
+
+// append one public key file name to the recipient list
+static void add_recipient(char ***names, size_t *count, const char *name) {
+    *names = (char **) realloc(*names, (*count + 1) * sizeof(char *));
+    (*names)[(*count)++] = strdup(name);
+}
+
+// one public key file name per line; blank lines and #-comments are skipped
+static bool read_recipients(const char *path, char ***names, size_t *count) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        char *s = line;
+        while (isspace((unsigned char)*s)) s++;
+        size_t len = strlen(s);
+        while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+        if (len > 0 && s[0] != '#') {
+            add_recipient(names, count, s);
+        }
+    }
+    free(line);
+    fclose(f);
+    return true;
+}
 
 int main(int argc, char** argv) {
     FILE *infile = stdin;
-    FILE *outfile = stdout;
-    FILE *pub;
-    char username[100];
-    char *pub_name = "ss.pub";
+    char *out_name = NULL;
+    char *batch_name = NULL;
+    char *priv_name = NULL;
+    size_t cache_slots = 0;
+    char *manifest_name = NULL, *base_name = NULL, *base_manifest_name = NULL;
+    char username[SS_USERNAME_MAX];
+    char *ring_name = NULL;
+    char **pub_names = NULL;
+    size_t count = 0;
     int opt = 0;
     int verb = 0;
-    
+    bool sharded = false;
+    bool append = false;
+    bool stream = false;
+    long flush_ms = -1;         // -1: not given
+    uint32_t shard = 0, shards = 1;
+    const char *tuned = tune_startup();
+    ssio_opts opts = { .threads = tune.threads, .batch = tune.batch };
 
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'i': {
             infile = fopen(optarg, "r");
@@ -29,57 +109,361 @@ int main(int argc, char** argv) {
             }
             break;
         }
-        case 'o': {
-            outfile = fopen(optarg, "w");
-            if (!outfile) {
-                fprintf(stderr, "encrypt - Could not open outfile: %s\n", optarg);
-                fclose(infile);
+        case 'o': out_name = optarg; break;
+        case 'n': add_recipient(&pub_names, &count, optarg); break;
+        case 'R': {
+            if (!read_recipients(optarg, &pub_names, &count)) {
+                fprintf(stderr, "encrypt - Could not open recipients file: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'K': ring_name = optarg; break;
+        case 't': { // threads; digits only, 0 = online CPUs
+            char *end = NULL;
+            unsigned long t = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || t > SSIO_THREADS_MAX) {
+                fprintf(stderr, "encrypt: invalid -t <threads>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.threads = (unsigned) t;
+            break;
+        }
+        case OPT_TRACE: {
+            if (!trace_open(optarg)) {
+                fprintf(stderr, "encrypt - Could not open trace file: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case OPT_SHARD: { // i/N, 0-based
+            char tail;
+            if (sscanf(optarg, "%" SCNu32 "/%" SCNu32 "%c", &shard, &shards, &tail) != 2
+                || shards == 0 || shard >= shards) {
+                fprintf(stderr, "encrypt: invalid --shard <i/N>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            sharded = true;
+            break;
+        }
+        case OPT_BATCH: batch_name = optarg; break;
+        case OPT_APPEND: append = true; break;
+        case OPT_WITH_PRIV: priv_name = optarg; break;
+        case OPT_CACHE: { // slots; digits only
+            char *end = NULL;
+            unsigned long long slots = strtoull(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0') {
+                fprintf(stderr, "encrypt: invalid --cache <slots>: \"%s\"\n", optarg);
                 return EXIT_FAILURE;
             }
+            cache_slots = (size_t) slots;
             break;
         }
-        case 'n': pub_name = optarg; break;
+        case OPT_MANIFEST: manifest_name = optarg; break;
+        case OPT_BASE: base_name = optarg; break;
+        case OPT_BASE_MANIFEST: base_manifest_name = optarg; break;
+        case OPT_STREAM: stream = true; break;
+        case OPT_FLUSH_MS: { // milliseconds; digits only
+            char *end = NULL;
+            unsigned long ms = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || ms > SSIO_FLUSH_MS_MAX) {
+                fprintf(stderr, "encrypt: invalid --flush-ms <ms>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            flush_ms = (long) ms;
+            break;
+        }
+        case 'x': opts.flags |= SSIO_INDEXED; break;
+        case 'z': opts.flags |= SSIO_COMPRESSED | SSIO_INDEXED; break;
         case 'v': verb = 1; break;
         case 'h':
             printf(
                 "SYNOPSIS\n"
                 "  Encrypts a file using Schmidt-Samoa (SS) public key.\n\n"
                 "USAGE\n"
-                "  encrypt [-hv] [-i infile] [-o outfile] [-n pubkey]\n\n"
+                "  encrypt [-hvxz] [-i infile] [-o outfile] [-n pubkey]... [-R list] [-K keyring]\n"
+                "          [-t threads] [--shard i/N] [--batch list|dir] [--append]\n"
+                "          [--with-priv privkey]"
+                " [--cache slots] [--manifest file]\n"
+                "          [--base old --base-manifest file] [--stream [--flush-ms ms]]\n"
+                "          [--trace file.json]\n\n"
                 "OPTIONS\n"
                 "  -i infile     Input file (default: stdin).\n"
                 "  -o outfile     Output file (default: stdout).\n"
-                "  -n pubkey     Public key file (default: ss.pub).\n"
+                "  -n pubkey     Public key file (default: ss.pub); repeat for more recipients.\n"
+                "  -R, --recipients list\n"
+                "                File naming one public key file per line.\n"
+                "  -K, --keyring keyring\n"
+                "                Look up each -n/-R name in a keyring (sskeyring) by\n"
+                "                username or fingerprint instead of opening a file.\n"
+                "  -t, --threads threads\n"
+                "                Encryption threads (default: online CPUs).\n"
+                "  -x, --index   Write an indexed container (random-access decrypt).\n"
+                "  -z, --compress\n"
+                "                Compress before encrypting (implies -x).\n"
+                "  --shard i/N   Encrypt only block-aligned slice i (0-based) of N;\n"
+                "                needs a seekable -i infile. Reassemble with merge,\n"
+                "                or decrypt the whole set directly.\n"
+                "  --batch list|dir\n"
+                "                Encrypt every file of a directory, or named one per line\n"
+                "                in list, into the directory given by -o; the key is\n"
+                "                loaded once and files are spread over all threads.\n"
+                "  --append      Update outfile, encrypted earlier from a shorter -i infile,\n"
+                "                re-encrypting only its last block and the new bytes;\n"
+                "                refused if outfile is not infile's start under -n.\n"
+                "  --with-priv privkey\n"
+                "                Encrypt to your own key about 3x faster using its private\n"
+                "                key file; the output is the same as without it.\n"
+                "  --cache slots Reuse the ciphertext of repeated input blocks (zero-filled\n"
+                "                or sparse files), keeping up to slots distinct blocks\n"
+                "                (0 = off, the default; one recipient, no --batch).\n"
+                "  --manifest file\n"
+                "                Also write the block fingerprints of the output to file.\n"
+                "  --base old --base-manifest file\n"
+                "                Copy the blocks that are unchanged since old was written\n"
+                "                (with --manifest file) and encrypt only the rest; the\n"
+                "                output is the same as a full run.\n"
+                "  --stream      Encrypt a live pipe as data arrives: input waits at most\n"
+                "                --flush-ms ms (default 100) before it is written out as a\n"
+                "                possibly short block and the output is flushed. Always\n"
+                "                writes the indexed layout (as -x).\n"
+                "  --trace file.json\n"
+                "                Write a Chrome trace-event timeline (Perfetto).\n"
                 "  -v            Verbose output.\n"
-                "  -h            Display program usage.\n");
+                "  -h            Display program usage.\n\n"
+                "  With several recipients the input is read once and recipient i\n"
+                "  (0-based, in the order given) is written to <outfile>.<i>.\n");
             return 0;
+        default:
+            return EXIT_FAILURE;
         }
     } // end of switch cases
 
-    // open public key file
-    pub = fopen(pub_name, "r");
-    if (!pub) {
-        fprintf(stderr, "encrypt - Could not open public key file: %s\n", pub_name);
+    if (ring_name && count == 0) {
+        fprintf(stderr, "encrypt - -K needs -n or -R naming the recipients\n");
+        return EXIT_FAILURE;
+    }
+    if (count == 0) {
+        add_recipient(&pub_names, &count, "ss.pub");
+    }
+    if (sharded && (count > 1 || (opts.flags & SSIO_COMPRESSED) || infile == stdin)) {
+        fprintf(stderr, "encrypt - --shard needs -i <infile>, one recipient and no -z\n");
+        return EXIT_FAILURE;
+    }
+    if (batch_name && (count > 1 || sharded || infile != stdin || !out_name)) {
+        fprintf(stderr, "encrypt - --batch needs -o <outdir>, one recipient and no -i or --shard\n");
+        return EXIT_FAILURE;
+    }
+    if (append && (count > 1 || sharded || batch_name || (opts.flags & SSIO_COMPRESSED)
+                   || infile == stdin || !out_name)) {
+        fprintf(stderr, "encrypt - --append needs -i <infile>, -o <outfile>, one recipient and no -z\n");
+        return EXIT_FAILURE;
+    }
+    bool delta = manifest_name || base_name || base_manifest_name;
+    if (delta && (count > 1 || sharded || batch_name || append || (opts.flags & SSIO_COMPRESSED)
+                  || !out_name || !base_name != !base_manifest_name)) {
+        fprintf(stderr, "encrypt - --manifest and --base/--base-manifest need -o <outfile>, one recipient\n"
+                        "          and no --shard, --batch, --append or -z; --base needs --base-manifest\n");
+        return EXIT_FAILURE;
+    }
+    struct stat so, sb;
+    if (base_name && stat(out_name, &so) == 0 && stat(base_name, &sb) == 0
+        && so.st_dev == sb.st_dev && so.st_ino == sb.st_ino) {
+        fprintf(stderr, "encrypt - --base must not be the output file: %s\n", base_name);
+        return EXIT_FAILURE;
+    }
+    if (flush_ms >= 0 && !stream) {
+        fprintf(stderr, "encrypt - --flush-ms needs --stream\n");
+        return EXIT_FAILURE;
+    }
+    if (stream && (sharded || batch_name || append || delta || (opts.flags & SSIO_COMPRESSED))) {
+        fprintf(stderr, "encrypt - --stream cannot be used with --shard, --batch, --append, --base or -z\n");
+        return EXIT_FAILURE;
+    }
+    if (cache_slots > 0 && (count > 1 || batch_name)) {
+        fprintf(stderr, "encrypt - --cache needs one recipient and no --batch\n");
+        return EXIT_FAILURE;
+    }
+    if (priv_name && count > 1) {
+        fprintf(stderr, "encrypt - --with-priv needs the one matching recipient\n");
+        return EXIT_FAILURE;
+    }
+    if (count > 1 && !out_name) {
+        fprintf(stderr, "encrypt - Several recipients need -o <outfile> as output name base\n");
+        return EXIT_FAILURE;
+    }
+
+    if (verb && tuned) {
+        fprintf(stderr, "Tuning profile: %s\n", tuned);
+    }
+    tune_buffer(infile);
+
+    keyring *ring = NULL;
+    if (ring_name && !(ring = keyring_open(ring_name, 0))) {
+        fprintf(stderr, "encrypt - Could not open keyring: %s\n", ring_name);
         return EXIT_FAILURE;
     }
 
-    mpz_t n;
-    mpz_init(n);
+    FILE **outfiles = (FILE **) calloc(count, sizeof(FILE *));
+    mpz_t *ns = (mpz_t *) malloc(count * sizeof(mpz_t));
+    int status = EXIT_SUCCESS;
+    size_t ready = 0;
+
+    for (; ready < count; ready++) {
+        mpz_init(ns[ready]);
+
+        // look the key up in the keyring, or open public key file and read public key
+        uint64_t tr = trace_begin();
+        if (ring) {
+            const keyring_key *key = keyring_find(ring, pub_names[ready]);
+            if (!key) {
+                fprintf(stderr, "encrypt - Key not in keyring: %s\n", pub_names[ready]);
+                status = EXIT_FAILURE;
+                ready++;
+                break;
+            }
+            mpz_set(ns[ready], key->n);
+            snprintf(username, sizeof(username), "%s", key->username);
+            keyring_release(ring, key);
+        } else {
+            FILE *pub = fopen(pub_names[ready], "r");
+            if (!pub) {
+                fprintf(stderr, "encrypt - Could not open public key file: %s\n", pub_names[ready]);
+                status = EXIT_FAILURE;
+                ready++;
+                break;
+            }
+            ss_read_pub(ns[ready], username, pub);
+            fclose(pub);
+        }
+        trace_end("key load", "io", tr);
+
+        // open this recipient's output; batch outputs are opened per file
+        if (!out_name || batch_name) {
+            outfiles[ready] = stdout;
+        } else if (append) {
+            outfiles[ready] = fopen(out_name, "r+");
+            if (!outfiles[ready]) {
+                outfiles[ready] = fopen(out_name, "w+");    // first run: nothing to keep
+            }
+        } else if (count == 1) {
+            outfiles[ready] = fopen(out_name, "w");
+        } else {
+            size_t len = strlen(out_name) + 24;
+            char *name = (char *) malloc(len);
+            snprintf(name, len, "%s.%zu", out_name, ready);
+            outfiles[ready] = fopen(name, "w");
+            if (verb && outfiles[ready]) {
+                fprintf(stderr, "Recipient %zu: %s -> %s\n", ready, pub_names[ready], name);
+            }
+            free(name);
+        }
+        if (!outfiles[ready]) {
+            fprintf(stderr, "encrypt - Could not open outfile for: %s\n", pub_names[ready]);
+            status = EXIT_FAILURE;
+            ready++;
+            break;
+        }
+        tune_buffer(outfiles[ready]);
+
+        // verbose output
+        if (verb) {
+            fprintf(stderr, "Username: %s\n", username);
+            gmp_fprintf(stderr, "Public key n  (%zu bits) = %Zd\n", mpz_sizeinbase(ns[ready], 2), ns[ready]);
+        }
+    }
 
-    // read public key from public key file
-    ss_read_pub(n, username, pub);
+    // the key owner encrypts through the private factors
+    ss_crt_key crt;
+    bool have_crt = false;
+    if (status == EXIT_SUCCESS && priv_name) {
+        FILE *priv = fopen(priv_name, "r");
+        if (!priv) {
+            fprintf(stderr, "encrypt - Could not open private key file: %s\n", priv_name);
+            status = EXIT_FAILURE;
+        } else {
+            mpz_t d, pq;
+            mpz_inits(d, pq, NULL);
+            ss_read_priv(pq, d, priv);
+            fclose(priv);
+            have_crt = ss_crt_init(&crt, d, pq, ns[0]);
+            mpz_clears(d, pq, NULL);
+            if (!have_crt) {
+                fprintf(stderr, "encrypt - Private key does not match public key: %s\n", priv_name);
+                status = EXIT_FAILURE;
+            } else {
+                opts.crt = &crt;
+            }
+        }
+    }
 
-    // verbose output
-    if (verb) {
-        fprintf(stderr, "Username: %s\n", username);
-        gmp_fprintf(stderr, "Public key n  (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+    // repeated blocks encrypt once
+    if (cache_slots > 0) {
+        opts.cache = sscache_create(cache_slots);
+        if (!opts.cache) {
+            fprintf(stderr, "encrypt - Could not allocate --cache of %zu slots\n", cache_slots);
+            status = EXIT_FAILURE;
+        }
     }
 
-    // encrypt file & clean up
-    ss_encrypt_file(infile, outfile, n);
-    if (infile  && infile  != stdin)  fclose(infile);
-    if (outfile && outfile != stdout) fclose(outfile);
-    fclose(pub);
-    mpz_clear(n);
-    return EXIT_SUCCESS;
+    // encrypt a whole batch, or the input file, & clean up
+    bool ok = true;
+    if (status == EXIT_SUCCESS && batch_name) {
+        size_t files = 0;
+        char **paths = ssbatch_collect(batch_name, &files);
+        ssbatch_opts bo = { .prog = "encrypt", .n = ns[0], .outdir = out_name, .opts = opts, .verbose = verb };
+        if (!paths) {
+            fprintf(stderr, "encrypt - Could not read batch list or directory: %s\n", batch_name);
+            status = EXIT_FAILURE;
+        } else if (ssbatch_run(paths, files, &bo) > 0) {
+            status = EXIT_FAILURE;      // each failure was reported already
+        }
+        ssbatch_free(paths, files);
+    } else if (status == EXIT_SUCCESS && delta) {
+        FILE *man = manifest_name ? fopen(manifest_name, "w") : NULL;
+        FILE *base = base_name ? fopen(base_name, "r") : NULL;
+        FILE *base_man = base_manifest_name ? fopen(base_manifest_name, "r") : NULL;
+        uint64_t reused = 0;
+        if ((manifest_name && !man) || (base_name && !base) || (base_manifest_name && !base_man)) {
+            fprintf(stderr, "encrypt - Could not open manifest or base file\n");
+            status = EXIT_FAILURE;
+        } else if (!ssio_encrypt_delta(infile, outfiles[0], ns[0], &opts, man, base, base_man, &reused)) {
+            fprintf(stderr, "encrypt - Could not encrypt input against base (wrong key, layout or manifest?)\n");
+            status = EXIT_FAILURE;
+        } else if (verb) {
+            fprintf(stderr, "Blocks reused from base: %" PRIu64 "\n", reused);
+        }
+        if (man) fclose(man);
+        if (base) fclose(base);
+        if (base_man) fclose(base_man);
+    } else if (status == EXIT_SUCCESS) {
+        ok = sharded ? ssio_encrypt_shard(infile, outfiles[0], ns[0], &opts, shard, shards)
+           : append  ? ssio_encrypt_append(infile, outfiles[0], ns[0], &opts)
+           : stream  ? ssio_encrypt_live(infile, outfiles, ns, count, &opts,
+                                         flush_ms >= 0 ? (unsigned) flush_ms : 100)
+                     : ssio_encrypt_multi(infile, outfiles, ns, count, &opts);
+    }
+    if (!ok) {
+        fprintf(stderr, "encrypt - Could not encrypt input\n");
+        status = EXIT_FAILURE;
+    }
+    if (verb && opts.cache) {
+        sscache_print_stats(opts.cache, stderr);
+    }
+    sscache_destroy(opts.cache);
+    if (infile && infile != stdin) fclose(infile);
+    for (size_t i = 0; i < ready; i++) {
+        if (outfiles[i] && outfiles[i] != stdout) fclose(outfiles[i]);
+        mpz_clear(ns[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(pub_names[i]);
+    }
+    free(pub_names);
+    if (have_crt) ss_crt_clear(&crt);
+    if (ring) keyring_close(ring);
+    free(outfiles);
+    free(ns);
+    trace_close();
+    return status;
 }
@@ -1,19 +1,69 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <sys/stat.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdbool.h>
 #include <gmp.h>
 
 #include "numtheory.h"
 #include "randstate.h"
 #include "ss.h"
+#include "primepool.h"
+#include "trace.h"
+#include "tune.h"
 
-#define OPTIONS "b:i:n:d:s:vh"
+#define OPTIONS "b:i:n:d:s:P:vh"
+
+#define OPT_FILL_POOL 256
+#define OPT_TRACE     257
+#define OPT_PROFILE   258
+
+#define COST_SECS 0.05      // time decryption for at least this long
+#define COST_MIN  3         // and over at least this many blocks
+#define COST_MAX  1000
+
+// how the bit-lengths of p and q are chosen
+typedef enum {
+    SPLIT_RANDOM,           // ss_pick_pbits, or what the prime pool holds
+    SPLIT_FAST,             // smallest pq, cheapest decryption
+    SPLIT_PQ,               // pq of a requested size
+} split_profile;
+
+static const struct option long_options[] = {
+    { "pool", required_argument, NULL, 'P' },
+    { "fill-pool", required_argument, NULL, OPT_FILL_POOL },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "profile", required_argument, NULL, OPT_PROFILE },
+    { NULL, 0, NULL, 0 },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// seconds per ss_decrypt of one block under (d, pq)
+static double decrypt_cost(const mpz_t d, const mpz_t pq) {
+    mpz_t c, m;
+    mpz_inits(c, m, NULL);
+    uint64_t reps = 0;
+    double t0 = now();
+    do {
+        rng_urandomm(randstate(), c, pq);
+        ss_decrypt(m, c, d, pq);
+        reps++;
+    } while (reps < COST_MAX && (reps < COST_MIN || now() - t0 < COST_SECS));
+    double t = now() - t0;
+    mpz_clears(c, m, NULL);
+    return t / reps;
+}
 
 int main(int argc, char** argv) {
     uint64_t bits = 1024;
@@ -25,8 +75,16 @@ int main(int argc, char** argv) {
     char *priv_name = "ss.priv";
     int opt = 0;
     int verb = 0;
+    const char *pool_name = getenv("SS_PRIME_POOL");
+    uint64_t fill = 0;
+    const char *trace_name = NULL;
+    split_profile profile = SPLIT_RANDOM;
+    bool profiled = false;      // --profile given: report the decrypt cost
+    uint64_t pq_bits = 0;
+
+    const char *tuned = tune_startup();
 
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'b': { // bits; digits >= 1
             for (const char *t = optarg; *t; t++) {
@@ -81,25 +139,128 @@ int main(int argc, char** argv) {
             seed = (uint64_t) val;
             break;
         }
+        case 'P': pool_name = optarg; break;
+        case OPT_FILL_POOL: { // key count; digits >= 1
+            for (const char *t = optarg; *t; t++) {
+                if (!isdigit((unsigned char)*t)) {
+                    fprintf(stderr, "keygen: invalid --fill-pool <count>: \"%s\"\n", optarg);
+                    return EXIT_FAILURE;
+                }
+            }
+            errno = 0;
+            char *end = NULL;
+            unsigned long long val = strtoull(optarg, &end, 10);
+            if (errno || end == optarg || *end != '\0' || val < 1ULL) {
+                fprintf(stderr, "keygen: invalid --fill-pool <count>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            fill = (uint64_t) val;
+            break;
+        }
+        case OPT_TRACE: trace_name = optarg; break;
+        case OPT_PROFILE: { // random | fast | pq=<bits>
+            if (strcmp(optarg, "random") == 0) {
+                profile = SPLIT_RANDOM;
+            } else if (strcmp(optarg, "fast") == 0) {
+                profile = SPLIT_FAST;
+            } else if (strncmp(optarg, "pq=", 3) == 0 && isdigit((unsigned char)optarg[3])) {
+                errno = 0;
+                char *end = NULL;
+                unsigned long long val = strtoull(optarg + 3, &end, 10);
+                if (errno || *end != '\0' || val < 1ULL) {
+                    fprintf(stderr, "keygen: invalid --profile: \"%s\"\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                profile = SPLIT_PQ;
+                pq_bits = (uint64_t) val;
+            } else {
+                fprintf(stderr, "keygen: invalid --profile: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            profiled = true;
+            break;
+        }
         case 'v': verb = 1; break;
         case 'h':
             printf(
                 "SYNOPSIS\n"
                 "  Generate Schmidt-Samoa (SS) public and private keys.\n\n"
                 "USAGE\n"
-                "  keygen [-hv] [-b bits] [-i iters] [-n pbfile] [-d pvfile] [-s seed]\n\n"
+                "  keygen [-hv] [-b bits] [-i iters] [-n pbfile] [-d pvfile] [-s seed] [-P pool]\n"
+                "         [--profile random|fast|pq=bits] [--trace file.json]\n"
+                "  keygen --fill-pool count [-b bits] [-i iters] [-s seed] [-P pool]\n\n"
                 "OPTIONS\n"
                 "  -b bits       Min bit-length of modulus n (default: 1024).\n"
                 "  -i iters      Miller-Rabin iterations (default: 50).\n"
                 "  -n pbfile     Public key output (default: ss.pub).\n"
                 "  -d pvfile     Private key output (default: ss.priv).\n"
                 "  -s seed       RNG seed (default: time(NULL)).\n"
+                "  -P, --pool pool\n"
+                "                Draw p and q from this prime pool when it has them\n"
+                "                (default: $SS_PRIME_POOL, else search live).\n"
+                "  --profile random|fast|pq=bits\n"
+                "                How to split n into p^2 * q: random (default; or what\n"
+                "                the pool holds), fast (smallest pq, cheapest\n"
+                "                decryption), or pq=bits (private modulus of about that\n"
+                "                size). Splits stay within nbits/5 <= bits(p) < 2*nbits/5.\n"
+                "                Reports the expected decrypt cost per block on stderr.\n"
+                "  --fill-pool count\n"
+                "                Add primes for count keys of -b bits to the pool\n"
+                "                (default pool: ss.pool) instead of making a key;\n"
+                "                seeded from the OS, so -s does not apply.\n"
+                "  --trace file.json\n"
+                "                Write a Chrome trace-event timeline (Perfetto).\n"
                 "  -v            Verbose output.\n"
                 "  -h            Display program usage.\n");
             return 0;
         }
     }
 
+    // a fixed pq size must be reachable within the safe bounds
+    uint64_t pq_lo = 0, pq_hi = 0;
+    bool pq_any = ss_pq_range(bits, &pq_lo, &pq_hi);
+    if (profile == SPLIT_PQ && !ss_pbits_for_pq(bits, pq_bits)) {
+        if (pq_any) {
+            fprintf(stderr, "keygen: --profile pq=%" PRIu64 " out of range for -b %" PRIu64
+                    " (pq=%" PRIu64 "..%" PRIu64 ")\n", pq_bits, bits, pq_lo, pq_hi);
+        } else {
+            fprintf(stderr, "keygen: --profile pq=%" PRIu64 " out of range for -b %" PRIu64
+                    " (no pq= fits)\n", pq_bits, bits);
+        }
+        return EXIT_FAILURE;
+    }
+
+    if (trace_name && !trace_open(trace_name)) {
+        fprintf(stderr, "keygen -  Could not open trace file: %s\n", trace_name);
+        return EXIT_FAILURE;
+    }
+
+    // pool filling mode: no key files are touched
+    if (fill) {
+        if (!pool_name) {
+            pool_name = "ss.pool";
+        }
+        // never the key seed: fills sharing one would append the same primes
+        if (!randstate_init_os()) {
+            fprintf(stderr, "keygen -  No OS randomness to fill the prime pool with\n");
+            trace_close();
+            return EXIT_FAILURE;
+        }
+        uint64_t tr = trace_begin();
+        bool ok = primepool_fill(pool_name, bits, fill, iters);
+        trace_end_arg("fill pool", "keygen", tr, "keys", fill);
+        randstate_clear();
+        trace_close();
+        if (!ok) {
+            fprintf(stderr, "keygen -  Could not write prime pool: %s\n", pool_name);
+            return EXIT_FAILURE;
+        }
+        if (verb) {
+            fprintf(stderr, "Added primes for %" PRIu64 " keys of %" PRIu64 " bits to %s\n", fill, bits, pool_name);
+        }
+        return EXIT_SUCCESS;
+    }
+
     //read files with error checks
     pub = fopen(pub_name, "w");
     if (!pub) {
@@ -124,8 +285,32 @@ int main(int argc, char** argv) {
     mpz_inits(p, q, n, d, pq, NULL);
 
     // make keys
-    ss_make_pub(p, q, n, bits, iters);  // p,q are primes; n = p^2 * q
+    // a random split prefers what the prime pool can serve; missing primes are
+    // searched live
+    ss_keygen_stats stats;
+    primepool_source pool = { .path = pool_name, .iters = iters };
+    uint64_t pbits;
+    uint64_t tr = trace_begin();
+    switch (profile) {
+    case SPLIT_FAST: pbits = ss_pick_pbits_fast(bits); break;
+    case SPLIT_PQ: pbits = ss_pbits_for_pq(bits, pq_bits); break;
+    default:
+        if (!pool_name || !primepool_pick_pbits(pool_name, bits, &pbits)) {
+            pbits = ss_pick_pbits(bits);
+        }
+        break;
+    }
+    trace_end_arg("pick split", "keygen", tr, "pbits", pbits);
+    if (pool_name) {
+        ss_set_prime_source(primepool_source_take, &pool);
+    }
+    tr = trace_begin();
+    ss_make_pub_split(p, q, n, bits, pbits, iters, &stats);  // p,q are primes; n = p^2 * q
+    trace_end_arg("make_pub", "keygen", tr, "bits", bits);
+    ss_set_prime_source(NULL, NULL);
+    tr = trace_begin();
     ss_make_priv(d, pq, p, q);          // pq = p*q ; d = n^{-1} mod lcm(p-1,q-1)
+    trace_end("make_priv", "keygen", tr);
 
     // get username
     const char *user = getenv("USER"); 
@@ -134,17 +319,43 @@ int main(int argc, char** argv) {
     }
 
     // write keys to files
+    tr = trace_begin();
     ss_write_pub(n, user, pub);
     ss_write_priv(pq, d, priv);
+    trace_end("write keys", "io", tr);
 
     // verbose output
     if (verb) {
+        if (tuned) {
+            fprintf(stderr, "Tuning profile: %s\n", tuned);
+        }
         fprintf(stderr, "Username: %s\n", user);
         gmp_fprintf(stderr, "First large prime p  (%zu bits) = %Zd\n", mpz_sizeinbase(p, 2), p);
         gmp_fprintf(stderr, "Second large prime q  (%zu bits) = %Zd\n", mpz_sizeinbase(q, 2), q);
         gmp_fprintf(stderr, "Public key n  (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
         gmp_fprintf(stderr, "Private exponent d  (%zu bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
         gmp_fprintf(stderr, "Private modulus pq (%zu bits) = %Zd\n", mpz_sizeinbase(pq, 2), pq);
+        static const char *profiles[] = { "random", "fast", "pq" };
+        fprintf(stderr, "Split profile: %s (p %" PRIu64 " bits, q %" PRIu64 " bits)\n",
+                profiles[profile], pbits, ss_qbits(bits, pbits));
+    }
+
+    // the cost of the chosen split, with or without -v, whenever one was asked for
+    if (verb || profiled) {
+        fprintf(stderr, "Decrypt cost: %.1f us/block (pq %zu bits", decrypt_cost(d, pq) * 1e6,
+                mpz_sizeinbase(pq, 2));
+        if (pq_any) {
+            fprintf(stderr, "; -b %" PRIu64 " takes pq=%" PRIu64 "..%" PRIu64, bits, pq_lo, pq_hi);
+        }
+        fprintf(stderr, ")\n");
+    }
+
+    if (verb) {
+        fprintf(stderr, "Prime retries: p %" PRIu64 ", q %" PRIu64 "\n", stats.p_retries, stats.q_retries);
+        if (pool_name) {
+            fprintf(stderr, "Prime pool %s: %" PRIu64 " drawn, %" PRIu64 " searched live\n",
+                    pool_name, pool.hits, pool.misses);
+        }
         fprintf(stderr, "Seed: %" PRIu64 "\n", seed);
     }
     
@@ -153,5 +364,6 @@ int main(int argc, char** argv) {
     fclose(priv);
     randstate_clear();
     mpz_clears(p, q, n, d, pq, NULL);
+    trace_close();
     return EXIT_SUCCESS;
 }
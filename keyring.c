@@ -0,0 +1,363 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "keyring.h"
+#include "sha256.h"
+
+struct keyring {
+    const char *map;
+    size_t size;
+    uint64_t count;
+    uint64_t slots;
+    uint64_t records;           // offset of the first record
+
+    // key context cache
+    pthread_mutex_t lock;
+    keyring_key **buckets;      // hash chains by fingerprint
+    size_t nbuckets;            // a power of two
+    keyring_key *head, *tail;   // LRU list
+    size_t cached;
+    size_t cap;
+    keyring_stats stats;
+};
+
+// one record line, parsed in place
+typedef struct {
+    uint64_t fingerprint;
+    const char *n;              // hex digits
+    size_t n_len;
+    const char *user;
+    size_t user_len;
+    uint64_t end;               // offset just past the line
+} keyring_record;
+
+uint64_t keyring_name_hash(const char *username) {
+    uint8_t digest[SHA256_LEN];
+    sha256(username, strlen(username), digest);
+    uint64_t h = 0;
+    for (int i = 0; i < 8; i++) {
+        h = h << 8 | digest[i];
+    }
+    return h;
+}
+
+static bool parse_hex16(const char *p, uint64_t *v) {
+    uint64_t x = 0;
+    for (int i = 0; i < 16; i++) {
+        int c = p[i];
+        if (c >= '0' && c <= '9') x = x << 4 | (uint64_t) (c - '0');
+        else if (c >= 'a' && c <= 'f') x = x << 4 | (uint64_t) (c - 'a' + 10);
+        else return false;
+    }
+    *v = x;
+    return true;
+}
+
+static bool valid_username(const char *s) {
+    size_t len = strlen(s);
+    if (len == 0 || len >= SS_USERNAME_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (isspace((unsigned char) s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// writing
+//
+
+typedef struct {
+    uint64_t hash;
+    uint64_t off;               // 0: empty
+    size_t key;                 // index of the key in the input
+} keyring_slot;
+
+// insert into an open-addressed table; false if an equal key is there already
+static bool slot_insert(keyring_slot *t, uint64_t slots, uint64_t hash, uint64_t off, size_t key,
+                        bool (*same)(size_t a, size_t b, void *ctx), void *ctx) {
+    for (uint64_t i = hash % slots; ; i = (i + 1) % slots) {
+        if (t[i].off == 0) {
+            t[i] = (keyring_slot) { .hash = hash, .off = off, .key = key };
+            return true;
+        }
+        if (t[i].hash == hash && same(t[i].key, key, ctx)) {
+            return false;
+        }
+    }
+}
+
+typedef struct {
+    char **usernames;
+} keyring_input;
+
+// fingerprints identify cached keys: equal ones are refused even for distinct n
+static bool same_key(size_t a, size_t b, void *ctx) {
+    (void) a, (void) b, (void) ctx;
+    return true;
+}
+
+static bool same_user(size_t a, size_t b, void *ctx) {
+    keyring_input *in = (keyring_input *) ctx;
+    return strcmp(in->usernames[a], in->usernames[b]) == 0;
+}
+
+static bool write_table(FILE *out, const keyring_slot *t, uint64_t slots) {
+    for (uint64_t i = 0; i < slots; i++) {
+        if (fprintf(out, "%016" PRIx64 " %016" PRIx64 "\n", t[i].hash, t[i].off) != KEYRING_SLOT_LEN) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool keyring_write(FILE *out, mpz_t *ns, char **usernames, size_t count) {
+    // at most half full, so probes stay short
+    uint64_t slots = 2;
+    while (slots < 2 * (uint64_t) count) {
+        slots *= 2;
+    }
+    keyring_slot *by_fp = (keyring_slot *) calloc(slots, sizeof(keyring_slot));
+    keyring_slot *by_user = (keyring_slot *) calloc(slots, sizeof(keyring_slot));
+    uint64_t *fps = (uint64_t *) malloc((count ? count : 1) * sizeof(uint64_t));
+    keyring_input in = { .usernames = usernames };
+
+    // records follow the tables; lay them out and index them
+    uint64_t off = KEYRING_HEADER_LEN + 2 * slots * KEYRING_SLOT_LEN;
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; i++) {
+        fps[i] = ss_fingerprint(ns[i]);
+        ok = valid_username(usernames[i])
+            && slot_insert(by_fp, slots, fps[i], off, i, same_key, &in)
+            && slot_insert(by_user, slots, keyring_name_hash(usernames[i]), off, i, same_user, &in);
+        off += 16 + 1 + mpz_sizeinbase(ns[i], 16) + 1 + strlen(usernames[i]) + 1;
+    }
+
+    if (ok) {
+        ok = fprintf(out, "#ssr1 keys=%016" PRIx64 " slots=%016" PRIx64 "\n", (uint64_t) count, slots)
+                 == KEYRING_HEADER_LEN
+            && write_table(out, by_fp, slots) && write_table(out, by_user, slots);
+        for (size_t i = 0; ok && i < count; i++) {
+            ok = gmp_fprintf(out, "%016" PRIx64 " %Zx %s\n", fps[i], ns[i], usernames[i]) > 0;
+        }
+        ok = ok && fflush(out) == 0 && !ferror(out);
+    }
+    free(by_fp);
+    free(by_user);
+    free(fps);
+    return ok;
+}
+
+//
+// reading
+//
+
+keyring *keyring_open(const char *path, size_t cache) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= KEYRING_HEADER_LEN) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);      // the mapping stays
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    keyring *kr = (keyring *) calloc(1, sizeof(keyring));
+    kr->map = (const char *) map;
+    kr->size = (size_t) st.st_size;
+    bool ok = memcmp(kr->map, "#ssr1 keys=", 11) == 0 && parse_hex16(kr->map + 11, &kr->count)
+        && memcmp(kr->map + 27, " slots=", 7) == 0 && parse_hex16(kr->map + 34, &kr->slots)
+        && kr->slots > 0 && kr->count <= kr->slots
+        && kr->slots <= (kr->size - KEYRING_HEADER_LEN) / (2 * KEYRING_SLOT_LEN);
+    if (!ok) {
+        munmap(map, kr->size);
+        free(kr);
+        return NULL;
+    }
+    kr->records = KEYRING_HEADER_LEN + 2 * kr->slots * KEYRING_SLOT_LEN;
+
+    kr->cap = cache ? cache : 256;
+    kr->nbuckets = 16;
+    while (kr->nbuckets < kr->cap) {
+        kr->nbuckets *= 2;
+    }
+    kr->buckets = (keyring_key **) calloc(kr->nbuckets, sizeof(keyring_key *));
+    pthread_mutex_init(&kr->lock, NULL);
+    return kr;
+}
+
+static void free_key(keyring_key *key) {
+    mpz_clear(key->n);
+    free(key);
+}
+
+void keyring_close(keyring *kr) {
+    if (!kr) {
+        return;
+    }
+    for (keyring_key *key = kr->head, *next; key; key = next) {
+        next = key->next;
+        free_key(key);
+    }
+    free(kr->buckets);
+    pthread_mutex_destroy(&kr->lock);
+    munmap((void *) kr->map, kr->size);
+    free(kr);
+}
+
+uint64_t keyring_count(const keyring *kr) {
+    return kr->count;
+}
+
+// parse the record line at off, bounds-checked against the mapping
+static bool record_at(const keyring *kr, uint64_t off, keyring_record *rec) {
+    if (off < kr->records || off + 18 > kr->size || !parse_hex16(kr->map + off, &rec->fingerprint)
+        || kr->map[off + 16] != ' ') {
+        return false;
+    }
+    const char *p = kr->map + off + 17, *end = kr->map + kr->size;
+    rec->n = p;
+    while (p < end && isxdigit((unsigned char) *p)) p++;
+    rec->n_len = (size_t) (p - rec->n);
+    if (p >= end || *p != ' ' || rec->n_len == 0) {
+        return false;
+    }
+    rec->user = ++p;
+    while (p < end && *p != '\n' && *p != ' ') p++;
+    rec->user_len = (size_t) (p - rec->user);
+    if (p >= end || *p != '\n' || rec->user_len == 0 || rec->user_len >= SS_USERNAME_MAX) {
+        return false;
+    }
+    rec->end = (uint64_t) (p + 1 - kr->map);
+    return true;
+}
+
+// probe table (0: by fingerprint, 1: by username) for a matching record
+static bool probe(const keyring *kr, int table, uint64_t hash, uint64_t fp, const char *name,
+                  keyring_record *rec) {
+    const char *base = kr->map + KEYRING_HEADER_LEN + (uint64_t) table * kr->slots * KEYRING_SLOT_LEN;
+    for (uint64_t n = 0, i = hash % kr->slots; n < kr->slots; n++, i = (i + 1) % kr->slots) {
+        uint64_t h, off;
+        const char *line = base + i * KEYRING_SLOT_LEN;
+        if (!parse_hex16(line, &h) || !parse_hex16(line + 17, &off) || off == 0) {
+            return false;
+        }
+        if (h == hash && record_at(kr, off, rec)
+            && (table == 0 ? rec->fingerprint == fp
+                           : rec->user_len == strlen(name) && memcmp(rec->user, name, rec->user_len) == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void lru_unlink(keyring *kr, keyring_key *key) {
+    if (key->prev) key->prev->next = key->next; else kr->head = key->next;
+    if (key->next) key->next->prev = key->prev; else kr->tail = key->prev;
+    key->prev = key->next = NULL;
+}
+
+static void lru_push(keyring *kr, keyring_key *key) {
+    key->next = kr->head;
+    key->prev = NULL;
+    if (kr->head) kr->head->prev = key; else kr->tail = key;
+    kr->head = key;
+}
+
+// drop least recently used contexts nobody holds until the cache fits; locked
+static void evict(keyring *kr) {
+    keyring_key *key = kr->tail;
+    while (kr->cached > kr->cap && key) {
+        keyring_key *prev = key->prev;
+        if (key->refs == 0) {
+            keyring_key **link = &kr->buckets[key->fingerprint & (kr->nbuckets - 1)];
+            while (*link != key) link = &(*link)->chain;
+            *link = key->chain;
+            lru_unlink(kr, key);
+            free_key(key);
+            kr->cached--;
+            kr->stats.evictions++;
+        }
+        key = prev;
+    }
+}
+
+// the cached context of a record, parsed on a miss
+static const keyring_key *acquire(keyring *kr, const keyring_record *rec) {
+    pthread_mutex_lock(&kr->lock);
+    kr->stats.lookups++;
+    keyring_key **bucket = &kr->buckets[rec->fingerprint & (kr->nbuckets - 1)];
+    keyring_key *key = *bucket;
+    while (key && key->fingerprint != rec->fingerprint) key = key->chain;
+    if (key) {
+        kr->stats.hits++;
+        lru_unlink(kr, key);
+    } else {
+        key = (keyring_key *) calloc(1, sizeof(keyring_key));
+        char *hex = strndup(rec->n, rec->n_len);
+        mpz_init_set_str(key->n, hex, 16);
+        free(hex);
+        if (ss_fingerprint(key->n) != rec->fingerprint) {
+            free_key(key);      // a damaged record
+            pthread_mutex_unlock(&kr->lock);
+            return NULL;
+        }
+        key->k = ss_block_size(key->n);
+        key->fingerprint = rec->fingerprint;
+        memcpy(key->username, rec->user, rec->user_len);
+        key->chain = *bucket;
+        *bucket = key;
+        kr->cached++;
+    }
+    key->refs++;
+    lru_push(kr, key);
+    evict(kr);
+    pthread_mutex_unlock(&kr->lock);
+    return key;
+}
+
+const keyring_key *keyring_find(keyring *kr, const char *name) {
+    keyring_record rec;
+    uint64_t fp;
+    bool found = strlen(name) == 16 && parse_hex16(name, &fp) && probe(kr, 0, fp, fp, NULL, &rec);
+    found = found || probe(kr, 1, keyring_name_hash(name), 0, name, &rec);
+    return found ? acquire(kr, &rec) : NULL;
+}
+
+void keyring_release(keyring *kr, const keyring_key *key) {
+    pthread_mutex_lock(&kr->lock);
+    ((keyring_key *) key)->refs--;
+    evict(kr);
+    pthread_mutex_unlock(&kr->lock);
+}
+
+const keyring_key *keyring_next(keyring *kr, uint64_t *cursor) {
+    keyring_record rec;
+    uint64_t off = *cursor ? *cursor : kr->records;
+    if (off >= kr->size || !record_at(kr, off, &rec)) {
+        return NULL;
+    }
+    *cursor = rec.end;
+    return acquire(kr, &rec);
+}
+
+keyring_stats keyring_get_stats(keyring *kr) {
+    pthread_mutex_lock(&kr->lock);
+    keyring_stats st = kr->stats;
+    pthread_mutex_unlock(&kr->lock);
+    return st;
+}
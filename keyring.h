@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "ss.h"
+
+//
+// Keyring: many public keys in one file, found by fingerprint or username
+// without parsing the others.
+//
+// The file is text with fixed-width tables, so that it can be mapped and
+// probed in place:
+//
+//  #ssr1 keys=<16 hex> slots=<16 hex>
+//  <16 hex hash> <16 hex record offset>           slots lines: by fingerprint
+//  <16 hex hash> <16 hex record offset>           slots lines: by username
+//  <16 hex fingerprint> <hex n> <username>        one record line per key
+//
+// Both tables are open-addressed with linear probing from hash mod slots;
+// a record offset of 0 marks an empty slot. The fingerprint table hashes by
+// ss_fingerprint(n), the username table by keyring_name_hash. Every probe
+// hit is checked against the record itself, never trusted on the hash.
+//
+// keyring_open maps the file read-only and shared, so any number of
+// processes on a host use one copy of it in the page cache. Keyrings are
+// replaced by renaming a new file over the old one; open keyrings keep
+// the file they mapped.
+//
+// Parsed keys are kept in a bounded LRU cache of key contexts, with the
+// modulus and block size ready to use. Lookups may come from any number
+// of threads.
+//
+
+#define KEYRING_HEADER_LEN 51   // strlen("#ssr1 keys=xxxxxxxxxxxxxxxx slots=xxxxxxxxxxxxxxxx\n")
+#define KEYRING_SLOT_LEN   34   // strlen("xxxxxxxxxxxxxxxx xxxxxxxxxxxxxxxx\n")
+
+typedef struct keyring keyring;
+
+// a ready-to-use public key, owned by the keyring's cache
+typedef struct keyring_key {
+    mpz_t n;
+    uint64_t k;                 // ss_block_size(n)
+    uint64_t fingerprint;       // ss_fingerprint(n)
+    char username[SS_USERNAME_MAX];
+
+    // internal
+    size_t refs;                // lookups not yet released
+    struct keyring_key *prev, *next;    // LRU list, most recent first
+    struct keyring_key *chain;  // cache hash chain
+} keyring_key;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;              // served from the context cache
+    uint64_t evictions;
+} keyring_stats;
+
+//
+// Hash of a username for the username table (first 8 bytes of SHA-256)
+//
+uint64_t keyring_name_hash(const char *username);
+
+//
+// Write a keyring holding count keys
+//
+// Requires:
+//  out: open and writable file stream
+//  usernames: no whitespace; at most SS_USERNAME_MAX - 1 bytes each
+//
+// Returns false on a repeated fingerprint or username, a bad username, or
+// an I/O failure
+//
+bool keyring_write(FILE *out, mpz_t *ns, char **usernames, size_t count);
+
+//
+// Map a keyring
+//
+// Requires:
+//  cache: key contexts kept parsed; 0 picks 256
+//
+// Returns NULL if path cannot be mapped or is not a keyring
+//
+keyring *keyring_open(const char *path, size_t cache);
+
+//
+// Unmap a keyring; every key must have been released
+//
+void keyring_close(keyring *kr);
+
+uint64_t keyring_count(const keyring *kr);
+
+//
+// Find a key by username, or by fingerprint given as 16 hex digits
+//
+// Provides:
+//  the key, valid until keyring_release
+//
+// Returns NULL if the keyring holds no such key
+//
+const keyring_key *keyring_find(keyring *kr, const char *name);
+
+void keyring_release(keyring *kr, const keyring_key *key);
+
+//
+// Walk the keys in file order (e.g. to list them)
+//
+// Provides:
+//  the next key, valid until keyring_release; *cursor moves past it
+//
+// Requires:
+//  cursor: 0 to start with
+//
+// Returns NULL after the last key
+//
+const keyring_key *keyring_next(keyring *kr, uint64_t *cursor);
+
+keyring_stats keyring_get_stats(keyring *kr);
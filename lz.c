@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MIN_MATCH  4
+#define LZ_HASH_BITS  14
+#define LZ_LAST_LITS  5         // input tail always emitted as literals
+#define LZ_MAX_OFFSET 65535
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+// write an extended length (the part that did not fit into the token nibble)
+static size_t put_len(uint8_t *dst, size_t len) {
+    size_t o = 0;
+    while (len >= 255) {
+        dst[o++] = 255;
+        len -= 255;
+    }
+    dst[o++] = (uint8_t) len;
+    return o;
+}
+
+static size_t put_sequence(uint8_t *dst, const uint8_t *lits, size_t nlits, size_t offset, size_t mlen) {
+    size_t o = 1;
+    uint8_t token = (uint8_t) ((nlits < 15 ? nlits : 15) << 4);
+    if (nlits >= 15) {
+        o += put_len(dst + o, nlits - 15);
+    }
+    memcpy(dst + o, lits, nlits);
+    o += nlits;
+
+    // literal-only sequence terminates the buffer
+    if (mlen) {
+        dst[o++] = (uint8_t) offset;
+        dst[o++] = (uint8_t) (offset >> 8);
+        mlen -= LZ_MIN_MATCH;
+        token |= (uint8_t) (mlen < 15 ? mlen : 15);
+        if (mlen >= 15) {
+            o += put_len(dst + o, mlen - 15);
+        }
+    }
+    dst[0] = token;
+    return o;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    if (cap < lz_bound(n)) {
+        return 0;
+    }
+
+    int32_t *table = (int32_t *) malloc(sizeof(int32_t) << LZ_HASH_BITS);
+    for (size_t i = 0; i < ((size_t) 1 << LZ_HASH_BITS); i++) {
+        table[i] = -1;
+    }
+
+    size_t o = 0, ip = 0, anchor = 0;
+    size_t limit = n > LZ_LAST_LITS + LZ_MIN_MATCH ? n - LZ_LAST_LITS - LZ_MIN_MATCH : 0;
+
+    // greedy: take the first match the hash table offers
+    while (ip < limit) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash32(seq);
+        int32_t ref = table[h];
+        table[h] = (int32_t) ip;
+
+        if (ref >= 0 && ip - (size_t) ref <= LZ_MAX_OFFSET && read32(src + ref) == seq) {
+            size_t mlen = LZ_MIN_MATCH;
+            while (ip + mlen < n - LZ_LAST_LITS && src[ref + mlen] == src[ip + mlen]) {
+                mlen++;
+            }
+            o += put_sequence(dst + o, src + anchor, ip - anchor, ip - (size_t) ref, mlen);
+            ip += mlen;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+    o += put_sequence(dst + o, src + anchor, n - anchor, 0, 0);
+
+    free(table);
+    return o;
+}
+
+// read an extended length; false on truncated input
+static bool get_len(const uint8_t *src, size_t len, size_t *ip, size_t *out) {
+    uint8_t b;
+    do {
+        if (*ip >= len) {
+            return false;
+        }
+        b = src[(*ip)++];
+        *out += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t n) {
+    size_t ip = 0, op = 0;
+
+    while (ip < len) {
+        uint8_t token = src[ip++];
+
+        // literals
+        size_t nlits = token >> 4;
+        if (nlits == 15 && !get_len(src, len, &ip, &nlits)) {
+            return false;
+        }
+        if (nlits > len - ip || nlits > n - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, nlits);
+        ip += nlits;
+        op += nlits;
+        if (ip == len) {
+            break;              // last sequence carries no match
+        }
+
+        // match
+        if (len - ip < 2) {
+            return false;
+        }
+        size_t offset = src[ip] | ((size_t) src[ip + 1] << 8);
+        ip += 2;
+        size_t mlen = token & 0x0F;
+        if (mlen == 15 && !get_len(src, len, &ip, &mlen)) {
+            return false;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > n - op) {
+            return false;
+        }
+        // byte-wise: source and destination may overlap
+        for (size_t i = 0; i < mlen; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op == n;
+}
+
+size_t lz_frame(const uint8_t *src, size_t n, uint8_t *dst) {
+    size_t clen = lz_compress(src, n, dst + LZ_FRAME_HEADER, lz_bound(n));
+    put_be32(dst, (uint32_t) n);
+
+    // keep incompressible data as is
+    if (clen == 0 || clen >= n) {
+        memcpy(dst + LZ_FRAME_HEADER, src, n);
+        put_be32(dst + 4, (uint32_t) n | LZ_STORED_FLAG);
+        return LZ_FRAME_HEADER + n;
+    }
+    put_be32(dst + 4, (uint32_t) clen);
+    return LZ_FRAME_HEADER + clen;
+}
+
+void lz_decoder_init(lz_decoder *dec, lz_sink sink, void *ctx) {
+    dec->in = (uint8_t *) malloc(LZ_FRAME_HEADER + lz_bound(LZ_FRAME_MAX));
+    dec->out = (uint8_t *) malloc(LZ_FRAME_MAX);
+    dec->have = 0;
+    dec->sink = sink;
+    dec->ctx = ctx;
+}
+
+bool lz_decoder_feed(lz_decoder *dec, const uint8_t *buf, size_t len) {
+    size_t cap = LZ_FRAME_HEADER + lz_bound(LZ_FRAME_MAX);
+
+    while (len > 0) {
+        // how much of the current frame is still missing
+        size_t want = LZ_FRAME_HEADER;
+        if (dec->have >= LZ_FRAME_HEADER) {
+            uint32_t raw = get_be32(dec->in);
+            uint32_t stored = get_be32(dec->in + 4) & ~LZ_STORED_FLAG;
+            if (raw > LZ_FRAME_MAX || stored > cap - LZ_FRAME_HEADER) {
+                return false;
+            }
+            want = LZ_FRAME_HEADER + stored;
+        }
+        size_t take = want - dec->have < len ? want - dec->have : len;
+        memcpy(dec->in + dec->have, buf, take);
+        dec->have += take;
+        buf += take;
+        len -= take;
+
+        if (dec->have < LZ_FRAME_HEADER) {
+            continue;
+        }
+
+        // a complete frame (not just its header) is ready
+        uint32_t raw = get_be32(dec->in);
+        uint32_t stored = get_be32(dec->in + 4);
+        if (dec->have == LZ_FRAME_HEADER + (stored & ~LZ_STORED_FLAG)) {
+            const uint8_t *body = dec->in + LZ_FRAME_HEADER;
+            if (stored & LZ_STORED_FLAG) {
+                if ((stored & ~LZ_STORED_FLAG) != raw || !dec->sink(body, raw, dec->ctx)) {
+                    return false;
+                }
+            } else if (!lz_decompress(body, stored, dec->out, raw) || !dec->sink(dec->out, raw, dec->ctx)) {
+                return false;
+            }
+            dec->have = 0;
+        }
+    }
+    return true;
+}
+
+bool lz_decoder_finish(lz_decoder *dec) {
+    bool ok = dec->have == 0;
+    free(dec->in);
+    free(dec->out);
+    dec->in = dec->out = NULL;
+    return ok;
+}
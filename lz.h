@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Small LZ77 compressor (LZ4-style sequences) used to shrink the payload
+// before it is blocked and encrypted.
+//
+// The stream is a series of frames, each holding at most LZ_FRAME_MAX input
+// bytes:
+//
+//  <raw_len: u32 BE> <stored_len: u32 BE> <stored_len bytes>
+//
+// The top bit of stored_len marks a frame stored uncompressed (when
+// compressing would not make it smaller).
+//
+
+#define LZ_FRAME_MAX    (64 * 1024)
+#define LZ_FRAME_HEADER 8
+#define LZ_STORED_FLAG  0x80000000u
+
+//
+// Worst-case compressed size of n input bytes
+//
+size_t lz_bound(size_t n);
+
+//
+// Compress one buffer
+//
+// Returns the compressed size, or 0 if it does not fit into cap bytes
+//
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+//
+// Decompress one buffer produced by lz_compress
+//
+// Returns false if src is malformed or does not decode to exactly n bytes
+//
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t n);
+
+//
+// Compress up to LZ_FRAME_MAX bytes into one frame
+//
+// Provides:
+//  dst: the framed bytes (header included)
+//
+// Requires:
+//  dst: at least LZ_FRAME_HEADER + lz_bound(n) bytes
+//
+// Returns the frame size in bytes
+//
+size_t lz_frame(const uint8_t *src, size_t n, uint8_t *dst);
+
+typedef bool (*lz_sink)(const uint8_t *buf, size_t len, void *ctx);
+
+typedef struct {
+    uint8_t *in;            // partial frame collected so far
+    size_t have;
+    uint8_t *out;           // one decoded frame
+    lz_sink sink;
+    void *ctx;
+} lz_decoder;
+
+//
+// Start a streaming frame decoder that hands every decoded frame to sink
+//
+void lz_decoder_init(lz_decoder *dec, lz_sink sink, void *ctx);
+
+//
+// Feed the next bytes of a frame stream; frames may span calls
+//
+// Returns false on a malformed frame or when sink reports failure
+//
+bool lz_decoder_feed(lz_decoder *dec, const uint8_t *buf, size_t len);
+
+//
+// Release the decoder
+//
+// Returns false if the stream ended inside a frame
+//
+bool lz_decoder_finish(lz_decoder *dec);
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <gmp.h>
+
+#include "ssio.h"
+
+#define OPTIONS "o:vh"
+
+int main(int argc, char** argv) {
+    FILE *outfile = stdout;
+    int opt = 0;
+    int verb = 0;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'o': {
+            outfile = fopen(optarg, "w");
+            if (!outfile) {
+                fprintf(stderr, "merge - Could not open outfile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'v': verb = 1; break;
+        case 'h':
+            printf(
+                "SYNOPSIS\n"
+                "  Reassembles the shards written by encrypt --shard i/N into the\n"
+                "  output of an unsharded run, byte for byte. No key is needed.\n\n"
+                "USAGE\n"
+                "  merge [-hv] [-o outfile] shard...\n\n"
+                "OPTIONS\n"
+                "  shard...      Every shard of the set, in any order.\n"
+                "  -o outfile    Output file (default: stdout).\n"
+                "  -v            Verbose output.\n"
+                "  -h            Display program usage.\n");
+            return 0;
+        default:
+            return EXIT_FAILURE;
+        }
+    } // end of switch cases
+
+    size_t count = (size_t) (argc - optind);
+    if (count == 0) {
+        fprintf(stderr, "merge - No shards given\n");
+        return EXIT_FAILURE;
+    }
+
+    // open every shard
+    FILE **shards = (FILE **) calloc(count, sizeof(FILE *));
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < count && status == EXIT_SUCCESS; i++) {
+        shards[i] = fopen(argv[optind + i], "r");
+        if (!shards[i]) {
+            fprintf(stderr, "merge - Could not open shard: %s\n", argv[optind + i]);
+            status = EXIT_FAILURE;
+        } else if (verb) {
+            ssio_shard s;
+            if (ssio_shard_read(shards[i], &s)) {
+                fprintf(stderr, "Shard %" PRIu32 "/%" PRIu32 ": %s, bytes %" PRIu64 "+%" PRIu64 " of %" PRIu64 "\n",
+                        s.index, s.count, argv[optind + i], s.off, s.len, s.total);
+            }
+            rewind(shards[i]);
+        }
+    }
+
+    // merge & clean up
+    if (status == EXIT_SUCCESS && !ssio_merge_shards(shards, count, outfile)) {
+        fprintf(stderr, "merge - Incomplete, inconsistent or malformed shard set\n");
+        status = EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (shards[i]) fclose(shards[i]);
+    }
+    free(shards);
+    if (outfile != stdout) fclose(outfile);
+    return status;
+}
@@ -1,7 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "numtheory.h"
 #include "randstate.h"
+#include "trace.h"
 
-void gcd(mpz_t g, const mpz_t a, const mpz_t b) {
+#ifndef NT_BACKEND
+#define NT_BACKEND "fast"
+#endif
+
+//
+// native backend: the hand-rolled algorithms
+//
+
+static void native_gcd(mpz_t g, const mpz_t a, const mpz_t b) {
     // initialize mpz
     mpz_t a1, b1;
     mpz_inits(a1, b1, NULL);
@@ -33,7 +46,7 @@ void gcd(mpz_t g, const mpz_t a, const mpz_t b) {
     mpz_clears(a1, b1, NULL);
 }
 
-void mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
+static void native_mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
     // check n == 0
     if (mpz_sgn(n) == 0) {
         mpz_set_ui(o, 0);
@@ -82,12 +95,64 @@ void mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
     mpz_clears(r, r1, t, t1, q, temp, NULL);
 }
 
-void pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
+static unsigned pow_window = 1;    // exponent bits per step of native_pow_mod
+
+// left-to-right fixed window: w squarings, then one multiply by a^digit
+static void native_pow_mod_window(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n, unsigned w) {
+    size_t size = (size_t) 1 << w;
+    mpz_t *tbl = (mpz_t *) malloc(size * sizeof(mpz_t));
+    mpz_init_set_ui(tbl[0], 1);
+    mpz_init(tbl[1]);
+    mpz_mod(tbl[1], a, n);
+    for (size_t i = 2; i < size; i++) {
+        mpz_init(tbl[i]);
+        mpz_mul(tbl[i], tbl[i - 1], tbl[1]);
+        mpz_mod(tbl[i], tbl[i], n);
+    }
+
+    mpz_t v;
+    mpz_init_set_ui(v, 1);
+    size_t bits = mpz_sizeinbase(d, 2);
+    size_t top = ((bits + w - 1) / w) * w;     // round up to whole windows
+    for (size_t pos = top; pos > 0; pos -= w) {
+        unsigned digit = 0;
+        for (unsigned b = 0; b < w; b++) {
+            mpz_mul(v, v, v);
+            mpz_mod(v, v, n);
+            digit = (digit << 1) | (unsigned) mpz_tstbit(d, pos - 1 - b);
+        }
+        if (digit) {
+            mpz_mul(v, v, tbl[digit]);
+            mpz_mod(v, v, n);
+        }
+    }
+
+    mpz_set(o, v);
+    mpz_clear(v);
+    for (size_t i = 0; i < size; i++) {
+        mpz_clear(tbl[i]);
+    }
+    free(tbl);
+}
+
+void nt_set_pow_window(unsigned w) {
+    pow_window = w < 1 ? 1 : (w > 8 ? 8 : w);
+}
+
+unsigned nt_pow_window(void) {
+    return pow_window;
+}
+
+static void native_pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
     // n == 1 case
     if (mpz_cmp_ui(n, 1) == 0) {
         mpz_set_ui(o, 0);
         return;
     }
+    if (pow_window > 1 && mpz_sgn(d) > 0) {
+        native_pow_mod_window(o, a, d, n, pow_window);
+        return;
+    }
 
     //mpz inits
     mpz_t v;
@@ -114,7 +179,10 @@ void pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
     mpz_clears(v, p, temp, NULL);
 }
 
-bool is_prime(const mpz_t n, uint64_t iters) {
+// Miller-Rabin on the given exponentiation kernel; every kernel draws the
+// same witnesses from st, so a seed gives the same primes on either backend
+static bool miller_rabin(const mpz_t n, uint64_t iters, rng *st,
+                         void (*powm)(mpz_t, const mpz_t, const mpz_t, const mpz_t)) {
     // manual checks from 0-3
     if (!mpz_cmp_ui(n, 0)) {
         return false;
@@ -136,8 +204,8 @@ bool is_prime(const mpz_t n, uint64_t iters) {
 
     //mpz inits
     uint64_t s = 0;
-    mpz_t n1, n2, a, r, two, y;
-    mpz_inits(n1, n2, a, r, two, y, NULL);
+    mpz_t n1, a, r, two, y;
+    mpz_inits(n1, a, r, two, y, NULL);
 
     mpz_sub_ui(n1, n, 1);   // make n-1 variable for convenience
     mpz_set(r, n1);         // r = n-1 at first
@@ -151,20 +219,20 @@ bool is_prime(const mpz_t n, uint64_t iters) {
 
     // for i 1 to k
     for (uint64_t i = 0; i < iters; i++) {
-        mpz_sub_ui(n2, n, 3);           // n2 = n - 3 --> we'll sample in [0, n-4]
-        mpz_urandomm(a, state, n2);     //generate the random num from 0 to n-4
-        mpz_add_ui(a, a, 2);            // shift to [2, n-2]
-        pow_mod(y, a, r, n);
+        uint64_t tr = trace_begin();
+        rng_witness(st, a, n);          // uniform in [2, n-2]
+        powm(y, a, r, n);
 
         // if (y != 1) and (y != n-1)
         if (mpz_cmp_ui(y, 1) && mpz_cmp(y, n1)) {
             uint64_t j = 1;
 
             while ((j <= s - 1) && mpz_cmp(y, n1)) {
-                pow_mod(y, y, two, n);
+                powm(y, y, two, n);
                 // y == 1 return false
                 if (!mpz_cmp_ui(y, 1)) {
-                    mpz_clears(n1, n2, a, r, two, y, NULL);
+                    trace_end_arg("miller_rabin round", "prime", tr, "round", i);
+                    mpz_clears(n1, a, r, two, y, NULL);
                     return false;
                 }
                 j++;
@@ -172,16 +240,282 @@ bool is_prime(const mpz_t n, uint64_t iters) {
 
             // return false because y != n-1
             if (mpz_cmp(y, n1)) {
-                mpz_clears(n1, n2, a, r, two, y, NULL);
+                trace_end_arg("miller_rabin round", "prime", tr, "round", i);
+                mpz_clears(n1, a, r, two, y, NULL);
                 return false;
             }
         }
+        trace_end_arg("miller_rabin round", "prime", tr, "round", i);
     }
     // prime! & clean up
-    mpz_clears(n1, n2, a, r, two, y, NULL);
+    mpz_clears(n1, a, r, two, y, NULL);
     return true;
 }
 
+static bool native_is_prime(const mpz_t n, uint64_t iters, rng *st) {
+    return miller_rabin(n, iters, st, native_pow_mod);
+}
+
+//
+// gmp backend: GMP's own routines throughout
+//
+
+static void gmp_gcd(mpz_t g, const mpz_t a, const mpz_t b) {
+    mpz_gcd(g, a, b);
+}
+
+static void gmp_mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
+    // no inverse (or n in {0, +-1}) -> 0, like the native version
+    if (mpz_cmpabs_ui(n, 1) <= 0 || mpz_invert(o, a, n) == 0) {
+        mpz_set_ui(o, 0);
+    }
+}
+
+static void gmp_pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
+    if (mpz_cmp_ui(n, 1) == 0) {
+        mpz_set_ui(o, 0);
+    } else if (mpz_sgn(d) <= 0) {
+        mpz_set_ui(o, 1);       // the native loop never runs for d <= 0
+    } else {
+        mpz_powm(o, a, d, n);   // Montgomery / sliding window for odd n
+    }
+}
+
+static bool gmp_is_prime(const mpz_t n, uint64_t iters, rng *st) {
+    (void) st;                  // GMP draws its own witnesses
+    uint64_t tr = trace_begin();
+    bool prime = mpz_probab_prime_p(n, iters > 0 ? (int) (iters < 1000 ? iters : 1000) : 1) != 0;
+    trace_end("mpz_probab_prime_p", "prime", tr);
+    return prime;
+}
+
+//
+// fast backend: GMP's kernels under our Miller-Rabin, so that witnesses (and
+// with them every seeded key) are the same as with the native backend
+//
+
+static bool fast_is_prime(const mpz_t n, uint64_t iters, rng *st) {
+    return miller_rabin(n, iters, st, gmp_pow_mod);
+}
+
+//
+// diff backend: runs every call on all backends and aborts on disagreement
+//
+
+static const nt_backend concrete[] = {
+    { "native", native_gcd, native_mod_inverse, native_pow_mod, native_is_prime },
+    { "gmp", gmp_gcd, gmp_mod_inverse, gmp_pow_mod, gmp_is_prime },
+    { "fast", gmp_gcd, gmp_mod_inverse, gmp_pow_mod, fast_is_prime },
+};
+
+#define NT_CONCRETE (sizeof(concrete) / sizeof(concrete[0]))
+
+static void diff_fail(const char *fn, const char *name) {
+    fprintf(stderr, "numtheory: %s backend disagrees with native in %s\n", name, fn);
+    abort();
+}
+
+// outputs may alias inputs: results go to temporaries until all have run
+static void diff_gcd(mpz_t g, const mpz_t a, const mpz_t b) {
+    mpz_t want, got;
+    mpz_inits(want, got, NULL);
+    concrete[0].gcd(want, a, b);
+    for (size_t i = 1; i < NT_CONCRETE; i++) {
+        concrete[i].gcd(got, a, b);
+        if (mpz_cmp(got, want) != 0) diff_fail("gcd", concrete[i].name);
+    }
+    mpz_set(g, want);
+    mpz_clears(want, got, NULL);
+}
+
+static void diff_mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
+    mpz_t want, got;
+    mpz_inits(want, got, NULL);
+    concrete[0].mod_inverse(want, a, n);
+    for (size_t i = 1; i < NT_CONCRETE; i++) {
+        concrete[i].mod_inverse(got, a, n);
+        if (mpz_cmp(got, want) != 0) diff_fail("mod_inverse", concrete[i].name);
+    }
+    mpz_set(o, want);
+    mpz_clears(want, got, NULL);
+}
+
+static void diff_pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
+    mpz_t want, got;
+    mpz_inits(want, got, NULL);
+    concrete[0].pow_mod(want, a, d, n);
+    for (size_t i = 1; i < NT_CONCRETE; i++) {
+        concrete[i].pow_mod(got, a, d, n);
+        if (mpz_cmp(got, want) != 0) diff_fail("pow_mod", concrete[i].name);
+    }
+    mpz_set(o, want);
+    mpz_clears(want, got, NULL);
+}
+
+static bool diff_is_prime(const mpz_t n, uint64_t iters, rng *st) {
+    if (iters == 0) {
+        return concrete[0].is_prime(n, iters, st);     // no rounds: nothing to compare
+    }
+
+    // replay the same witness stream for every backend
+    bool want = false;
+    for (size_t i = 0; i < NT_CONCRETE; i++) {
+        rng copy = *st;
+        bool got = concrete[i].is_prime(n, iters, &copy);
+        if (i == 0) {
+            want = got;
+        } else if (got != want) {
+            diff_fail("is_prime", concrete[i].name);
+        }
+        rng_clear(&copy);
+    }
+    concrete[0].is_prime(n, iters, st);    // advance st as a single call would
+    return want;
+}
+
+static const nt_backend diff = { "diff", diff_gcd, diff_mod_inverse, diff_pow_mod, diff_is_prime };
+
+static const nt_backend *const backends[] = { &concrete[0], &concrete[1], &concrete[2], &diff };
+
+//
+// backend selection
+//
+
+static const nt_backend *active = NULL;
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+
+// SS_BACKEND, else the build-time NT_BACKEND, else native
+static void select_default(void) {
+    const char *env = getenv("SS_BACKEND");
+    if (env && *env) {
+        active = nt_backend_find(env);
+        if (!active) {
+            fprintf(stderr, "numtheory: unknown SS_BACKEND \"%s\", using %s\n", env, NT_BACKEND);
+        }
+    }
+    if (!active) {
+        active = nt_backend_find(NT_BACKEND);
+    }
+    if (!active) {
+        active = &concrete[0];
+    }
+}
+
+static const nt_backend *backend(void) {
+    pthread_once(&active_once, select_default);
+    return active;
+}
+
+const nt_backend *nt_backend_find(const char *name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i];
+        }
+    }
+    return NULL;
+}
+
+const nt_backend *nt_backend_at(size_t i) {
+    return i < sizeof(backends) / sizeof(backends[0]) ? backends[i] : NULL;
+}
+
+bool nt_backend_select(const char *name) {
+    const nt_backend *b = nt_backend_find(name);
+    pthread_once(&active_once, select_default);     // SS_BACKEND must not override this later
+    if (b) {
+        active = b;
+    }
+    return b != NULL;
+}
+
+const char *nt_backend_name(void) {
+    return backend()->name;
+}
+
+void gcd(mpz_t g, const mpz_t a, const mpz_t b) {
+    backend()->gcd(g, a, b);
+}
+
+void mod_inverse(mpz_t o, const mpz_t a, const mpz_t n) {
+    backend()->mod_inverse(o, a, n);
+}
+
+void pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n) {
+    backend()->pow_mod(o, a, d, n);
+}
+
+bool is_prime(const mpz_t n, uint64_t iters) {
+    return is_prime_r(n, iters, randstate());
+}
+
+bool is_prime_r(const mpz_t n, uint64_t iters, rng *st) {
+    return backend()->is_prime(n, iters, st);
+}
+
+// odd primes below 1000 for trial division
+static const uint16_t small_primes[] = {
+    3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97,
+    101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193,
+    197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307,
+    311, 313, 317, 331, 337, 347, 349, 353, 359, 367, 373, 379, 383, 389, 397, 401, 409, 419, 421,
+    431, 433, 439, 443, 449, 457, 461, 463, 467, 479, 487, 491, 499, 503, 509, 521, 523, 541, 547,
+    557, 563, 569, 571, 577, 587, 593, 599, 601, 607, 613, 617, 619, 631, 641, 643, 647, 653, 659,
+    661, 673, 677, 683, 691, 701, 709, 719, 727, 733, 739, 743, 751, 757, 761, 769, 773, 787, 797,
+    809, 811, 821, 823, 827, 829, 839, 853, 857, 859, 863, 877, 881, 883, 887, 907, 911, 919, 929,
+    937, 941, 947, 953, 967, 971, 977, 983, 991, 997,
+};
+
+int prime_screen(const mpz_t n) {
+    if (mpz_cmp_ui(n, 2) < 0) {
+        return SCREEN_TRIAL;
+    }
+    if (mpz_cmp_ui(n, 2) == 0) {
+        return SCREEN_PRIME;
+    }
+    if (mpz_even_p(n)) {
+        return SCREEN_TRIAL;
+    }
+
+    // trial division; decides every n below 1000^2 outright
+    for (size_t i = 0; i < sizeof(small_primes) / sizeof(small_primes[0]); i++) {
+        if (mpz_cmp_ui(n, small_primes[i]) == 0) {
+            return SCREEN_PRIME;
+        }
+        if (mpz_divisible_ui_p(n, small_primes[i])) {
+            return SCREEN_TRIAL;
+        }
+    }
+    if (mpz_cmp_ui(n, 997UL * 997UL) < 0) {
+        return SCREEN_PRIME;
+    }
+
+    // one strong probable-prime round to base 2: n-1 = 2^s * r
+    mpz_t n1, r, y, two;
+    mpz_inits(n1, r, y, two, NULL);
+    mpz_sub_ui(n1, n, 1);
+    uint64_t s = mpz_scan1(n1, 0);
+    mpz_fdiv_q_2exp(r, n1, s);
+    mpz_set_ui(two, 2);
+    pow_mod(y, two, r, n);
+
+    int verdict = SCREEN_PASSED;
+    if (mpz_cmp_ui(y, 1) != 0 && mpz_cmp(y, n1) != 0) {
+        verdict = SCREEN_BASE2;
+        for (uint64_t j = 1; j < s; j++) {
+            pow_mod(y, y, two, n);
+            if (mpz_cmp(y, n1) == 0) {
+                verdict = SCREEN_PASSED;
+                break;
+            }
+            if (mpz_cmp_ui(y, 1) == 0) {
+                break;
+            }
+        }
+    }
+    mpz_clears(n1, r, y, two, NULL);
+    return verdict;
+}
+
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
     // make random number in range 0 - 2^bits - 1, then force size and oddness
     if (bits < 2) {
@@ -189,9 +523,28 @@ void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
         return;
     }
 
+    rng *st = randstate();
+    bool found;
+    do {
+        uint64_t tr = trace_begin();
+        rng_candidate(st, p, bits, false);  // odd, exactly bits bits
+        found = is_prime_r(p, iters, st);
+        trace_end_arg("make_prime attempt", "prime", tr, "bits", bits);
+    } while (!found);                       // loop until prime
+}
+
+void make_prime_top2(mpz_t p, uint64_t bits, uint64_t iters) {
+    if (bits < 2) {
+        mpz_set_ui(p, 2);
+        return;
+    }
+
+    rng *st = randstate();
+    bool found;
     do {
-        mpz_urandomb(p, state, bits);       // random candidate
-        mpz_setbit(p, bits - 1);            // force exact bit-length
-        mpz_setbit(p, 0);                   // force odd
-    } while (is_prime(p, iters) == false);  // loop until prime
+        uint64_t tr = trace_begin();
+        rng_candidate(st, p, bits, true);   // also p >= 1.5 * 2^(bits-1)
+        found = is_prime_r(p, iters, st);
+        trace_end_arg("make_prime attempt", "prime", tr, "bits", bits);
+    } while (!found);                       // loop until prime
 }
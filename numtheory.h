@@ -3,6 +3,73 @@
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#include "rng.h"
+
+/**
+ * Arithmetic backend behind gcd, mod_inverse, pow_mod and is_prime_r.
+ *
+ *   native  the hand-rolled algorithms in numtheory.c
+ *   gmp     GMP's mpz_gcd, mpz_invert, mpz_powm and mpz_probab_prime_p
+ *   fast    GMP's kernels under our own Miller-Rabin; draws the same
+ *           witnesses as native, so seeded keys do not depend on the choice
+ *   diff    runs every call on all of the above and aborts on disagreement
+ *
+ * The default is the build-time NT_BACKEND (make NT_BACKEND=...), overridden
+ * at startup by the SS_BACKEND environment variable.
+ */
+typedef struct {
+    const char *name;
+    void (*gcd)(mpz_t g, const mpz_t a, const mpz_t b);
+    void (*mod_inverse)(mpz_t o, const mpz_t a, const mpz_t n);
+    void (*pow_mod)(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n);
+    bool (*is_prime)(const mpz_t n, uint64_t iters, rng *st);
+} nt_backend;
+
+/**
+ * Looks up a backend by name.
+ *
+ * @return the backend, or NULL if there is none by that name
+ */
+const nt_backend *nt_backend_find(const char *name);
+
+/**
+ * Enumerates the backends.
+ *
+ * @return backend i, or NULL once i is past the last one
+ */
+const nt_backend *nt_backend_at(size_t i);
+
+/**
+ * Makes the named backend the active one for all later calls.
+ *
+ * @return false (and keeps the current backend) if the name is unknown
+ *
+ * @note Not synchronized with calls running on other threads; select first
+ */
+bool nt_backend_select(const char *name);
+
+/**
+ * @return the name of the active backend
+ */
+const char *nt_backend_name(void);
+
+/**
+ * Sets the exponent window of the native backend's pow_mod.
+ *
+ * @param w bits consumed per multiply, clamped to [1, 8]; 1 is plain
+ *          square-and-multiply, larger windows trade a 2^w-entry table of
+ *          powers for fewer multiplies on long exponents
+ *
+ * @note Other backends use GMP's own windowing. Set before starting threads.
+ */
+void nt_set_pow_window(unsigned w);
+
+/**
+ * @return the native pow_mod window in bits
+ */
+unsigned nt_pow_window(void);
 
 /**
  * Computes the greatest common divisor of two integers using the Euclidean algorithm
@@ -57,6 +124,34 @@ void pow_mod(mpz_t o, const mpz_t a, const mpz_t d, const mpz_t n);
  */
 bool is_prime(const mpz_t n, uint64_t iters);
 
+/**
+ * Thread-safe variant of is_prime drawing its witnesses from st.
+ * 
+ * @param n The number to test for primality
+ * @param iters The number of iterations (witnesses) to test
+ * @param st Generator owned by the calling thread
+ * 
+ * @return true if n is probably prime, false if n is definitely composite
+ */
+bool is_prime_r(const mpz_t n, uint64_t iters, rng *st);
+
+#define SCREEN_PRIME  0     // n is prime (small enough to be decided by trial division)
+#define SCREEN_TRIAL  1     // n is composite: below 2, even, or has a factor below 1000
+#define SCREEN_BASE2  2     // n is composite: fails the strong probable-prime test to base 2
+#define SCREEN_PASSED 3     // n survived the screen; run the full Miller-Rabin test
+
+/**
+ * Cheap deterministic pre-screen to run before is_prime on untrusted input.
+ * 
+ * @param n The number to screen
+ * 
+ * @return one of the SCREEN_* verdicts
+ * 
+ * @note Trial division by the primes below 1000, then one strong test to base 2;
+ *       rejects nearly all composites at a fraction of the cost of is_prime
+ */
+int prime_screen(const mpz_t n);
+
 /**
  * Generates a random prime number with the specified number of bits.
  * 
@@ -64,7 +159,22 @@ bool is_prime(const mpz_t n, uint64_t iters);
  * @param bits The number of bits for the generated prime
  * @param iters The number of Miller-Rabin iterations to use for primality testing
  * 
- * @note Uses recursive approach to keep generating random numbers until a prime is found
- * @note Depends on the global 'state' variable for random number generation
+ * @note Iterative: draws odd candidates of exactly bits bits with rng_candidate and
+ *       tests each with Miller-Rabin until one passes; bits < 2 gives 2
+ * @note Candidates and Miller-Rabin bases come from the calling thread's ChaCha20
+ *       stream (randstate()), so a seeded run is reproducible per thread
  */
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+
+/**
+ * Generates a random prime number whose two most significant bits are set.
+ * 
+ * @param p Output parameter - stores the generated prime number
+ * @param bits The number of bits for the generated prime (at least 2)
+ * @param iters The number of Miller-Rabin iterations to use for primality testing
+ * 
+ * @note The prime is at least 3 * 2^(bits-2), so products of such primes have a
+ *       predictable bit-length (used by ss_make_pub to size n without retries)
+ * @note Same candidate loop as make_prime, on the calling thread's randstate() stream
+ */
+void make_prime_top2(mpz_t p, uint64_t bits, uint64_t iters);
@@ -0,0 +1,73 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "trace.h"
+
+typedef struct {
+    size_t n;
+    atomic_size_t next;
+    void (*fn)(size_t i, unsigned tid, void *ctx);
+    void *ctx;
+} parallel_job;
+
+typedef struct {
+    parallel_job *job;
+    unsigned tid;
+} parallel_worker;
+
+static void *run_worker(void *arg) {
+    parallel_worker *w = (parallel_worker *) arg;
+    parallel_job *job = w->job;
+    size_t i;
+    if (w->tid > 0) {
+        trace_lane(w->tid);     // the caller keeps its own lane
+    }
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->n) {
+        job->fn(i, w->tid, job->ctx);
+    }
+    if (w->tid > 0) {
+        trace_release();
+    }
+    return NULL;
+}
+
+unsigned parallel_ncpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned) n : 1;
+}
+
+void parallel_for(size_t n, unsigned threads, void (*fn)(size_t i, unsigned tid, void *ctx), void *ctx) {
+    if (threads == 0) {
+        threads = parallel_ncpus();
+    }
+    if (threads > n) {
+        threads = n > 0 ? (unsigned) n : 1;
+    }
+
+    parallel_job job = { .n = n, .fn = fn, .ctx = ctx };
+    atomic_init(&job.next, 0);
+    parallel_worker *workers = (parallel_worker *) malloc(threads * sizeof(parallel_worker));
+    pthread_t *tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+
+    // spawn helpers; fall back to fewer threads if creation fails
+    unsigned started = 1;
+    for (unsigned t = 1; t < threads; t++) {
+        workers[t] = (parallel_worker) { .job = &job, .tid = t };
+        if (pthread_create(&tids[t], NULL, run_worker, &workers[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    // the caller works as thread 0
+    workers[0] = (parallel_worker) { .job = &job, .tid = 0 };
+    run_worker(&workers[0]);
+    for (unsigned t = 1; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    free(workers);
+    free(tids);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+//
+// Number of online CPUs (at least 1)
+//
+unsigned parallel_ncpus(void);
+
+//
+// Run fn(i, tid, ctx) for every i in [0, n) on up to threads threads
+//
+// Indices are handed out one at a time from a shared counter, so uneven
+// work items balance themselves. The calling thread takes part as tid 0;
+// the call returns once every index has been processed.
+//
+// Requires:
+//  threads: worker count; 0 means parallel_ncpus()
+//  fn: safe to call concurrently for different i
+//
+void parallel_for(size_t n, unsigned threads, void (*fn)(size_t i, unsigned tid, void *ctx), void *ctx);
@@ -0,0 +1,122 @@
+#!/usr/bin/env bash
+# End-to-end performance regression harness for keygen/encrypt/decrypt
+# Usage: ./perf_check.sh            (or: make perf-check)
+# Env vars:
+#   PERF_BASELINE=perf_baseline.txt -> baseline to compare against
+#   PERF_UPDATE=1                   -> rewrite the baseline from this run instead
+#   PERF_TOL=0.30                   -> allowed slowdown in CPU time / throughput (30%)
+#   PERF_RSS_TOL=0.50               -> allowed growth in peak RSS (50%)
+#   PERF_SLACK=0.02                 -> CPU / wall seconds over the baseline always allowed
+#   PERF_REPS=3                     -> runs per case; the fastest one counts
+#
+# Corpora and keys are generated from fixed seeds, so every run does the same
+# work. Wall time, CPU time, peak RSS and throughput are recorded per case;
+# the baseline is per machine, refresh it with `make perf-baseline`.
+
+set -euo pipefail
+
+BASELINE="${PERF_BASELINE:-perf_baseline.txt}"
+UPDATE="${PERF_UPDATE:-0}"
+TOL="${PERF_TOL:-0.30}"
+RSS_TOL="${PERF_RSS_TOL:-0.50}"
+SLACK="${PERF_SLACK:-0.02}"
+REPS="${PERF_REPS:-3}"
+PERFRUN="${PERFRUN:-./perfrun}"
+KEYGEN="${KEYGEN:-./keygen}"
+ENCRYPT="${ENCRYPT:-./encrypt}"
+DECRYPT="${DECRYPT:-./decrypt}"
+
+for b in "$PERFRUN" "$KEYGEN" "$ENCRYPT" "$DECRYPT"; do
+  [ -x "$b" ] || { echo "missing $b (run: make perfrun keygen encrypt decrypt)"; exit 1; }
+done
+
+tmpdir="$(mktemp -d)"; trap 'rm -rf "$tmpdir"' EXIT
+results="$tmpdir/results"; : > "$results"
+
+# measure the defaults: an empty profile keeps ./ss.tune (see tune.h) out,
+# and no backend override or prime pool may shortcut the work
+: > "$tmpdir/empty.tune"
+export SS_TUNE="$tmpdir/empty.tune"
+unset SS_BACKEND SS_PRIME_POOL
+
+# run one case PERF_REPS times; keep the fastest wall/cpu and the largest RSS
+# usage: measure <name> <bytes or 0 for keygen> <stdin or -> <stdout or -> cmd...
+measure() {
+  local name="$1" bytes="$2" in="$3" out="$4"; shift 4
+  local best_wall="" best_cpu="" max_rss=0
+  for _ in $(seq "$REPS"); do
+    local args=()
+    [ "$in" != "-" ] && args+=( -i "$in" )
+    [ "$out" != "-" ] && args+=( -o "$out" )
+    "$PERFRUN" "${args[@]}" -- "$@" 2> "$tmpdir/m" >/dev/null
+    read -r wall cpu rss < <(sed -E 's/wall=([^ ]+) cpu=([^ ]+) rss_kb=([^ ]+)/\1 \2 \3/' "$tmpdir/m" | tail -1)
+    if [ -z "$best_wall" ] || awk -v a="$wall" -v b="$best_wall" 'BEGIN { exit !(a < b) }'; then
+      best_wall="$wall"
+    fi
+    if [ -z "$best_cpu" ] || awk -v a="$cpu" -v b="$best_cpu" 'BEGIN { exit !(a < b) }'; then
+      best_cpu="$cpu"
+    fi
+    if (( rss > max_rss )); then max_rss="$rss"; fi
+  done
+  # throughput: bytes/s for file cases, runs/s for keygen
+  local tp
+  tp=$(awk -v b="$bytes" -v w="$best_wall" 'BEGIN { printf "%.1f", (b > 0 ? b : 1) / (w > 0 ? w : 1e-9) }')
+  printf "%-18s %10s %10s %8s %14s\n" "$name" "$best_wall" "$best_cpu" "$max_rss" "$tp" | tee -a "$results"
+}
+
+echo "== Corpora and keys (fixed seeds) =="
+"$PERFRUN" -g 65536 1 > "$tmpdir/rand_64k.bin"
+"$PERFRUN" -g 262144 2 > "$tmpdir/rand_256k.bin"
+awk 'BEGIN { for (i = 0; i < 16384; i++) printf "{\"ts\":%d,\"level\":\"info\",\"msg\":\"request %d served\"}\n", i, i % 97 }' \
+  > "$tmpdir/text.json"
+text_bytes=$(wc -c < "$tmpdir/text.json" | tr -d ' ')
+"$KEYGEN" -b 1024 -s 1 -n "$tmpdir/k.pub" -d "$tmpdir/k.priv" >/dev/null
+
+echo "== Measurements =="
+printf "%-18s %10s %10s %8s %14s\n" "# case" "wall_s" "cpu_s" "rss_kb" "throughput/s"
+measure keygen_1024   0 - - "$KEYGEN" -b 1024 -s 1 -n "$tmpdir/g.pub" -d "$tmpdir/g.priv"
+measure keygen_2048   0 - - "$KEYGEN" -b 2048 -s 1 -n "$tmpdir/g.pub" -d "$tmpdir/g.priv"
+measure encrypt_64k   65536 "$tmpdir/rand_64k.bin" "$tmpdir/r64.enc" "$ENCRYPT" -n "$tmpdir/k.pub"
+measure decrypt_64k   65536 "$tmpdir/r64.enc" "$tmpdir/r64.out" "$DECRYPT" -n "$tmpdir/k.priv"
+measure encrypt_256k  262144 "$tmpdir/rand_256k.bin" "$tmpdir/r256.enc" "$ENCRYPT" -n "$tmpdir/k.pub"
+measure decrypt_256k  262144 "$tmpdir/r256.enc" "$tmpdir/r256.out" "$DECRYPT" -n "$tmpdir/k.priv"
+measure encrypt_text_z "$text_bytes" "$tmpdir/text.json" "$tmpdir/text.enc" "$ENCRYPT" -z -n "$tmpdir/k.pub"
+measure decrypt_text_z "$text_bytes" "$tmpdir/text.enc" "$tmpdir/text.out" "$DECRYPT" -n "$tmpdir/k.priv"
+
+# a fast wrong answer is not a win
+cmp -s "$tmpdir/rand_64k.bin" "$tmpdir/r64.out" && cmp -s "$tmpdir/rand_256k.bin" "$tmpdir/r256.out" \
+  && cmp -s "$tmpdir/text.json" "$tmpdir/text.out" || { echo "FAIL: round-trip mismatch"; exit 1; }
+
+if [ "$UPDATE" = "1" ]; then
+  { echo "# case wall_s cpu_s rss_kb throughput/s  ($(uname -m), $(date -u +%Y-%m-%d))"; cat "$results"; } > "$BASELINE"
+  echo "Baseline written to $BASELINE"
+  exit 0
+fi
+[ -f "$BASELINE" ] || { echo "no baseline at $BASELINE (run: make perf-baseline)"; exit 1; }
+
+echo "== Compare against $BASELINE (tol cpu/throughput ${TOL}, rss ${RSS_TOL}) =="
+fail=0
+while read -r name wall cpu rss tp; do
+  base=$(awk -v n="$name" '$1 == n { print $2, $3, $4, $5 }' "$BASELINE")
+  if [ -z "$base" ]; then
+    echo "  new:  $name (not in baseline)"; continue
+  fi
+  read -r bwall bcpu brss btp <<< "$base"
+  # times within SLACK seconds of the baseline pass whatever the ratio, so
+  # that scheduler noise cannot fail the short cases
+  verdict=$(awk -v w="$wall" -v bw="$bwall" -v c="$cpu" -v bc="$bcpu" -v r="$rss" -v br="$brss" \
+                -v t="$tp" -v bt="$btp" -v tol="$TOL" -v rtol="$RSS_TOL" -v slack="$SLACK" 'BEGIN {
+    msg = ""
+    if (c > bc * (1 + tol) && c - bc > slack) msg = msg sprintf(" cpu %.3fs > %.3fs", c, bc)
+    if (t < bt / (1 + tol) && w - bw > slack) msg = msg sprintf(" throughput %.1f < %.1f", t, bt)
+    if (r > br * (1 + rtol) + 1024)          msg = msg sprintf(" rss %dkB > %dkB", r, br)
+    print msg }')
+  if [ -n "$verdict" ]; then
+    echo "  FAIL: $name:$verdict"; fail=1
+  else
+    echo "  ok:   $name"
+  fi
+done < "$results"
+
+[ "$fail" = "0" ] || { echo "Performance regression detected ❌"; exit 1; }
+echo "All perf checks passed ✅"
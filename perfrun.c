@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+//
+// Measurement helper for perf_check.sh.
+//
+//  perfrun [-i infile] [-o outfile] -- command [args...]
+//      runs command with the given stdin/stdout and prints
+//      "wall=<s> cpu=<s> rss_kb=<peak RSS>" to stderr
+//
+//  perfrun -g bytes seed
+//      writes bytes of deterministic pseudo-random data (xorshift64*) to
+//      stdout, so corpora are identical on every machine
+//
+
+static int generate(uint64_t bytes, uint64_t seed) {
+    uint64_t x = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    uint8_t buf[4096];
+    while (bytes > 0) {
+        size_t len = bytes < sizeof(buf) ? (size_t) bytes : sizeof(buf);
+        for (size_t i = 0; i < len; i += 8) {
+            x ^= x >> 12;
+            x ^= x << 25;
+            x ^= x >> 27;
+            uint64_t v = x * 0x2545F4914F6CDD1DULL;
+            memcpy(buf + i, &v, len - i < 8 ? len - i : 8);
+        }
+        if (fwrite(buf, 1, len, stdout) != len) {
+            return EXIT_FAILURE;
+        }
+        bytes -= len;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    const char *in_name = NULL;
+    const char *out_name = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+i:o:g:h")) != -1) {
+        switch (opt) {
+        case 'i': in_name = optarg; break;
+        case 'o': out_name = optarg; break;
+        case 'g':
+            if (optind >= argc) {
+                fprintf(stderr, "perfrun: -g needs <bytes> <seed>\n");
+                return EXIT_FAILURE;
+            }
+            return generate(strtoull(optarg, NULL, 10), strtoull(argv[optind], NULL, 10));
+        case 'h':
+        default:
+            fprintf(stderr,
+                    "USAGE\n"
+                    "  perfrun [-i infile] [-o outfile] -- command [args...]\n"
+                    "  perfrun -g bytes seed\n");
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "perfrun: no command given\n");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("perfrun: fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        // child: redirect and exec
+        if (in_name) {
+            int fd = open(in_name, O_RDONLY);
+            if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) {
+                perror(in_name);
+                _exit(127);
+            }
+            close(fd);
+        }
+        if (out_name) {
+            int fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+                perror(out_name);
+                _exit(127);
+            }
+            close(fd);
+        }
+        execvp(argv[optind], argv + optind);
+        perror(argv[optind]);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            perror("perfrun: wait4");
+            return EXIT_FAILURE;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    fprintf(stderr, "wall=%.6f cpu=%.6f rss_kb=%ld\n", wall, cpu, ru.ru_maxrss);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <gmp.h>
+
+#include "numtheory.h"
+#include "parallel.h"
+
+#define OPTIONS "i:o:t:r:s:jvh"
+
+#define CHUNK 4096          // numbers tested per parallel batch
+
+#define VERDICT_INVALID   0
+#define VERDICT_PRIME     1
+#define VERDICT_COMPOSITE 2
+
+typedef struct {
+    char *text;             // input line as given (trimmed)
+    mpz_t n;
+    int verdict;
+    int stage;              // SCREEN_* verdict; SCREEN_PASSED then means Miller-Rabin decided
+} item;
+
+typedef struct {
+    item *items;
+    uint64_t iters;
+    rng *rngs;                  // one witness stream per thread
+} batch;
+
+static void check_one(size_t i, unsigned tid, void *ctx) {
+    batch *b = (batch *) ctx;
+    item *it = &b->items[i];
+    if (it->verdict == VERDICT_INVALID) {
+        return;
+    }
+    it->stage = prime_screen(it->n);
+    if (it->stage == SCREEN_PASSED) {
+        it->verdict = is_prime_r(it->n, b->iters, &b->rngs[tid]) ? VERDICT_PRIME : VERDICT_COMPOSITE;
+    } else {
+        it->verdict = it->stage == SCREEN_PRIME ? VERDICT_PRIME : VERDICT_COMPOSITE;
+    }
+}
+
+// decimal, or hex with a 0x prefix; mpz_set_str would skip inner whitespace
+static int parse_number(mpz_t n, const char *s) {
+    for (const char *t = s; *t; t++) {
+        if (isspace((unsigned char)*t)) {
+            return 0;
+        }
+    }
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        return s[2] != '\0' && mpz_set_str(n, s + 2, 16) == 0;
+    }
+    return mpz_set_str(n, s, 10) == 0;
+}
+
+static uint64_t parse_u64(const char *arg, const char *name, int *ok) {
+    for (const char *t = arg; *t; t++) {
+        if (!isdigit((unsigned char)*t)) {
+            *ok = 0;
+        }
+    }
+    errno = 0;
+    char *end = NULL;
+    unsigned long long val = strtoull(arg, &end, 10);
+    if (errno || end == arg || *end != '\0') {
+        *ok = 0;
+    }
+    if (!*ok) {
+        fprintf(stderr, "primecheck: invalid %s: \"%s\"\n", name, arg);
+    }
+    return (uint64_t) val;
+}
+
+int main(int argc, char **argv) {
+    FILE *infile = stdin;
+    FILE *outfile = stdout;
+    uint64_t iters = 50;
+    uint64_t threads = 0;
+    uint64_t seed = time(NULL);
+    int json = 0;
+    int verb = 0;
+    int opt = 0;
+    int ok = 1;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'i':
+            infile = fopen(optarg, "r");
+            if (!infile) {
+                fprintf(stderr, "primecheck - Could not open infile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'o':
+            outfile = fopen(optarg, "w");
+            if (!outfile) {
+                fprintf(stderr, "primecheck - Could not open outfile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't': threads = parse_u64(optarg, "-t <threads>", &ok); break;
+        case 'r': iters = parse_u64(optarg, "-r <rounds>", &ok); break;
+        case 's': seed = parse_u64(optarg, "-s <seed>", &ok); break;
+        case 'j': json = 1; break;
+        case 'v': verb = 1; break;
+        case 'h':
+            printf(
+                "SYNOPSIS\n"
+                "  Tests numbers for primality in parallel, one number per input line.\n"
+                "  Each number gets trial division, a base-2 strong test, then\n"
+                "  Miller-Rabin; results keep the input order. Exits non-zero if any\n"
+                "  line is not a number.\n\n"
+                "USAGE\n"
+                "  primecheck [-hjv] [-i infile] [-o outfile] [-t threads] [-r rounds] [-s seed]\n\n"
+                "OPTIONS\n"
+                "  -i infile     Input file; decimal or 0x-prefixed hex (default: stdin).\n"
+                "  -o outfile    Output file (default: stdout).\n"
+                "  -t threads    Worker threads (default: online CPUs).\n"
+                "  -r rounds     Miller-Rabin rounds (default: 50).\n"
+                "  -s seed       Witness RNG seed (default: time(NULL)).\n"
+                "  -j            Print a JSON summary to stderr.\n"
+                "  -v            Verbose output.\n"
+                "  -h            Display program usage.\n");
+            return 0;
+        default:
+            return EXIT_FAILURE;
+        }
+        if (!ok) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (iters < 1) {
+        fprintf(stderr, "primecheck: -r <rounds> must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+    if (threads == 0) {
+        threads = parallel_ncpus();
+    }
+
+    // per-thread witness streams of one seed; no two threads share a stream
+    rng *rngs = (rng *) malloc(threads * sizeof(rng));
+    for (uint64_t t = 0; t < threads; t++) {
+        rng_init(&rngs[t], seed, t);
+    }
+
+    item *items = (item *) malloc(CHUNK * sizeof(item));
+    for (size_t i = 0; i < CHUNK; i++) {
+        mpz_init(items[i].n);
+    }
+    batch b = { .items = items, .iters = iters, .rngs = rngs };
+
+    uint64_t counts[3] = { 0 };                 // by VERDICT_*
+    uint64_t by_stage[4] = { 0 };               // composites by SCREEN_* stage
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    char *line = NULL;
+    size_t cap = 0;
+    int eof = 0;
+    while (!eof) {
+        // read one batch, keeping blank lines out of the results
+        size_t count = 0;
+        while (count < CHUNK) {
+            ssize_t got = getline(&line, &cap, infile);
+            if (got < 0) {
+                eof = 1;
+                break;
+            }
+            char *s = line;
+            while (isspace((unsigned char)*s)) s++;
+            size_t len = strlen(s);
+            while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+            if (len == 0) {
+                continue;
+            }
+            items[count].text = strdup(s);
+            items[count].verdict = parse_number(items[count].n, s) ? VERDICT_COMPOSITE : VERDICT_INVALID;
+            items[count].stage = SCREEN_PASSED;
+            count++;
+        }
+
+        parallel_for(count, (unsigned) threads, check_one, &b);
+
+        // report in input order
+        for (size_t i = 0; i < count; i++) {
+            static const char *names[] = { "invalid", "prime", "composite" };
+            fprintf(outfile, "%s %s\n", items[i].text, names[items[i].verdict]);
+            counts[items[i].verdict]++;
+            if (items[i].verdict == VERDICT_COMPOSITE) {
+                by_stage[items[i].stage]++;
+            }
+            free(items[i].text);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    uint64_t total = counts[0] + counts[1] + counts[2];
+
+    if (verb) {
+        fprintf(stderr, "Tested %" PRIu64 " numbers on %" PRIu64 " threads in %.3f s\n", total, threads, secs);
+    }
+    if (json) {
+        fprintf(stderr,
+                "{\"total\": %" PRIu64 ", \"prime\": %" PRIu64 ", \"composite\": %" PRIu64
+                ", \"invalid\": %" PRIu64 ", \"rejected_by\": {\"trial_division\": %" PRIu64
+                ", \"base2\": %" PRIu64 ", \"miller_rabin\": %" PRIu64 "}, \"rounds\": %" PRIu64
+                ", \"threads\": %" PRIu64 ", \"seconds\": %.6f}\n",
+                total, counts[VERDICT_PRIME], counts[VERDICT_COMPOSITE], counts[VERDICT_INVALID],
+                by_stage[SCREEN_TRIAL], by_stage[SCREEN_BASE2], by_stage[SCREEN_PASSED],
+                iters, threads, secs);
+    }
+
+    // clean up
+    free(line);
+    for (size_t i = 0; i < CHUNK; i++) {
+        mpz_clear(items[i].n);
+    }
+    free(items);
+    for (uint64_t t = 0; t < threads; t++) {
+        rng_clear(&rngs[t]);
+    }
+    free(rngs);
+    if (infile != stdin) fclose(infile);
+    if (outfile != stdout) fclose(outfile);
+    return counts[VERDICT_INVALID] ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "primepool.h"
+#include "numtheory.h"
+#include "randstate.h"
+#include "ss.h"
+
+// open and flock "<path>.lock"; returns the lock fd or -1
+static int pool_lock(const char *path, int how) {
+    size_t len = strlen(path) + sizeof(".lock");
+    char *name = (char *) malloc(len);
+    snprintf(name, len, "%s.lock", path);
+    int fd = open(name, O_RDWR | O_CREAT, 0600);
+    free(name);
+    if (fd < 0) {
+        return -1;
+    }
+    if (flock(fd, how) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void pool_unlock(int fd) {
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+// parse "<bits> <hex>"; false on anything else, including consumed lines
+static bool parse_line(const char *line, uint64_t *bits, mpz_t p) {
+    if (line[0] == '-') {
+        return false;
+    }
+    char *end = NULL;
+    unsigned long long b = strtoull(line, &end, 10);
+    if (end == line || *end != ' ') {
+        return false;
+    }
+    *bits = (uint64_t) b;
+    return mpz_set_str(p, end + 1, 16) == 0 && mpz_sizeinbase(p, 2) == *bits;
+}
+
+// whether a line, consumed or not, holds p
+static bool line_holds(const char *line, const mpz_t p, mpz_t tmp) {
+    const char *hex = strchr(line, ' ');
+    return hex && mpz_set_str(tmp, hex + 1, 16) == 0 && mpz_cmp(tmp, p) == 0;
+}
+
+static bool has_top2(const mpz_t p, uint64_t bits) {
+    return bits >= 2 && mpz_tstbit(p, bits - 2);
+}
+
+// append one prime under the lock unless the pool holds or held it already;
+// the pool only ever grows by whole lines
+// returns 1 if appended, 0 for a repeated prime, -1 on failure
+static int pool_append(const char *path, const mpz_t p) {
+    int lock = pool_lock(path, LOCK_EX);
+    if (lock < 0) {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    FILE *f = fd >= 0 ? fdopen(fd, "a+") : NULL;
+    int status = -1;
+    if (f) {
+        char *line = NULL;
+        size_t cap = 0;
+        mpz_t tmp;
+        mpz_init(tmp);
+        bool repeated = false;
+        rewind(f);
+        while (!repeated && getline(&line, &cap, f) > 0) {
+            repeated = line_holds(line, p, tmp);
+        }
+        mpz_clear(tmp);
+        free(line);
+        if (repeated) {
+            status = 0;
+        } else if (gmp_fprintf(f, "%zu %Zx\n", mpz_sizeinbase(p, 2), p) > 0 && fflush(f) == 0) {
+            status = 1;
+            fsync(fd);
+        }
+        fclose(f);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    pool_unlock(lock);
+    return status;
+}
+
+bool primepool_fill(const char *path, uint64_t nbits, uint64_t count, uint64_t iters) {
+    mpz_t p;
+    mpz_init(p);
+    int status = 1;
+
+    // search outside the lock so that concurrent keygens are never blocked by it
+    for (uint64_t i = 0; status >= 0 && i < count; i++) {
+        uint64_t pbits = ss_pick_pbits(nbits);
+        // a prime the pool holds or held is replaced, never added twice
+        do {
+            make_prime_top2(p, pbits, iters);
+        } while ((status = pool_append(path, p)) == 0);
+        if (status > 0) {
+            do {
+                make_prime(p, ss_qbits(nbits, pbits), iters);
+            } while ((status = pool_append(path, p)) == 0);
+        }
+    }
+    mpz_clear(p);
+    return status >= 0;
+}
+
+bool primepool_take(const char *path, mpz_t p, uint64_t bits, bool top2, uint64_t iters) {
+    int lock = pool_lock(path, LOCK_EX);
+    if (lock < 0) {
+        return false;
+    }
+    int fd = open(path, O_RDWR);
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!in) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        pool_unlock(lock);
+        return false;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t got;
+    off_t off = 0;
+    bool found = false, marked = false, ok = true;
+    uint64_t b;
+    mpz_t cand;
+    mpz_init(cand);
+
+    // consume the first usable prime, later copies of it, and any line that
+    // fails verification on the way
+    while (ok && (got = getline(&line, &cap, in)) > 0) {
+        bool consume = false;
+        if (found) {
+            consume = line[0] != '-' && line_holds(line, p, cand);
+        } else if (parse_line(line, &b, cand) && b == bits && (!top2 || has_top2(cand, b))) {
+            consume = true;
+            if (is_prime(cand, iters)) {
+                mpz_set(p, cand);
+                found = true;
+            }
+        }
+        if (consume) {
+            ok = pwrite(fd, "-", 1, off) == 1;
+            marked = true;
+        }
+        off += got;
+    }
+    ok = ok && (!marked || fdatasync(fd) == 0);
+
+    free(line);
+    mpz_clear(cand);
+    fclose(in);
+    pool_unlock(lock);
+    return ok && found;
+}
+
+bool primepool_pick_pbits(const char *path, uint64_t nbits, uint64_t *pbits) {
+    uint64_t lo = nbits / 5, hi = (2 * nbits) / 5;
+    if (hi <= lo) {
+        return false;
+    }
+
+    // per-size counts: any prime, and primes usable as p
+    uint64_t span = nbits + 2;              // q never exceeds nbits + 1 bits
+    uint64_t *any = (uint64_t *) calloc(span, sizeof(uint64_t));
+    uint64_t *top = (uint64_t *) calloc(span, sizeof(uint64_t));
+
+    int lock = pool_lock(path, LOCK_SH);
+    FILE *in = lock >= 0 ? fopen(path, "r") : NULL;
+    if (in) {
+        char *line = NULL;
+        size_t cap = 0;
+        uint64_t b;
+        mpz_t cand;
+        mpz_init(cand);
+        while (getline(&line, &cap, in) > 0) {
+            if (parse_line(line, &b, cand) && b < span) {
+                any[b]++;
+                top[b] += has_top2(cand, b);
+            }
+        }
+        mpz_clear(cand);
+        free(line);
+        fclose(in);
+    }
+    if (lock >= 0) {
+        pool_unlock(lock);
+    }
+
+    // splits the pool can serve completely
+    uint64_t *cands = (uint64_t *) malloc((hi - lo) * sizeof(uint64_t));
+    uint64_t ncands = 0;
+    for (uint64_t pb = lo < 2 ? 2 : lo; pb < hi; pb++) {
+        uint64_t qb = ss_qbits(nbits, pb);
+        if (qb < span && top[pb] > 0 && any[qb] > (qb == pb ? 1u : 0u)) {
+            cands[ncands++] = pb;
+        }
+    }
+    if (ncands > 0) {
+        *pbits = cands[rng_below(randstate(), ncands)];
+    }
+
+    free(cands);
+    free(any);
+    free(top);
+    return ncands > 0;
+}
+
+bool primepool_source_take(mpz_t p, uint64_t bits, bool top2, void *ctx) {
+    primepool_source *src = (primepool_source *) ctx;
+    if (primepool_take(src->path, p, bits, top2, src->iters)) {
+        src->hits++;
+        return true;
+    }
+    src->misses++;
+    return false;
+}
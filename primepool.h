@@ -0,0 +1,72 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Prime pool: primes generated ahead of time so that keygen can draw them
+// instead of searching while the caller waits.
+//
+// The pool is a text file with one prime per line, "<bits> <hex>", readable
+// by its owner only. Every access holds a flock(2) on "<pool>.lock". Taking
+// a prime overwrites the first byte of its line with '-' in place, so a
+// prime is handed out at most once even across concurrent keygen processes
+// and crashes, without rewriting the rest of the pool. Consumed lines stay
+// in the file: a prime is never appended twice, even after it was taken.
+//
+
+//
+// Generate primes for nbits keys and append them to the pool
+//
+// Provides:
+//  count (p, q) pairs sized as ss_make_pub_split would size them; a prime
+//  the pool already holds (or held) is replaced by a fresh one
+//
+// Requires:
+//  path: pool file; created if missing
+//  nbits: key size the primes are meant for
+//  iters: iterations of Miller-Rabin to use for primality check
+//  randstate_init_os to have been called, so that concurrent fills differ
+//
+// Returns false if the pool could not be written
+//
+bool primepool_fill(const char *path, uint64_t nbits, uint64_t count, uint64_t iters);
+
+//
+// Remove one prime of the given size from the pool
+//
+// Provides:
+//  p: a prime of exactly bits bits, re-verified with iters rounds; every
+//     copy of it in the pool is consumed with it
+//
+// Requires:
+//  top2: also require the second most significant bit (see make_prime_top2)
+//  p: initialized
+//
+// Returns false if the pool holds no such prime (or cannot be read)
+//
+bool primepool_take(const char *path, mpz_t p, uint64_t bits, bool top2, uint64_t iters);
+
+//
+// Choose a p/q split for an nbits key that the pool can serve entirely
+//
+// Provides:
+//  pbits: drawn uniformly among the splits with both primes available
+//
+// Returns false if no split is available
+//
+bool primepool_pick_pbits(const char *path, uint64_t nbits, uint64_t *pbits);
+
+//
+// ss_prime_source adapter drawing from the pool named by ctx (a
+// primepool_source)
+//
+typedef struct {
+    const char *path;
+    uint64_t iters;
+    uint64_t hits;          // primes served from the pool
+    uint64_t misses;        // requests that fell back to live search
+} primepool_source;
+
+bool primepool_source_take(mpz_t p, uint64_t bits, bool top2, void *ctx);
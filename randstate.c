@@ -1,14 +1,49 @@
-#include <stdlib.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/random.h>
 #include "randstate.h"
 
-gmp_randstate_t state;              //global random state variable
+static uint64_t seed_value;                 // seed of the current generation
+static atomic_ulong generation = 1;         // bumped by every init and clear
+static atomic_ulong next_stream;
+
+static _Thread_local rng local;             // this thread's stream
+static _Thread_local unsigned long local_generation;
 
 void randstate_init(uint64_t seed) {
-    srandom(seed);                  //make random seed
-    gmp_randinit_mt(state);         //initialize the state
-    gmp_randseed_ui(state, seed);   //set seed value to state
+    seed_value = seed;
+    atomic_store(&next_stream, 1);
+    local_generation = atomic_fetch_add(&generation, 1) + 1;
+    rng_init(&local, seed, 0);
+}
+
+bool randstate_init_os(void) {
+    uint64_t seed;
+    if (getrandom(&seed, sizeof(seed), 0) != (ssize_t) sizeof(seed)) {
+        FILE *f = fopen("/dev/urandom", "rb");
+        size_t got = f ? fread(&seed, sizeof(seed), 1, f) : 0;
+        if (f) {
+            fclose(f);
+        }
+        if (got != 1) {
+            return false;
+        }
+    }
+    randstate_init(seed);
+    return true;
 }
 
 void randstate_clear(void) {
-    gmp_randclear(state);
+    atomic_fetch_add(&generation, 1);       // other threads re-derive on next use
+    rng_clear(&local);
+    local_generation = 0;
+}
+
+rng *randstate(void) {
+    unsigned long g = atomic_load(&generation);
+    if (local_generation != g) {
+        local_generation = g;
+        rng_init(&local, seed_value, atomic_fetch_add(&next_stream, 1));
+    }
+    return &local;
 }
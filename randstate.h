@@ -1,9 +1,10 @@
 #pragma once
 
 #include <gmp.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-extern gmp_randstate_t state;
+#include "rng.h"
 
 //
 // Initializes the random state needed for SS key generation operations.
@@ -11,10 +12,27 @@ extern gmp_randstate_t state;
 //
 // seed: the seed to seed the random state with.
 //
+// The calling thread draws from stream 0 of the seed; every other thread
+// gets a stream of its own (1, 2, ... in order of first use), so threads
+// never contend for, or share, random state.
+//
 void randstate_init(uint64_t seed);
 
+//
+// randstate_init with a seed from the operating system (getrandom(2), else
+// /dev/urandom), for output that must differ between runs, e.g. pool primes.
+//
+// Returns false (state left as it was) if no OS randomness is available.
+//
+bool randstate_init_os(void);
+
 //
 // Frees any memory used by the initialized random state.
 // Must be called after all key generation or number theory operations are used.
 //
 void randstate_clear(void);
+
+//
+// The calling thread's generator for the current seed.
+//
+rng *randstate(void);
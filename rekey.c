@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <gmp.h>
+
+#include "numtheory.h"
+#include "randstate.h"
+#include "ss.h"
+#include "ssio.h"
+#include "tune.h"
+
+#define OPTIONS "i:o:d:n:t:vh"
+
+int main(int argc, char** argv) {
+    FILE *infile = stdin;
+    FILE *outfile = stdout;
+    FILE *priv, *pub;
+    char username[100];
+    char *priv_name = "ss.priv";
+    char *pub_name = "ss.pub";
+    int opt = 0;
+    int verb = 0;
+    const char *tuned = tune_startup();
+    ssio_opts opts = { .threads = tune.threads, .batch = tune.batch };
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'i': {
+            infile = fopen(optarg, "r");
+            if (!infile) {
+                fprintf(stderr, "rekey - Could not open infile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'o': {
+            outfile = fopen(optarg, "w");
+            if (!outfile) {
+                fprintf(stderr, "rekey - Could not open outfile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'd': priv_name = optarg; break;
+        case 'n': pub_name = optarg; break;
+        case 't': { // threads; digits only, 0 = online CPUs
+            char *end = NULL;
+            unsigned long t = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || t > SSIO_THREADS_MAX) {
+                fprintf(stderr, "rekey: invalid -t <threads>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.threads = (unsigned) t;
+            break;
+        }
+        case 'v': verb = 1; break;
+        case 'h':
+            printf(
+                "SYNOPSIS\n"
+                "  Re-encrypts a file from one Schmidt-Samoa (SS) key to another in a\n"
+                "  single streaming pass; the plaintext never touches the disk.\n\n"
+                "USAGE\n"
+                "  rekey [-hv] [-i infile] [-o outfile] [-d old privkey] [-n new pubkey] [-t threads]\n\n"
+                "OPTIONS\n"
+                "  -i infile     Input file (default: stdin).\n"
+                "  -o outfile    Output file (default: stdout).\n"
+                "  -d privkey    Private key the input was encrypted for (default: ss.priv).\n"
+                "  -n pubkey     Public key to re-encrypt to (default: ss.pub).\n"
+                "  -t threads    Worker threads (default: online CPUs).\n"
+                "  -v            Verbose output.\n"
+                "  -h            Display program usage.\n");
+            return 0;
+        default:
+            return EXIT_FAILURE;
+        }
+    } // end of switch cases
+
+    if (verb && tuned) {
+        fprintf(stderr, "Tuning profile: %s\n", tuned);
+    }
+    tune_buffer(infile);
+    tune_buffer(outfile);
+
+    // open both key files
+    priv = fopen(priv_name, "r");
+    if (!priv) {
+        fprintf(stderr, "rekey - Could not open private key file: %s\n", priv_name);
+        return EXIT_FAILURE;
+    }
+    pub = fopen(pub_name, "r");
+    if (!pub) {
+        fprintf(stderr, "rekey - Could not open public key file: %s\n", pub_name);
+        fclose(priv);
+        return EXIT_FAILURE;
+    }
+
+    mpz_t d, pq, n;
+    mpz_inits(d, pq, n, NULL);
+    ss_read_priv(pq, d, priv);
+    ss_read_pub(n, username, pub);
+
+    // verbose output
+    if (verb) {
+        gmp_fprintf(stderr, "Old private modulus pq (%zu bits)\n", mpz_sizeinbase(pq, 2));
+        fprintf(stderr, "New recipient: %s\n", username);
+        gmp_fprintf(stderr, "New public key n  (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+    }
+
+    // re-encrypt & clean up
+    int status = EXIT_SUCCESS;
+    if (!ssio_rekey_file(infile, outfile, d, pq, n, &opts)) {
+        fprintf(stderr, "rekey - Malformed input or output failure\n");
+        status = EXIT_FAILURE;
+    }
+    if (infile  && infile  != stdin)  fclose(infile);
+    if (outfile && outfile != stdout) fclose(outfile);
+    fclose(priv);
+    fclose(pub);
+    mpz_clears(d, pq, n, NULL);
+    return status;
+}
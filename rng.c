@@ -0,0 +1,135 @@
+#include <string.h>
+#include "rng.h"
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define QR(a, b, c, d) (a += b, d ^= a, d = ROTL(d, 16), c += d, b ^= c, b = ROTL(b, 12), \
+                        a += b, d ^= a, d = ROTL(d, 8),  c += d, b ^= c, b = ROTL(b, 7))
+
+// ChaCha20 block counter of stream into out (RFC 8439 layout, 64-bit counter and nonce)
+static void chacha_block(const rng *r, uint64_t counter, uint8_t out[64]) {
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        r->key[0], r->key[1], r->key[2], r->key[3], r->key[4], r->key[5], r->key[6], r->key[7],
+        (uint32_t) counter, (uint32_t) (counter >> 32), (uint32_t) r->stream, (uint32_t) (r->stream >> 32),
+    };
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        QR(x[0], x[4], x[8], x[12]); QR(x[1], x[5], x[9], x[13]);
+        QR(x[2], x[6], x[10], x[14]); QR(x[3], x[7], x[11], x[15]);
+        QR(x[0], x[5], x[10], x[15]); QR(x[1], x[6], x[11], x[12]);
+        QR(x[2], x[7], x[8], x[13]); QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + in[i];
+        out[4 * i] = (uint8_t) v;
+        out[4 * i + 1] = (uint8_t) (v >> 8);
+        out[4 * i + 2] = (uint8_t) (v >> 16);
+        out[4 * i + 3] = (uint8_t) (v >> 24);
+    }
+}
+
+static void refill(rng *r) {
+    for (int i = 0; i < RNG_BLOCKS; i++) {
+        chacha_block(r, r->counter++, r->buf + 64 * i);
+    }
+    r->pos = 0;
+}
+
+void rng_init(rng *r, uint64_t seed, uint64_t stream) {
+    // splitmix64 spreads the seed over the whole key
+    uint64_t x = seed;
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        r->key[2 * i] = (uint32_t) z;
+        r->key[2 * i + 1] = (uint32_t) (z >> 32);
+    }
+    r->stream = stream;
+    r->counter = 0;
+    r->pos = RNG_BUF;       // generate on first use
+}
+
+void rng_clear(rng *r) {
+    volatile uint8_t *p = (volatile uint8_t *) r;
+    for (size_t i = 0; i < sizeof(*r); i++) {
+        p[i] = 0;
+    }
+}
+
+void rng_bytes(rng *r, void *out, size_t len) {
+    uint8_t *o = (uint8_t *) out;
+    while (len > 0) {
+        if (r->pos == RNG_BUF) {
+            refill(r);
+        }
+        size_t take = RNG_BUF - r->pos < len ? RNG_BUF - r->pos : len;
+        memcpy(o, r->buf + r->pos, take);
+        r->pos += take;
+        o += take;
+        len -= take;
+    }
+}
+
+uint64_t rng_u64(rng *r) {
+    uint64_t v;
+    rng_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+uint64_t rng_below(rng *r, uint64_t bound) {
+    // reject the top 2^64 mod bound values so every residue is equally likely
+    uint64_t limit = -bound % bound, v;
+    do {
+        v = rng_u64(r);
+    } while (v < limit);
+    return v % bound;
+}
+
+void rng_urandomb(rng *r, mpz_t z, uint64_t bits) {
+    if (bits == 0) {
+        mpz_set_ui(z, 0);
+        return;
+    }
+    // fill the limbs in place, then cut to bits
+    mp_size_t limbs = (mp_size_t) ((bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+    mp_limb_t *d = mpz_limbs_write(z, limbs);
+    rng_bytes(r, d, (size_t) limbs * sizeof(mp_limb_t));
+    unsigned top = (unsigned) (bits % GMP_NUMB_BITS);
+    if (top) {
+        d[limbs - 1] &= ((mp_limb_t) 1 << top) - 1;
+    }
+    mpz_limbs_finish(z, limbs);
+}
+
+void rng_urandomm(rng *r, mpz_t z, const mpz_t n) {
+    uint64_t bits = mpz_sizeinbase(n, 2);
+    do {
+        rng_urandomb(r, z, bits);       // accepted with probability above 1/2
+    } while (mpz_cmp(z, n) >= 0);
+}
+
+void rng_candidate(rng *r, mpz_t p, uint64_t bits, bool top2) {
+    rng_urandomb(r, p, bits);
+    mpz_setbit(p, bits - 1);            // force exact bit-length
+    if (top2) {
+        mpz_setbit(p, bits - 2);        // and the next bit
+    }
+    mpz_setbit(p, 0);                   // force odd
+}
+
+void rng_witness(rng *r, mpz_t a, const mpz_t n) {
+    uint64_t bits = mpz_sizeinbase(n, 2);
+    bool ok;
+    do {
+        rng_urandomb(r, a, bits);
+        ok = mpz_cmp_ui(a, 2) >= 0 && mpz_cmp(a, n) < 0;
+        if (ok) {
+            mpz_add_ui(a, a, 1);        // a <= n-2 unless a + 1 == n
+            ok = mpz_cmp(a, n) != 0;
+            mpz_sub_ui(a, a, 1);
+        }
+    } while (!ok);
+}
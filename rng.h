@@ -0,0 +1,97 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Counter-based CSPRNG: ChaCha20 keyed from a seed, one independent stream
+// per (seed, stream) pair.
+//
+// Block i of stream s is ChaCha20(key, nonce = s, counter = i), so streams
+// never overlap and any number of threads can each own one without
+// sharing state. Output is produced RNG_BLOCKS blocks at a time into a
+// buffer that draws are served from.
+//
+// An rng is a plain value: copying one (e.g. to replay a witness sequence)
+// yields a second generator that repeats the first's future output.
+//
+
+#define RNG_BLOCKS 4                // ChaCha20 blocks per refill
+#define RNG_BUF    (64 * RNG_BLOCKS)
+
+typedef struct {
+    uint32_t key[8];
+    uint64_t stream;
+    uint64_t counter;               // next block to generate
+    size_t pos;                     // bytes of buf already handed out
+    uint8_t buf[RNG_BUF];
+} rng;
+
+//
+// Seed a stream
+//
+// Requires:
+//  seed: expanded into the 256-bit key; equal seeds give equal keys
+//  stream: e.g. a thread index; distinct streams are independent
+//
+void rng_init(rng *r, uint64_t seed, uint64_t stream);
+
+//
+// Wipe the key and buffered output
+//
+void rng_clear(rng *r);
+
+void rng_bytes(rng *r, void *out, size_t len);
+
+uint64_t rng_u64(rng *r);
+
+//
+// Uniform integer in [0, bound), without modulo bias
+//
+// Requires:
+//  bound: at least 1
+//
+uint64_t rng_below(rng *r, uint64_t bound);
+
+//
+// Uniform integer of at most bits bits
+//
+// Provides:
+//  z: in [0, 2^bits)
+//
+void rng_urandomb(rng *r, mpz_t z, uint64_t bits);
+
+//
+// Uniform integer below n
+//
+// Provides:
+//  z: in [0, n)
+//
+// Requires:
+//  n: positive
+//
+void rng_urandomm(rng *r, mpz_t z, const mpz_t n);
+
+//
+// Prime candidate of exactly bits bits
+//
+// Provides:
+//  p: odd, top bit set; with top2 also the second bit (p >= 1.5 * 2^(bits-1))
+//
+// Requires:
+//  bits: at least 2
+//
+void rng_candidate(rng *r, mpz_t p, uint64_t bits, bool top2);
+
+//
+// Miller-Rabin witness for n
+//
+// Provides:
+//  a: uniform in [2, n-2]
+//
+// Requires:
+//  n: at least 5
+//
+void rng_witness(rng *r, mpz_t a, const mpz_t n);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// SHA-256 (FIPS 180-4), used to fingerprint plaintext blocks and keys
+//
+
+#define SHA256_LEN 32
+
+//
+// Hash len bytes of data in one call
+//
+// Provides:
+//  out: the 32-byte digest
+//
+void sha256(const void *data, size_t len, uint8_t out[SHA256_LEN]);
@@ -1,35 +1,123 @@
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ss.h"
 #include "numtheory.h"
+#include "randstate.h"
+#include "sha256.h"
 
 void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters) {
+    ss_make_pub_split(p, q, n, nbits, ss_pick_pbits(nbits), iters, NULL);
+}
+
+uint64_t ss_pick_pbits(uint64_t nbits) {
+    uint64_t lo = nbits / 5;
+    uint64_t hi = (2 * nbits) / 5;
+    if (hi <= lo) {
+        return lo < 2 ? 2 : lo;     // toy key sizes: nothing to pick from
+    }
+    uint64_t pbits = lo + rng_below(randstate(), hi - lo);  // make random number with range
+    return pbits < 2 ? 2 : pbits;
+}
+
+uint64_t ss_pick_pbits_fast(uint64_t nbits) {
+    uint64_t lo = nbits / 5;
+    uint64_t hi = (2 * nbits) / 5;
+    if (hi <= lo) {
+        return lo < 2 ? 2 : lo;     // toy key sizes, as ss_pick_pbits
+    }
+    return hi - 1 < 2 ? 2 : hi - 1;
+}
+
+uint64_t ss_pbits_for_pq(uint64_t nbits, uint64_t pqbits) {
+    // pq < 2^(pbits + qbits) = 2^(nbits + 1 - pbits)
+    if (pqbits > nbits || pqbits < 2) {
+        return 0;
+    }
+    uint64_t pbits = nbits + 1 - pqbits;
+    bool in_range = pbits >= nbits / 5 && pbits < (2 * nbits) / 5 && pbits >= 2;
+    return in_range && ss_qbits(nbits, pbits) == nbits + 1 - 2 * pbits ? pbits : 0;
+}
+
+bool ss_pq_range(uint64_t nbits, uint64_t *lo, uint64_t *hi) {
+    // pqbits = nbits + 1 - pbits, so the largest p gives the smallest pq
+    bool any = false;
+    for (uint64_t pbits = nbits / 5; pbits < (2 * nbits) / 5; pbits++) {
+        uint64_t pqbits = nbits + 1 - pbits;
+        if (ss_pbits_for_pq(nbits, pqbits)) {
+            *hi = any ? *hi : pqbits;
+            *lo = pqbits;
+            any = true;
+        }
+    }
+    return any;
+}
+
+uint64_t ss_qbits(uint64_t nbits, uint64_t pbits) {
+    // p >= 1.5 * 2^(pbits-1) and q >= 2^(qbits-1) give n = p*p*q >= 2^(nbits-1)
+    // (toy sizes: q needs at least 3 bits so that some q differs from p)
+    return nbits + 1 > 2 * pbits + 3 ? nbits + 1 - 2 * pbits : 3;
+}
+
+static ss_prime_source prime_source = NULL;
+static void *prime_source_ctx = NULL;
+
+void ss_set_prime_source(ss_prime_source source, void *ctx) {
+    prime_source = source;
+    prime_source_ctx = ctx;
+}
+
+// ask the prime source first, search if it has nothing to offer
+static void next_prime(mpz_t p, uint64_t bits, bool top2, uint64_t iters) {
+    if (prime_source && prime_source(p, bits, top2, prime_source_ctx)) {
+        return;
+    }
+    if (top2) {
+        make_prime_top2(p, bits, iters);
+    } else {
+        make_prime(p, bits, iters);
+    }
+}
+
+void ss_make_pub_split(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t pbits, uint64_t iters,
+                       ss_keygen_stats *stats) {
+    uint64_t qbits = ss_qbits(nbits, pbits);
+    ss_keygen_stats local = { 0 };
+    if (!stats) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->pbits = pbits;
+    stats->qbits = qbits;
+
     // mpz inits
     mpz_t p_check, q_check;
     mpz_inits(p_check, q_check, NULL);
 
-    // loop until constraints are met
-    // p | (q-1) is false
-    // q | (p-1) is false
-    // log2(n) >= nbits  (i.e., n has at least the requested bit length)
-     do {
-        // make pbits and qbits
-        uint64_t pbits = (random() % (((2 * nbits) / 5) - (nbits / 5))) + (nbits / 5); // make random number with range
-        uint64_t qbits = nbits - (2 * pbits); // remaining bits go to qbits
+    // make primes
+    next_prime(p, pbits, true, iters);
+    next_prime(q, qbits, false, iters);
 
-        // make primes
-        make_prime(p, pbits, iters);
-        make_prime(q, qbits, iters);
-
-        // make minus one version
+    // regenerate only the offending prime until
+    // p | (q-1) is false (and p != q)
+    // q | (p-1) is false
+    for (;;) {
         mpz_sub_ui(p_check, p, 1);
         mpz_sub_ui(q_check, q, 1);
+        if (mpz_cmp(p, q) == 0 || mpz_divisible_p(q_check, p)) {
+            next_prime(q, qbits, false, iters);
+            stats->q_retries++;
+        } else if (mpz_divisible_p(p_check, q)) {
+            next_prime(p, pbits, true, iters);
+            stats->p_retries++;
+        } else {
+            break;
+        }
+    }
 
-        // n = p*p*q
-        mpz_mul(n, p, p);
-        mpz_mul(n, n, q);
-
-        // loop again if any constraint fails
-    } while (mpz_divisible_p(q_check, p) || mpz_divisible_p(p_check, q) || mpz_sizeinbase(n, 2) < nbits);
+    // n = p*p*q
+    mpz_mul(n, p, p);
+    mpz_mul(n, n, q);
 
     mpz_clears(p_check, q_check, NULL);
 }
@@ -84,8 +172,22 @@ void ss_read_pub(mpz_t n, char username[], FILE *pbfile) {
     // if valid
     if (pbfile) {
         gmp_fscanf(pbfile, "%Zx", n);       // read n
-        gmp_fscanf(pbfile, "%s", username); // read username
+        gmp_fscanf(pbfile, "%99s", username); // read username (SS_USERNAME_MAX - 1)
+    }
+}
+
+uint64_t ss_fingerprint(const mpz_t n) {
+    size_t len = 0;
+    uint8_t *bytes = (uint8_t *) malloc((mpz_sizeinbase(n, 2) + 7) / 8 + 1);
+    mpz_export(bytes, &len, 1, 1, 1, 0, n);
+    uint8_t digest[SHA256_LEN];
+    sha256(bytes, len, digest);
+    free(bytes);
+    uint64_t fp = 0;
+    for (int i = 0; i < 8; i++) {
+        fp = fp << 8 | digest[i];
     }
+    return fp;
 }
 
 void ss_read_priv(mpz_t pq, mpz_t d, FILE *pvfile) {
@@ -100,6 +202,23 @@ void ss_encrypt(mpz_t c, const mpz_t m, const mpz_t n){
     pow_mod(c, m, n, n);
 }
 
+uint64_t ss_block_size(const mpz_t n) {
+    mpz_t root;
+    mpz_init(root);
+    mpz_sqrt(root, n);                                  // make sqrt(n)
+    uint64_t k = (mpz_sizeinbase(root, 2) - 1) / 8;     // k = floor((log2(√n)-1)/8)
+    mpz_clear(root);
+    return k;
+}
+
+void ss_encrypt_bytes(mpz_t c, const uint8_t *buf, size_t len, const mpz_t n) {
+    mpz_import(c, len, 1, 1, 1, 0, buf);                // payload bytes, big endian
+    for (uint64_t b = 0; b < 8; b++) {
+        mpz_setbit(c, 8 * len + b);                     // prepend the 0xFF byte
+    }
+    ss_encrypt(c, c, n);
+}
+
 void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n) {
     // mpz inits
     size_t read;    //j
@@ -129,6 +248,167 @@ void ss_decrypt(mpz_t m, const mpz_t c, const mpz_t d, const mpz_t pq){
     pow_mod(m, c, d, pq);
 }
 
+// strip the pad byte off a decrypted block; consumes m
+static bool unpad_block(uint8_t *buf, size_t *len, size_t cap, mpz_t m) {
+    // empty block; nothing but (possibly) the pad byte was lost
+    if (mpz_sgn(m) == 0) {
+        *len = 0;
+        mpz_clear(m);
+        return true;
+    }
+
+    size_t bytes = (mpz_sizeinbase(m, 2) + 7) / 8;
+    if (bytes - 1 > cap) {
+        mpz_clear(m);
+        return false;
+    }
+
+    // export below the pad byte: clear it so only the payload remains
+    mpz_tdiv_r_2exp(m, m, 8 * (bytes - 1));
+    size_t got = 0;
+    if (bytes > 1) {
+        memset(buf, 0, bytes - 1);
+        mpz_export(buf, &got, 1, 1, 1, 0, m);
+        // payload with leading zero bytes exports short; right-align it
+        if (got < bytes - 1) {
+            memmove(buf + (bytes - 1 - got), buf, got);
+            memset(buf, 0, bytes - 1 - got);
+        }
+    }
+    *len = bytes - 1;
+    mpz_clear(m);
+    return true;
+}
+
+bool ss_decrypt_bytes(uint8_t *buf, size_t *len, size_t cap, const mpz_t c, const mpz_t d, const mpz_t pq) {
+    mpz_t m;
+    mpz_init(m);
+    ss_decrypt(m, c, d, pq);
+    return unpad_block(buf, len, cap, m);
+}
+
+bool ss_crt_init(ss_crt_key *k, const mpz_t d, const mpz_t pq, const mpz_t n) {
+    mpz_t r;
+    mpz_init(r);
+    mpz_inits(k->p, k->q, k->dp, k->dq, k->qinv, k->n, k->p2, k->ep, k->eq, k->qinv2, NULL);
+
+    // n = p^2 q and pq = p q, so n / pq = p
+    mpz_tdiv_qr(k->p, r, n, pq);
+    bool ok = mpz_sgn(r) == 0 && mpz_cmp_ui(k->p, 1) > 0 && mpz_divisible_p(pq, k->p);
+    if (ok) {
+        mpz_divexact(k->q, pq, k->p);
+        ok = mpz_cmp_ui(k->q, 1) > 0 && mpz_cmp(k->p, k->q) != 0;
+    }
+    if (ok) {
+        mpz_sub_ui(r, k->p, 1);
+        mpz_mod(k->dp, d, r);
+        mpz_sub_ui(r, k->q, 1);
+        mpz_mod(k->dq, d, r);
+        mod_inverse(k->qinv, k->q, k->p);
+        ok = mpz_sgn(k->qinv) != 0;
+    }
+    if (ok) {
+        // encryption exponents: |(Z/p^2)*| = p(p - 1), |(Z/q)*| = q - 1
+        mpz_set(k->n, n);
+        mpz_mul(k->p2, k->p, k->p);
+        mpz_sub_ui(r, k->p, 1);
+        mpz_mul(r, r, k->p);
+        mpz_mod(k->ep, n, r);
+        mpz_sub_ui(r, k->q, 1);
+        mpz_mod(k->eq, n, r);
+        mod_inverse(k->qinv2, k->q, k->p2);
+        ok = mpz_sgn(k->qinv2) != 0;
+    }
+    mpz_clear(r);
+    if (!ok) {
+        ss_crt_clear(k);
+    }
+    return ok;
+}
+
+void ss_crt_clear(ss_crt_key *k) {
+    mpz_clears(k->p, k->q, k->dp, k->dq, k->qinv, k->n, k->p2, k->ep, k->eq, k->qinv2, NULL);
+}
+
+typedef struct {
+    mpz_ptr out;
+    mpz_srcptr c, e, mod;
+} crt_half;
+
+static void *crt_half_run(void *arg) {
+    crt_half *h = (crt_half *) arg;
+    pow_mod(h->out, h->c, h->e, h->mod);
+    return NULL;
+}
+
+void ss_decrypt_crt(mpz_t m, const mpz_t c, const ss_crt_key *k, bool parallel) {
+    mpz_t mp, mq;
+    mpz_inits(mp, mq, NULL);
+
+    // q half on a helper thread while this one does the p half
+    crt_half hq = { .out = mq, .c = c, .e = k->dq, .mod = k->q };
+    pthread_t tid;
+    bool threaded = parallel && pthread_create(&tid, NULL, crt_half_run, &hq) == 0;
+    pow_mod(mp, c, k->dp, k->p);
+    if (threaded) {
+        pthread_join(tid, NULL);
+    } else {
+        crt_half_run(&hq);
+    }
+
+    // Garner: m = mq + q * ((mp - mq) * qinv mod p)
+    mpz_sub(mp, mp, mq);
+    mpz_mul(mp, mp, k->qinv);
+    mpz_mod(mp, mp, k->p);
+    mpz_mul(mp, mp, k->q);
+    mpz_add(m, mp, mq);
+    mpz_clears(mp, mq, NULL);
+}
+
+bool ss_decrypt_bytes_crt(uint8_t *buf, size_t *len, size_t cap, const mpz_t c,
+                          const ss_crt_key *k, bool parallel) {
+    mpz_t m;
+    mpz_init(m);
+    ss_decrypt_crt(m, c, k, parallel);
+    return unpad_block(buf, len, cap, m);
+}
+
+void ss_encrypt_crt(mpz_t c, const mpz_t m, const ss_crt_key *k) {
+    mpz_t cp, cq;
+    mpz_inits(cp, cq, NULL);
+
+    // the reduced exponents only hold for m coprime to the modulus; a multiple
+    // of p (or q) raised to n >= 2 is 0 mod p^2 (or q) either way
+    if (mpz_divisible_p(m, k->p)) {
+        mpz_set_ui(cp, 0);
+    } else {
+        mpz_mod(cp, m, k->p2);
+        pow_mod(cp, cp, k->ep, k->p2);
+    }
+    if (mpz_divisible_p(m, k->q)) {
+        mpz_set_ui(cq, 0);
+    } else {
+        mpz_mod(cq, m, k->q);
+        pow_mod(cq, cq, k->eq, k->q);
+    }
+
+    // Garner: c = cq + q * ((cp - cq) * qinv2 mod p^2)
+    mpz_sub(cp, cp, cq);
+    mpz_mul(cp, cp, k->qinv2);
+    mpz_mod(cp, cp, k->p2);
+    mpz_mul(cp, cp, k->q);
+    mpz_add(c, cp, cq);
+    mpz_clears(cp, cq, NULL);
+}
+
+void ss_encrypt_bytes_crt(mpz_t c, const uint8_t *buf, size_t len, const ss_crt_key *k) {
+    mpz_import(c, len, 1, 1, 1, 0, buf);                // payload bytes, big endian
+    for (uint64_t b = 0; b < 8; b++) {
+        mpz_setbit(c, 8 * len + b);                     // prepend the 0xFF byte
+    }
+    ss_encrypt_crt(c, c, k);
+}
+
 void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq) {
     // mpz inits
     size_t converted; //j
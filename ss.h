@@ -3,6 +3,17 @@
 #include <stdio.h>
 #include <gmp.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+//
+// Retry counters reported by key generation
+//
+typedef struct {
+    uint64_t pbits;         // bit-length chosen for p
+    uint64_t qbits;         // bit-length chosen for q
+    uint64_t p_retries;     // p regenerated because q | p-1
+    uint64_t q_retries;     // q regenerated because p | q-1 (or p == q)
+} ss_keygen_stats;
 
 //
 // Generates the components for a new SS key.
@@ -19,6 +30,85 @@
 //
 void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters);
 
+//
+// Picks the bit-length of p for an nbits key
+//
+// Provides:
+//  pbits drawn uniformly from [nbits/5, 2*nbits/5) with randstate()
+//
+uint64_t ss_pick_pbits(uint64_t nbits);
+
+//
+// Picks the bit-length of p for the cheapest decryption
+//
+// Decryption exponentiates modulo pq, which has about nbits - pbits bits,
+// so the largest p of the range ss_pick_pbits draws from gives the
+// smallest pq the bounds allow (also close to the cheapest split for CRT
+// decryption)
+//
+uint64_t ss_pick_pbits_fast(uint64_t nbits);
+
+//
+// Bit-length of p that gives an nbits key a private modulus pq of about
+// pqbits bits (pqbits or pqbits - 1; p and q vary below their top bits)
+//
+// Returns 0 if that p lies outside [nbits/5, 2*nbits/5)
+//
+uint64_t ss_pbits_for_pq(uint64_t nbits, uint64_t pqbits);
+
+//
+// Range of pqbits that ss_pbits_for_pq accepts for an nbits key
+//
+// Provides:
+//  lo, hi: smallest and largest accepted pqbits; a key made for pqbits has
+//          a pq of pqbits or pqbits - 1 bits
+//
+// Returns false if no split of an nbits key is within the bounds
+//
+bool ss_pq_range(uint64_t nbits, uint64_t *lo, uint64_t *hi);
+
+//
+// Bit-length of q for an nbits key whose p has pbits bits
+//
+uint64_t ss_qbits(uint64_t nbits, uint64_t pbits);
+
+//
+// Optional supplier of ready-made primes for key generation (e.g. a prime
+// pool). It returns false when it has no prime of the requested size, in
+// which case key generation searches for one itself.
+//
+// Provides:
+//  p: a prime of exactly bits bits (with its two top bits set if top2)
+//
+typedef bool (*ss_prime_source)(mpz_t p, uint64_t bits, bool top2, void *ctx);
+
+//
+// Install (or with NULL, remove) the prime source used by ss_make_pub*
+//
+void ss_set_prime_source(ss_prime_source source, void *ctx);
+
+//
+// Generates the components for a new SS key with a given prime split.
+//
+// p gets pbits bits with its two top bits set and q gets nbits - 2*pbits + 1
+// bits, which guarantees nbits <= log2(n) + 1 <= nbits + 1 without retrying.
+// Only the prime violating p | q-1 or q | p-1 is regenerated.
+//
+// Provides:
+//  p:  first prime
+//  q: second prime
+//  n: public modulus/exponent
+//  stats: chosen sizes and retry counts (may be NULL)
+//
+// Requires:
+//  nbits: minimum # of bits in n
+//  pbits: bits in p, e.g. from ss_pick_pbits
+//  iters: iterations of Miller-Rabin to use for primality check
+//  all mpz_t arguments to be initialized
+//
+void ss_make_pub_split(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t pbits, uint64_t iters,
+                       ss_keygen_stats *stats);
+
 //
 // Generates components for a new SS private key.
 //
@@ -53,20 +143,28 @@ void ss_write_pub(const mpz_t n, const char username[], FILE *pbfile);
 //
 void ss_write_priv(const mpz_t pq, const mpz_t d, FILE *pvfile);
 
+#define SS_USERNAME_MAX 100     // username buffer size, terminator included
+
 //
 // Import SS public key from input stream
 //
 // Provides:
 //  n: public modulus
-//  username: $USER of the pubkey creator
+//  username: $USER of the pubkey creator, cut to SS_USERNAME_MAX - 1 bytes
 //
 // Requires:
 //  pbfile: open and readable file stream
-//  username: requires sufficient space
+//  username: SS_USERNAME_MAX bytes
 //  all mpz_t arguments to be initialized
 //
 void ss_read_pub(mpz_t n, char username[], FILE *pbfile);
 
+//
+// Fingerprint of a public key: the first 8 bytes of SHA-256 over n's big
+// endian bytes, read as a big endian number
+//
+uint64_t ss_fingerprint(const mpz_t n);
+
 //
 // Import SS private key from input stream
 //
@@ -93,6 +191,31 @@ void ss_read_priv(mpz_t pq, mpz_t d, FILE *pvfile);
 //
 void ss_encrypt(mpz_t c, const mpz_t m, const mpz_t n);
 
+//
+// Block size k for public modulus n
+//
+// Provides:
+//  k = floor((log2(sqrt(n)) - 1) / 8); each block carries k - 1 payload bytes
+//
+// Requires:
+//  n: public exponent/modulus
+//
+uint64_t ss_block_size(const mpz_t n);
+
+//
+// Encrypt one block of raw bytes
+//
+// Provides:
+//  c: encrypted integer for 0xFF || buf
+//
+// Requires:
+//  buf: at most ss_block_size(n) - 1 payload bytes
+//  len: number of bytes in buf
+//  n: public exponent/modulus
+//  all mpz_t arguments to be initialized
+//
+void ss_encrypt_bytes(mpz_t c, const uint8_t *buf, size_t len, const mpz_t n);
+
 //
 // Encrypt an arbitrary file
 //
@@ -120,6 +243,103 @@ void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n);
 //
 void ss_decrypt(mpz_t m, const mpz_t c, const mpz_t d, const mpz_t pq);
 
+//
+// Decrypt one block back into raw bytes
+//
+// Provides:
+//  buf: payload bytes with the prepended 0xFF byte stripped
+//  len: number of payload bytes written to buf
+//
+// Requires:
+//  cap: capacity of buf; (mpz_sizeinbase(pq, 2) + 7) / 8 always suffices
+//  c: encrypted integer
+//  d: private exponent
+//  pq: private modulus
+//
+// Returns false if the decrypted block does not fit into buf
+//
+bool ss_decrypt_bytes(uint8_t *buf, size_t *len, size_t cap, const mpz_t c, const mpz_t d, const mpz_t pq);
+
+//
+// Private key split for CRT decryption
+//
+// c^d mod pq is computed as c^(d mod (p-1)) mod p and c^(d mod (q-1)) mod q,
+// recombined with Garner's formula. Each half works on half-size numbers
+// with a half-size exponent, so the pair costs about a quarter of one full
+// exponentiation, and the halves can run on two threads at once.
+//
+// Splitting the exponent itself does not pay off: the base changes with
+// every block, so the powers it would need cannot be precomputed.
+//
+// The key owner can encrypt the same way: m^n mod p^2 q is computed as
+// m^(n mod p(p-1)) mod p^2 and m^(n mod (q-1)) mod q, recombined likewise.
+//
+typedef struct {
+    mpz_t p, q;
+    mpz_t dp, dq;               // d mod (p - 1), d mod (q - 1)
+    mpz_t qinv;                 // q^-1 mod p
+    mpz_t n, p2;                // public modulus p^2 q, and p^2
+    mpz_t ep, eq;               // n mod p(p - 1), n mod (q - 1)
+    mpz_t qinv2;                // q^-1 mod p^2
+} ss_crt_key;
+
+//
+// Split a private key using the matching public modulus (p = n / pq)
+//
+// Provides:
+//  k: initialized CRT key; release it with ss_crt_clear
+//
+// Requires:
+//  d: private exponent
+//  pq: private modulus
+//  n: public modulus of the same key pair
+//
+// Returns false (k left uninitialized) if n and pq are not from one key pair
+//
+bool ss_crt_init(ss_crt_key *k, const mpz_t d, const mpz_t pq, const mpz_t n);
+
+void ss_crt_clear(ss_crt_key *k);
+
+//
+// Decrypt number c into number m through the CRT halves
+//
+// Provides:
+//  m: same result as ss_decrypt
+//
+// Requires:
+//  c: encrypted integer
+//  k: CRT key from ss_crt_init
+//  parallel: run the q half on a second thread (latency mode); falls back
+//            to running both halves in turn if no thread can be started
+//
+void ss_decrypt_crt(mpz_t m, const mpz_t c, const ss_crt_key *k, bool parallel);
+
+//
+// ss_decrypt_bytes through the CRT halves
+//
+// Requires:
+//  cap: (mpz_sizeinbase(pq, 2) + 7) / 8 always suffices
+//
+bool ss_decrypt_bytes_crt(uint8_t *buf, size_t *len, size_t cap, const mpz_t c,
+                          const ss_crt_key *k, bool parallel);
+
+//
+// Encrypt number m into number c through the CRT halves (key owner only)
+//
+// Provides:
+//  c: same result as ss_encrypt with the public modulus of k
+//
+// Requires:
+//  m: integer below that modulus
+//  k: CRT key from ss_crt_init
+//
+void ss_encrypt_crt(mpz_t c, const mpz_t m, const ss_crt_key *k);
+
+//
+// ss_encrypt_bytes through the CRT halves; same ciphertext, about 3x faster
+//
+void ss_encrypt_bytes_crt(mpz_t c, const uint8_t *buf, size_t len, const ss_crt_key *k);
+
 //
 // Decrypt a file back into its original form.
 //
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "ssbatch.h"
+#include "sspool.h"
+
+static void add_path(char ***paths, size_t *count, size_t *cap, char *path) {
+    if (*count == *cap) {
+        *cap = *cap ? 2 * *cap : 64;
+        *paths = (char **) realloc(*paths, *cap * sizeof(char *));
+    }
+    (*paths)[(*count)++] = path;
+}
+
+static int cmp_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+char **ssbatch_collect(const char *source, size_t *count) {
+    char **paths = NULL;
+    size_t cap = 0;
+    struct stat st;
+    *count = 0;
+    if (stat(source, &st) != 0) {
+        return NULL;
+    }
+
+    // directory: its regular files, in a stable order
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        if (!dir) {
+            return NULL;
+        }
+        struct dirent *e;
+        while ((e = readdir(dir)) != NULL) {
+            size_t len = strlen(source) + strlen(e->d_name) + 2;
+            char *path = (char *) malloc(len);
+            snprintf(path, len, "%s/%s", source, e->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+                add_path(&paths, count, &cap, path);
+            } else {
+                free(path);
+            }
+        }
+        closedir(dir);
+        if (*count > 1) {
+            qsort(paths, *count, sizeof(char *), cmp_paths);
+        }
+        return paths ? paths : (char **) calloc(1, sizeof(char *));
+    }
+
+    // list file: one path per line
+    FILE *f = fopen(source, "r");
+    if (!f) {
+        return NULL;
+    }
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) > 0) {
+        char *s = line;
+        while (isspace((unsigned char)*s)) s++;
+        size_t len = strlen(s);
+        while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+        if (len > 0 && s[0] != '#') {
+            add_path(&paths, count, &cap, strdup(s));
+        }
+    }
+    free(line);
+    fclose(f);
+    return paths ? paths : (char **) calloc(1, sizeof(char *));
+}
+
+void ssbatch_free(char **paths, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+typedef struct {
+    const char *path;
+    char *out;              // output path; NULL once the file has failed
+    uint8_t *buf;           // whole input, kept until an encrypt job is done
+    size_t size;
+    ss_job job;
+} ssbatch_item;
+
+typedef struct {
+    const ssbatch_opts *o;
+    ss_pool *pool;
+    size_t inflight;        // input bytes of submitted, uncollected jobs
+    size_t pending;         // submitted, uncollected jobs
+    size_t failed;
+    uint64_t bytes;         // input bytes of files that succeeded
+} ssbatch;
+
+static void fail(ssbatch *b, ssbatch_item *it, const char *why) {
+    fprintf(stderr, "%s - %s: %s\n", b->o->prog, it->path, why);
+    free(it->out);
+    it->out = NULL;
+    b->failed++;
+}
+
+static void write_output(ssbatch *b, ssbatch_item *it, const uint8_t *data, size_t len) {
+    FILE *out = fopen(it->out, "w");
+    bool ok = out && fwrite(data, 1, len, out) == len;
+    ok = (out && fclose(out) == 0) && ok;
+    if (!ok) {
+        fail(b, it, "could not write output");
+        return;
+    }
+    if (b->o->verbose) {
+        fprintf(stderr, "%s -> %s (%zu bytes)\n", it->path, it->out, it->size);
+    }
+    b->bytes += it->size;
+}
+
+// write out finished jobs; blocks for at least one job if wait is set
+static void collect(ssbatch *b, bool wait) {
+    ss_job *done[64];
+    size_t got = wait ? ss_pool_wait(b->pool, done, 64) : ss_pool_poll(b->pool, done, 64);
+    for (size_t i = 0; i < got; i++) {
+        ssbatch_item *it = (ssbatch_item *) done[i]->ctx;
+        if (!done[i]->ok) {
+            fail(b, it, b->o->decrypt ? "malformed input" : "could not encrypt");
+        } else {
+            write_output(b, it, done[i]->out, done[i]->out_len);
+        }
+        b->inflight -= it->size;
+        b->pending--;
+        free(it->buf);
+        it->buf = NULL;
+        ss_job_clear(&it->job);
+    }
+}
+
+// files too large to load go through the streaming path
+static void stream_file(ssbatch *b, ssbatch_item *it) {
+    FILE *in = fopen(it->path, "r");
+    FILE *out = in ? fopen(it->out, "w") : NULL;
+    bool ok = in && out
+        && (b->o->decrypt ? ssio_decrypt_file(in, out, b->o->d, b->o->pq, &b->o->opts)
+                          : ssio_encrypt_file(in, out, b->o->n, &b->o->opts));
+    ok = (out && fclose(out) == 0) && ok;
+    if (in) fclose(in);
+    if (!ok) {
+        fail(b, it, !in ? "could not open" : !out ? "could not write output"
+                    : b->o->decrypt ? "malformed input" : "could not encrypt");
+    } else {
+        if (b->o->verbose) {
+            fprintf(stderr, "%s -> %s (%zu bytes, streamed)\n", it->path, it->out, it->size);
+        }
+        b->bytes += it->size;
+    }
+}
+
+// load one file and hand it to the pool
+static void submit(ssbatch *b, ssbatch_item *it) {
+    // keep memory bounded: wait for earlier files before loading this one
+    while (b->pending > 0 && b->inflight + it->size > SSBATCH_WINDOW) {
+        collect(b, true);
+    }
+
+    FILE *in = fopen(it->path, "r");
+    if (!in) {
+        fail(b, it, "could not open");
+        return;
+    }
+    it->buf = (uint8_t *) malloc(it->size + 1);
+    bool ok = fread(it->buf, 1, it->size, in) == it->size && getc(in) == EOF && !ferror(in);
+    fclose(in);
+    if (!ok) {
+        free(it->buf);
+        it->buf = NULL;
+        fail(b, it, "could not read (changed while reading?)");
+        return;
+    }
+
+    if (b->o->decrypt) {
+        ss_job_decrypt_buffer(&it->job, (const char *) it->buf, it->size, b->o->d, b->o->pq);
+        free(it->buf);      // parsed already
+        it->buf = NULL;
+    } else {
+        ss_job_encrypt_buffer(&it->job, it->buf, it->size, b->o->n, b->o->opts.flags);
+        if (b->o->opts.crt && mpz_cmp(b->o->opts.crt->n, b->o->n) == 0) {
+            it->job.crt = b->o->opts.crt;
+        }
+    }
+    it->job.ctx = it;
+    it->job.grain = it->size <= SSBATCH_WHOLE ? it->job.blocks : 1;    // small files: one task
+    b->inflight += it->size;
+    b->pending++;
+    ss_pool_submit(b->pool, &it->job);
+}
+
+// outputs must not clobber an input, or each other
+static bool same_file(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static int cmp_outs(const void *a, const void *b) {
+    const ssbatch_item *x = *(ssbatch_item *const *) a, *y = *(ssbatch_item *const *) b;
+    int c = strcmp(x->out, y->out);
+    return c ? c : (x < y ? -1 : x > y);
+}
+
+size_t ssbatch_run(char **paths, size_t count, const ssbatch_opts *o) {
+    ssbatch b = { .o = o };
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    ssbatch_item *items = (ssbatch_item *) calloc(count ? count : 1, sizeof(ssbatch_item));
+    ssbatch_item **by_out = (ssbatch_item **) malloc((count ? count : 1) * sizeof(ssbatch_item *));
+    for (size_t i = 0; i < count; i++) {
+        const char *base = strrchr(paths[i], '/');
+        base = base ? base + 1 : paths[i];
+        size_t len = strlen(o->outdir) + strlen(base) + 2;
+        items[i].path = paths[i];
+        items[i].out = (char *) malloc(len);
+        snprintf(items[i].out, len, "%s/%s", o->outdir, base);
+        by_out[i] = &items[i];
+    }
+
+    // the first input claims a name; later ones with the same name fail
+    qsort(by_out, count, sizeof(ssbatch_item *), cmp_outs);
+    for (size_t i = 1, claim = 0; i < count; i++) {
+        if (strcmp(by_out[i]->out, by_out[claim]->out) == 0) {
+            fail(&b, by_out[i], "output name already used by another input");
+        } else {
+            claim = i;
+        }
+    }
+    free(by_out);
+
+    b.pool = ss_pool_create(o->opts.threads);
+    if (!b.pool) {
+        fprintf(stderr, "%s - Could not start worker threads\n", o->prog);
+        for (size_t i = 0; i < count; i++) free(items[i].out);
+        free(items);
+        return count;
+    }
+
+    // small and medium files through the pool, finishing in any order
+    for (size_t i = 0; i < count; i++) {
+        ssbatch_item *it = &items[i];
+        struct stat st;
+        if (!it->out) {
+            continue;
+        } else if (stat(it->path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            fail(&b, it, "not a readable regular file");
+        } else if (same_file(it->path, it->out)) {
+            fail(&b, it, "output would overwrite the input");
+        } else if ((uint64_t) st.st_size <= SSBATCH_STREAM) {
+            it->size = (size_t) st.st_size;
+            submit(&b, it);
+        } else {
+            it->size = (size_t) st.st_size;     // streamed below
+            continue;
+        }
+        collect(&b, false);
+    }
+    while (b.pending > 0) {
+        collect(&b, true);
+    }
+    ss_pool_destroy(b.pool);
+
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].out && items[i].size > SSBATCH_STREAM) {
+            stream_file(&b, &items[i]);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (o->verbose) {
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        fprintf(stderr, "Batch: %zu files, %zu failed, %llu bytes in %.3f s\n",
+                count, b.failed, (unsigned long long) b.bytes, secs);
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(items[i].out);
+    }
+    free(items);
+    return b.failed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gmp.h>
+
+#include "ssio.h"
+
+//
+// Batch mode: many files through one key load and one work-stealing pool.
+//
+// Files are read whole and submitted as sspool buffer jobs. Files of up to
+// SSBATCH_WHOLE bytes run as a single task; larger ones are split into one
+// task per block so they spread over every worker. At most SSBATCH_WINDOW
+// input bytes are in flight at once. Files above SSBATCH_STREAM bytes are
+// not loaded; they are streamed through ssio once the pool has drained.
+//
+// Every file succeeds or fails on its own: failures are reported to stderr
+// as "<prog> - <path>: <reason>" and the batch carries on.
+//
+
+#define SSBATCH_WHOLE  (64 * 1024)
+#define SSBATCH_WINDOW (64 * 1024 * 1024)
+#define SSBATCH_STREAM (256 * 1024 * 1024)
+
+typedef struct {
+    const char *prog;           // prefix of error messages
+    bool decrypt;
+    mpz_srcptr n;               // public key, to encrypt
+    mpz_srcptr d, pq;           // private key, to decrypt
+    const char *outdir;         // outputs are <outdir>/<input file name>
+    ssio_opts opts;             // layout (encrypt) and threads
+    bool verbose;               // per-file lines and a summary on stderr
+} ssbatch_opts;
+
+//
+// Collect input paths
+//
+// Provides:
+//  *count paths; release them with ssbatch_free
+//
+// Requires:
+//  source: a directory (its regular files, sorted by name) or a list file
+//          (one path per line; blank lines and #-comments are skipped)
+//
+// Returns NULL if source cannot be read
+//
+char **ssbatch_collect(const char *source, size_t *count);
+
+void ssbatch_free(char **paths, size_t count);
+
+//
+// Encrypt or decrypt every file
+//
+// Returns the number of files that failed
+//
+size_t ssbatch_run(char **paths, size_t count, const ssbatch_opts *o);
@@ -0,0 +1,121 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sscache.h"
+
+typedef struct {
+    uint64_t hash;
+    uint8_t *data;          // key bytes, then value bytes; NULL if empty
+    size_t klen;
+    size_t vlen;
+} sscache_slot;
+
+struct sscache {
+    pthread_mutex_t lock;
+    sscache_slot *slots;
+    size_t count;
+    sscache_stats stats;
+};
+
+// 64-bit words through a multiply-xorshift mix; the tail byte by byte
+static uint64_t hash_bytes(const uint8_t *p, size_t len) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * 0x94D049BB133111EBULL;
+    }
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 32);
+}
+
+sscache *sscache_create(size_t slots) {
+    if (slots == 0) {
+        return NULL;
+    }
+    sscache *c = (sscache *) calloc(1, sizeof(sscache));
+    if (!c) {
+        return NULL;
+    }
+    c->slots = (sscache_slot *) calloc(slots, sizeof(sscache_slot));
+    if (!c->slots) {
+        free(c);
+        return NULL;
+    }
+    c->count = slots;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void sscache_destroy(sscache *c) {
+    if (!c) {
+        return;
+    }
+    for (size_t i = 0; i < c->count; i++) {
+        free(c->slots[i].data);
+    }
+    free(c->slots);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+bool sscache_get(sscache *c, const void *key, size_t klen, void *val, size_t *vlen, size_t cap) {
+    uint64_t h = hash_bytes((const uint8_t *) key, klen);
+    sscache_slot *s = &c->slots[h % c->count];
+    pthread_mutex_lock(&c->lock);
+    c->stats.lookups++;
+    bool hit = s->data && s->hash == h && s->klen == klen && s->vlen <= cap
+        && memcmp(s->data, key, klen) == 0;
+    if (hit) {
+        memcpy(val, s->data + klen, s->vlen);
+        *vlen = s->vlen;
+        c->stats.hits++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return hit;
+}
+
+void sscache_put(sscache *c, const void *key, size_t klen, const void *val, size_t vlen) {
+    uint64_t h = hash_bytes((const uint8_t *) key, klen);
+    uint8_t *data = (uint8_t *) malloc(klen + vlen ? klen + vlen : 1);
+    if (!data) {
+        return;             // a cache may always forget
+    }
+    memcpy(data, key, klen);
+    memcpy(data + klen, val, vlen);
+
+    sscache_slot *s = &c->slots[h % c->count];
+    pthread_mutex_lock(&c->lock);
+    uint8_t *old = s->data;
+    if (old && !(s->hash == h && s->klen == klen && memcmp(old, key, klen) == 0)) {
+        c->stats.evictions++;
+    }
+    s->hash = h;
+    s->data = data;
+    s->klen = klen;
+    s->vlen = vlen;
+    c->stats.inserts++;
+    pthread_mutex_unlock(&c->lock);
+    free(old);
+}
+
+sscache_stats sscache_get_stats(sscache *c) {
+    pthread_mutex_lock(&c->lock);
+    sscache_stats st = c->stats;
+    pthread_mutex_unlock(&c->lock);
+    return st;
+}
+
+void sscache_print_stats(sscache *c, FILE *f) {
+    sscache_stats st = sscache_get_stats(c);
+    fprintf(f, "Block cache: %llu hits of %llu lookups (%.1f%%), %llu evictions, %zu slots\n",
+            (unsigned long long) st.hits, (unsigned long long) st.lookups,
+            st.lookups ? 100.0 * (double) st.hits / (double) st.lookups : 0.0,
+            (unsigned long long) st.evictions, c->count);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Block cache: results of earlier block operations, looked up by content.
+//
+// SS encryption is deterministic, so an input block that was seen before
+// has the ciphertext computed before (and a repeated ciphertext line the
+// same plaintext). Sparse files and zero-filled disk images repeat the
+// same few blocks over and over; the cache turns those repeats into a
+// hash, a compare and a copy instead of a modular exponentiation.
+//
+// The cache is direct-mapped: a key hashes to exactly one slot, and a new
+// entry replaces whatever that slot held. Memory is bounded by the slot
+// count times the key and value sizes. A hit needs the whole key to
+// compare equal, never just its hash.
+//
+// One cache holds the results of one key in one direction; it must not be
+// shared between keys or between encryption and decryption. Lookups and
+// inserts may come from any number of threads.
+//
+
+typedef struct sscache sscache;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t evictions;         // inserts that replaced another entry
+} sscache_stats;
+
+//
+// Create an empty cache of slots entries
+//
+// Returns NULL if slots is 0 or memory is short
+//
+sscache *sscache_create(size_t slots);
+
+void sscache_destroy(sscache *c);
+
+//
+// Look up the value stored for key
+//
+// Provides:
+//  val, *vlen: a copy of the value, if it fits in cap bytes
+//
+// Returns false on a miss
+//
+bool sscache_get(sscache *c, const void *key, size_t klen, void *val, size_t *vlen, size_t cap);
+
+//
+// Store a value for key, replacing the slot's previous entry
+//
+void sscache_put(sscache *c, const void *key, size_t klen, const void *val, size_t vlen);
+
+sscache_stats sscache_get_stats(sscache *c);
+
+//
+// Print "Block cache: <hits> hits of <lookups> lookups (<rate>%), ..." to f
+//
+void sscache_print_stats(sscache *c, FILE *f);
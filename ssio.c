@@ -0,0 +1,1270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include "ssio.h"
+#include "ss.h"
+#include "sha256.h"
+#include "lz.h"
+#include "parallel.h"
+#include "trace.h"
+
+#define SSIO_INDEX_LINE_LEN 24  // strlen("#index xxxxxxxxxxxxxxxx\n")
+
+bool ssio_writer_init(ssio_writer *w, FILE *out, uint64_t k, uint32_t flags) {
+    memset(w, 0, sizeof(*w));
+    w->out = out;
+    w->flags = flags;
+    w->k = k;
+
+    if (flags & SSIO_INDEXED) {
+        w->spool = tmpfile();   // keeps the index out of memory for huge inputs
+        if (!w->spool) {
+            return false;
+        }
+        w->cipher_off += fprintf(out, "#ssx1 flags=%08" PRIx32 " k=%016" PRIx64 "\n", flags, k);
+    }
+    return true;
+}
+
+void ssio_writer_put(ssio_writer *w, const mpz_t c, size_t plain_len) {
+    if (w->spool) {
+        fprintf(w->spool, "%016" PRIx64 " %016" PRIx64 " %08" PRIx32 "\n",
+                w->plain_off, w->cipher_off, (uint32_t) plain_len);
+    }
+    w->cipher_off += gmp_fprintf(w->out, "%Zx\n", c);   // same line format as ss_encrypt_file
+    w->plain_off += plain_len;
+    w->count++;
+}
+
+void ssio_writer_finish(ssio_writer *w) {
+    if (w->spool) {
+        // index section starts right behind the last block
+        uint64_t index_off = w->cipher_off;
+        fprintf(w->out, "#index %016" PRIx64 "\n", w->count);
+
+        // copy spooled entries
+        char buf[4096];
+        size_t got;
+        rewind(w->spool);
+        while ((got = fread(buf, 1, sizeof(buf), w->spool)) > 0) {
+            fwrite(buf, 1, got, w->out);
+        }
+        fclose(w->spool);
+        w->spool = NULL;
+
+        fprintf(w->out, "#end %016" PRIx64 " %016" PRIx64 "\n", index_off, w->plain_off);
+    }
+    fflush(w->out);
+}
+
+// parse a "#sss1" shard header line
+static bool shard_header(const char *hdr, ssio_shard *s) {
+    unsigned long long k, off, len, total;
+    if (sscanf(hdr, "#sss1 %8" SCNx32 " %8" SCNx32 " flags=%8" SCNx32 " k=%16llx off=%16llx len=%16llx total=%16llx",
+               &s->index, &s->count, &s->flags, &k, &off, &len, &total) != 7) {
+        return false;
+    }
+    s->k = (uint64_t) k;
+    s->off = (uint64_t) off;
+    s->len = (uint64_t) len;
+    s->total = (uint64_t) total;
+    return true;
+}
+
+bool ssio_reader_open(ssio_reader *r, FILE *in) {
+    memset(r, 0, sizeof(*r));
+    r->in = in;
+
+    // peek; hex lines never start with '#'
+    int ch = getc(in);
+    if (ch == EOF) {
+        return true;
+    }
+    ungetc(ch, in);
+    if (ch != '#') {
+        return true;
+    }
+
+    char hdr[SSIO_SHARD_HEADER_LEN + 1];
+    unsigned long long k;
+    if (!fgets(hdr, sizeof(hdr), in)) {
+        return false;
+    }
+    ssio_shard s;
+    if (shard_header(hdr, &s)) {
+        r->k = s.k;
+        r->shard = true;
+        r->plain_total = s.len;
+        return true;
+    }
+    if (sscanf(hdr, "#ssx1 flags=%8" SCNx32 " k=%16llx", &r->flags, &k) != 2) {
+        return false;
+    }
+    r->k = (uint64_t) k;
+    r->indexed = true;
+    return true;
+}
+
+bool ssio_reader_next(ssio_reader *r, mpz_t c) {
+    ssize_t got;
+    if (r->at_index || r->bad) {
+        return false;
+    }
+    while ((got = getline(&r->line, &r->line_cap, r->in)) > 0) {
+        if (r->line[0] == '#') {
+            // index section reached; anything else starting with '#' is not a block
+            unsigned long long count;
+            r->at_index = r->indexed && sscanf(r->line, "#index %16llx", &count) == 1;
+            r->bad = !r->at_index;
+            r->count = r->at_index ? (uint64_t) count : r->count;
+            return false;
+        }
+        while (got > 0 && (r->line[got - 1] == '\n' || r->line[got - 1] == '\r')) {
+            r->line[--got] = '\0';
+        }
+        if (got == 0) {
+            continue;           // tolerate blank lines
+        }
+        if (mpz_set_str(c, r->line, 16) != 0) {
+            r->bad = true;
+            return false;
+        }
+        r->lines++;
+        return true;
+    }
+    return false;
+}
+
+bool ssio_reader_complete(const ssio_reader *r) {
+    return !r->bad && !ferror(r->in) && (!r->indexed || (r->at_index && r->lines == r->count));
+}
+
+bool ssio_reader_load_index(ssio_reader *r) {
+    if (!r->indexed || fseek(r->in, -SSIO_FOOTER_LEN, SEEK_END) != 0) {
+        return false;
+    }
+
+    // footer: index offset and payload size
+    char buf[SSIO_FOOTER_LEN + 1];
+    unsigned long long index_off, plain_total, count;
+    if (!fgets(buf, sizeof(buf), r->in)
+        || sscanf(buf, "#end %16llx %16llx", &index_off, &plain_total) != 2) {
+        return false;
+    }
+
+    // index header: block count
+    if (fseek(r->in, (long) index_off, SEEK_SET) != 0 || !fgets(buf, sizeof(buf), r->in)
+        || sscanf(buf, "#index %16llx", &count) != 1) {
+        return false;
+    }
+    r->index_off = (uint64_t) index_off;
+    r->plain_total = (uint64_t) plain_total;
+    r->count = (uint64_t) count;
+    return true;
+}
+
+bool ssio_reader_entry(ssio_reader *r, uint64_t i, ssio_entry *e) {
+    char buf[SSIO_ENTRY_LEN + 1];
+    unsigned long long plain_off, cipher_off;
+    if (i >= r->count
+        || fseek(r->in, (long) (r->index_off + SSIO_INDEX_LINE_LEN + i * SSIO_ENTRY_LEN), SEEK_SET) != 0
+        || !fgets(buf, sizeof(buf), r->in)
+        || sscanf(buf, "%16llx %16llx %8" SCNx32, &plain_off, &cipher_off, &e->plain_len) != 3) {
+        return false;
+    }
+    e->plain_off = (uint64_t) plain_off;
+    e->cipher_off = (uint64_t) cipher_off;
+    return true;
+}
+
+void ssio_reader_close(ssio_reader *r) {
+    free(r->line);
+    r->line = NULL;
+    r->line_cap = 0;
+}
+
+#define SSIO_CHUNK (4 * LZ_FRAME_MAX)    // default input bytes read per batch
+
+// input bytes per batch: whole lz frames, so the batch size never shows in the output
+static size_t batch_bytes(const ssio_opts *opts) {
+    size_t bytes = (opts && opts->batch) ? opts->batch : SSIO_CHUNK;
+    bytes = (bytes + LZ_FRAME_MAX - 1) / LZ_FRAME_MAX * LZ_FRAME_MAX;
+    return bytes;
+}
+
+// whether every block of an indexed stream but the last carries k - 1 bytes;
+// leaves r at the first block line
+static bool full_blocks(ssio_reader *r) {
+    ssio_entry last;
+    return ssio_reader_load_index(r)
+        && (r->count == 0 || (ssio_reader_entry(r, r->count - 1, &last)
+                              && last.plain_off == (r->count - 1) * (r->k - 1)))
+        && fseeko(r->in, SSIO_HEADER_LEN, SEEK_SET) == 0;
+}
+
+// incremental state of a single-recipient run (ssio_encrypt_delta)
+typedef struct {
+    FILE *manifest;         // fingerprints to write, or NULL
+    ssio_reader base;       // previous ciphertext
+    FILE *base_manifest;    // its fingerprints; NULL once exhausted, or without a base
+    uint8_t *digest;        // per batch slot: fingerprint of this run's block
+    uint8_t *old;           // per batch slot: fingerprint of the base block
+    bool *reuse;            // per batch slot: base block at hand; after the pass, reused
+    bool failed;            // base and its manifest disagree
+    uint64_t reused;
+} ssio_delta;
+
+// cuts one recipient's payload stream into k - 1 byte blocks
+typedef struct {
+    ssio_writer w;
+    mpz_srcptr n;
+    const ss_crt_key *crt;  // owner's key for n, or NULL
+    sscache *cache;         // earlier blocks of n, or NULL
+    ssio_delta *delta;      // previous run to copy unchanged blocks from, or NULL
+    uint8_t *buf;           // pending payload
+    size_t fill;
+    mpz_t *c;               // ciphertexts of the current batch
+    size_t ready;           // blocks in the current batch
+} ssio_blocker;
+
+typedef struct {
+    ssio_blocker *b;
+    size_t count;
+    size_t *first;          // first task index per recipient (prefix sums)
+} ssio_batch;
+
+// encrypt one block, reusing the ciphertext of an identical earlier block
+static void encrypt_block(ssio_blocker *b, mpz_t c, const uint8_t *buf, size_t len) {
+    size_t cap = mpz_size(b->n) * sizeof(mp_limb_t), got;
+    if (b->cache) {
+        mp_limb_t *limbs = mpz_limbs_write(c, (mp_size_t) mpz_size(b->n));
+        bool hit = sscache_get(b->cache, buf, len, limbs, &got, cap);
+        mpz_limbs_finish(c, hit ? (mp_size_t) (got / sizeof(mp_limb_t)) : 0);
+        if (hit) {
+            return;
+        }
+    }
+    if (b->crt) {
+        ss_encrypt_bytes_crt(c, buf, len, b->crt);
+    } else {
+        ss_encrypt_bytes(c, buf, len, b->n);
+    }
+    if (b->cache) {
+        sscache_put(b->cache, buf, len, mpz_limbs_read(c), mpz_size(c) * sizeof(mp_limb_t));
+    }
+}
+
+static void encrypt_task(size_t t, unsigned tid, void *ctx) {
+    (void) tid;
+    ssio_batch *batch = (ssio_batch *) ctx;
+
+    // binary search for the recipient owning task t
+    size_t lo = 0, hi = batch->count - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (batch->first[mid] <= t) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    ssio_blocker *b = &batch->b[lo];
+    size_t i = t - batch->first[lo];
+    size_t room = b->w.k - 1;
+    size_t len = b->fill - i * room < room ? b->fill - i * room : room;
+    const uint8_t *buf = b->buf + i * room;
+    ssio_delta *dl = b->delta;
+    if (dl) {
+        // unchanged since the base run: its ciphertext is in c[i] already
+        uint8_t full[SHA256_LEN];
+        sha256(buf, len, full);
+        memcpy(dl->digest + i * SSIO_DIGEST_LEN, full, SSIO_DIGEST_LEN);
+        dl->reuse[i] = dl->reuse[i] && memcmp(full, dl->old + i * SSIO_DIGEST_LEN, SSIO_DIGEST_LEN) == 0;
+        if (dl->reuse[i]) {
+            return;
+        }
+    }
+    uint64_t tr = trace_begin();
+    encrypt_block(b, b->c[i], buf, len);
+    trace_end("encrypt block", "ssio", tr);
+}
+
+// parse one manifest line
+static bool read_digest(FILE *f, uint8_t *digest) {
+    char line[2 * SSIO_DIGEST_LEN + 4];
+    if (!fgets(line, sizeof(line), f) || strlen(line) != 2 * SSIO_DIGEST_LEN + 1) {
+        return false;
+    }
+    for (size_t j = 0; j < SSIO_DIGEST_LEN; j++) {
+        unsigned v;
+        if (sscanf(line + 2 * j, "%2x", &v) != 1) {
+            return false;
+        }
+        digest[j] = (uint8_t) v;
+    }
+    return true;
+}
+
+// line up the next ready base blocks, and their fingerprints, with this batch
+static void delta_fetch(ssio_delta *dl, mpz_t *c, size_t ready) {
+    for (size_t i = 0; i < ready; i++) {
+        dl->reuse[i] = false;
+        if (!dl->base_manifest) {
+            continue;
+        }
+        if (feof(dl->base_manifest) || !read_digest(dl->base_manifest, dl->old + i * SSIO_DIGEST_LEN)) {
+            // the manifest is used up; so must the base be
+            dl->failed = dl->failed || !feof(dl->base_manifest) || ssio_reader_next(&dl->base, c[i])
+                || dl->base.bad;
+            dl->base_manifest = NULL;
+        } else if (!ssio_reader_next(&dl->base, c[i])) {
+            dl->failed = true;
+            dl->base_manifest = NULL;
+        } else {
+            dl->reuse[i] = true;
+        }
+    }
+}
+
+// record block i of the batch in the new manifest
+static void delta_note(ssio_delta *dl, size_t i) {
+    dl->reused += dl->reuse[i];
+    if (dl->manifest) {
+        for (size_t j = 0; j < SSIO_DIGEST_LEN; j++) {
+            fprintf(dl->manifest, "%02x", dl->digest[i * SSIO_DIGEST_LEN + j]);
+        }
+        fputc('\n', dl->manifest);
+    }
+}
+
+// encrypt every complete block of every recipient in one parallel pass, then
+// write them in order; with last set the trailing partial blocks go too
+static void encrypt_batch(ssio_batch *batch, unsigned threads, bool last) {
+    size_t tasks = 0;
+    for (size_t r = 0; r < batch->count; r++) {
+        ssio_blocker *b = &batch->b[r];
+        size_t room = b->w.k - 1;
+        b->ready = last ? (b->fill + room - 1) / room : b->fill / room;
+        batch->first[r] = tasks;
+        tasks += b->ready;
+    }
+
+    for (size_t r = 0; r < batch->count; r++) {
+        if (batch->b[r].delta) {
+            delta_fetch(batch->b[r].delta, batch->b[r].c, batch->b[r].ready);
+        }
+    }
+
+    uint64_t tr = trace_begin();
+    parallel_for(tasks, threads, encrypt_task, batch);
+    trace_end_arg("encrypt batch", "ssio", tr, "blocks", tasks);
+
+    tr = trace_begin();
+    for (size_t r = 0; r < batch->count; r++) {
+        ssio_blocker *b = &batch->b[r];
+        size_t room = b->w.k - 1;
+        size_t used = 0;
+        for (size_t i = 0; i < b->ready; i++) {
+            size_t len = b->fill - used < room ? b->fill - used : room;
+            ssio_writer_put(&b->w, b->c[i], len);
+            used += len;
+            if (b->delta) {
+                delta_note(b->delta, i);
+            }
+        }
+        memmove(b->buf, b->buf + used, b->fill - used);
+        b->fill -= used;
+    }
+    trace_end("write", "io", tr);
+}
+
+// one blocker per recipient; each holds up to payload_cap pending bytes.
+// resume (one recipient only) continues a writer instead of starting one
+static bool batch_open(ssio_batch *batch, FILE **outfiles, mpz_t *ns, size_t count,
+                       uint32_t flags, size_t payload_cap, const ssio_writer *resume) {
+    batch->b = (ssio_blocker *) calloc(count, sizeof(ssio_blocker));
+    batch->first = (size_t *) malloc(count * sizeof(size_t));
+    batch->count = 0;
+    for (; batch->count < count; batch->count++) {
+        ssio_blocker *b = &batch->b[batch->count];
+        uint64_t k = ss_block_size(ns[batch->count]);
+        if (resume) {
+            b->w = *resume;
+        } else if (k < 2 || !ssio_writer_init(&b->w, outfiles[batch->count], k, flags)) {
+            return false;       // key too small to carry any payload, or no spool
+        }
+        b->n = ns[batch->count];
+        b->buf = (uint8_t *) malloc(payload_cap + k - 1);
+        size_t slots = (payload_cap + k - 1) / (k - 1) + 1;
+        b->c = (mpz_t *) malloc(slots * sizeof(mpz_t));
+        for (size_t i = 0; i < slots; i++) {
+            mpz_init(b->c[i]);
+        }
+    }
+    return true;
+}
+
+// finish every writer that was opened; false if any output failed
+static bool batch_close(ssio_batch *batch, size_t payload_cap) {
+    bool ok = true;
+    for (size_t r = 0; r < batch->count; r++) {
+        ssio_blocker *b = &batch->b[r];
+        ssio_writer_finish(&b->w);
+        ok = ok && !ferror(b->w.out);
+        size_t slots = (payload_cap + b->w.k - 1) / (b->w.k - 1) + 1;
+        for (size_t i = 0; i < slots; i++) {
+            mpz_clear(b->c[i]);
+        }
+        free(b->c);
+        free(b->buf);
+    }
+    free(batch->b);
+    free(batch->first);
+    return ok;
+}
+
+// hand the owner's CRT key and the block cache to the recipients they serve
+static void batch_keys(ssio_batch *batch, const ssio_opts *opts) {
+    for (size_t r = 0; opts && opts->crt && r < batch->count; r++) {
+        if (mpz_cmp(batch->b[r].n, opts->crt->n) == 0) {
+            batch->b[r].crt = opts->crt;
+        }
+    }
+    if (opts && batch->count == 1) {
+        batch->b[0].cache = opts->cache;
+    }
+}
+
+bool ssio_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts) {
+    mpz_t ns[1];
+    mpz_init_set(ns[0], n);
+    bool ok = ssio_encrypt_multi(infile, &outfile, ns, 1, opts);
+    mpz_clear(ns[0]);
+    return ok;
+}
+
+// encrypt at most limit input bytes for every recipient, in the given layout
+static bool encrypt_stream(FILE *infile, FILE **outfiles, mpz_t *ns, size_t count,
+                           const ssio_opts *opts, uint32_t flags, uint64_t limit,
+                           const ssio_writer *resume, ssio_delta *delta) {
+    unsigned threads = opts ? opts->threads : 1;
+
+    // the payload of one input chunk: raw, or one lz frame per LZ_FRAME_MAX bytes
+    size_t chunk_len = batch_bytes(opts);
+    size_t payload_cap = (flags & SSIO_COMPRESSED)
+        ? (chunk_len / LZ_FRAME_MAX) * (LZ_FRAME_HEADER + lz_bound(LZ_FRAME_MAX)) : chunk_len;
+    uint8_t *chunk = (uint8_t *) malloc(chunk_len);
+    uint8_t *payload = (flags & SSIO_COMPRESSED) ? (uint8_t *) malloc(payload_cap) : chunk;
+    ssio_batch batch;
+    bool ok = batch_open(&batch, outfiles, ns, count, flags, payload_cap, resume);
+    if (ok) {
+        batch_keys(&batch, opts);
+    }
+    if (ok && delta) {
+        uint64_t k = batch.b[0].w.k;
+        size_t slots = (payload_cap + k - 1) / (k - 1) + 1;     // as many as batch_open
+        delta->digest = (uint8_t *) malloc(slots * SSIO_DIGEST_LEN);
+        delta->old = (uint8_t *) malloc(slots * SSIO_DIGEST_LEN);
+        delta->reuse = (bool *) calloc(slots, sizeof(bool));
+        batch.b[0].delta = delta;
+    }
+
+    // read the input once; every recipient blocks the same payload
+    // (every block but the last carries k - 1 bytes, as with ss_encrypt_file)
+    size_t read;
+    uint64_t tr = trace_begin();
+    while (ok && limit > 0
+           && (read = fread(chunk, 1, limit < chunk_len ? (size_t) limit : chunk_len, infile)) > 0) {
+        trace_end_arg("read", "io", tr, "bytes", read);
+        limit -= read;
+        size_t len = read;
+        if (flags & SSIO_COMPRESSED) {
+            tr = trace_begin();
+            len = 0;
+            for (size_t off = 0; off < read; off += LZ_FRAME_MAX) {
+                size_t part = read - off < LZ_FRAME_MAX ? read - off : LZ_FRAME_MAX;
+                len += lz_frame(chunk + off, part, payload + len);
+            }
+            trace_end_arg("compress", "ssio", tr, "bytes", len);
+        }
+        for (size_t r = 0; r < count; r++) {
+            memcpy(batch.b[r].buf + batch.b[r].fill, payload, len);
+            batch.b[r].fill += len;
+        }
+        encrypt_batch(&batch, threads, false);
+        tr = trace_begin();
+    }
+    if (ok) {
+        encrypt_batch(&batch, threads, true);
+    }
+
+    // clean up
+    ok = batch_close(&batch, payload_cap) && ok;
+    if (payload != chunk) {
+        free(payload);
+    }
+    free(chunk);
+    return ok && !ferror(infile);
+}
+
+bool ssio_encrypt_multi(FILE *infile, FILE **outfiles, mpz_t *ns, size_t count, const ssio_opts *opts) {
+    uint32_t flags = opts ? opts->flags : 0;
+    if (flags & SSIO_COMPRESSED) {
+        flags |= SSIO_INDEXED;  // only the container header can record it
+    }
+    if (count == 0) {
+        return false;
+    }
+    return encrypt_stream(infile, outfiles, ns, count, opts, flags, UINT64_MAX, NULL, NULL);
+}
+
+#define LIVE_ERROR    (-1)
+#define LIVE_DEADLINE (-2)
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+// read whatever fd has; with data held since since, wait no longer than its
+// flush deadline. Returns the bytes read, 0 at end of input, LIVE_ERROR, or
+// LIVE_DEADLINE when the deadline passed first
+static ssize_t live_read(int fd, void *buf, size_t cap, bool held, uint64_t since, unsigned flush_ms) {
+    for (;;) {
+        int timeout = -1;
+        if (held) {
+            uint64_t waited = now_ms() - since;
+            if (waited >= flush_ms) {
+                return LIVE_DEADLINE;   // also under steady input
+            }
+            timeout = (int) (flush_ms - waited);
+        }
+        struct pollfd p = { .fd = fd, .events = POLLIN };
+        int ready = poll(&p, 1, timeout);
+        if (ready == 0) {
+            return LIVE_DEADLINE;
+        }
+        ssize_t got = ready < 0 ? -1 : read(fd, buf, cap);
+        if (got >= 0) {
+            return got;
+        }
+        if (errno != EINTR) {
+            return LIVE_ERROR;
+        }
+    }
+}
+
+bool ssio_encrypt_live(FILE *infile, FILE **outfiles, mpz_t *ns, size_t count, const ssio_opts *opts,
+                       unsigned flush_ms) {
+    uint32_t flags = opts ? opts->flags : 0;
+    if (count == 0 || (flags & SSIO_COMPRESSED)) {
+        return false;           // an lz frame cannot be written before its input ends
+    }
+    flags |= SSIO_INDEXED;      // short blocks are only locatable through the index
+    unsigned threads = opts ? opts->threads : 1;
+    size_t cap = batch_bytes(opts);
+    uint8_t *chunk = (uint8_t *) malloc(cap);
+    ssio_batch batch;
+    bool ok = batch_open(&batch, outfiles, ns, count, flags, cap, NULL);
+    if (ok) {
+        batch_keys(&batch, opts);
+    }
+
+    // whole blocks are written as soon as they fill up; at the deadline the
+    // rest goes out as a short block and every output is flushed
+    int fd = fileno(infile);
+    bool held = false;          // input read but not yet flushed out
+    uint64_t since = 0;         // when the oldest such byte arrived
+    ssize_t got;
+    while (ok && (got = live_read(fd, chunk, cap, held, since, flush_ms)) != 0) {
+        if (got == LIVE_ERROR) {
+            ok = false;
+            break;
+        }
+        if (got == LIVE_DEADLINE) {
+            encrypt_batch(&batch, threads, true);
+            for (size_t r = 0; r < count; r++) {
+                ok = fflush(batch.b[r].w.out) == 0 && ok;
+            }
+            held = false;
+            continue;
+        }
+        if (!held) {
+            held = true;
+            since = now_ms();
+        }
+        for (size_t r = 0; r < count; r++) {
+            memcpy(batch.b[r].buf + batch.b[r].fill, chunk, (size_t) got);
+            batch.b[r].fill += (size_t) got;
+        }
+        encrypt_batch(&batch, threads, false);
+    }
+    if (ok) {
+        encrypt_batch(&batch, threads, true);
+    }
+
+    // clean up
+    ok = batch_close(&batch, cap) && ok;
+    free(chunk);
+    return ok;
+}
+
+// legacy layout: the starts of the last two lines and the number of lines
+static bool scan_lines(FILE *f, uint64_t *kept_start, uint64_t *last_start, uint64_t *lines) {
+    char buf[65536];
+    uint64_t off = 0, prev2 = 0, prev = 0, cur = 0;
+    size_t got;
+    char tail = '\n';
+    *lines = 0;
+    rewind(f);
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (char *nl = buf; (nl = memchr(nl, '\n', buf + got - nl)) != NULL; nl++) {
+            prev2 = prev;
+            prev = cur;
+            cur = off + (uint64_t) (nl - buf) + 1;      // start of the next line
+            (*lines)++;
+        }
+        tail = buf[got - 1];
+        off += got;
+    }
+    *kept_start = prev2;
+    *last_start = prev;
+    return !ferror(f) && tail == '\n';     // a torn last line means a crashed writer
+}
+
+// whether the block line at cipher_off encrypts infile bytes [plain_off, plain_off + len)
+// under n, for some len in [min_len, max_len]; encryption is deterministic, so
+// one block tells a wrong key or a misplaced offset apart from the ciphertext
+// infile was encrypted to
+static bool block_matches(FILE *infile, FILE *cipher, const mpz_t n, uint64_t plain_off,
+                          size_t min_len, size_t max_len, uint64_t cipher_off) {
+    uint8_t *buf = (uint8_t *) malloc(max_len ? max_len : 1);
+    char *line = NULL;
+    size_t cap = 0, have = 0;
+    ssize_t got = 0;
+    mpz_t c, want;
+    mpz_inits(c, want, NULL);
+    bool ok = fseeko(infile, (off_t) plain_off, SEEK_SET) == 0
+        && (have = fread(buf, 1, max_len, infile)) >= min_len
+        && fseeko(cipher, (off_t) cipher_off, SEEK_SET) == 0 && (got = getline(&line, &cap, cipher)) > 1;
+    if (ok) {
+        line[got - 1] = '\0';
+        ok = mpz_set_str(c, line, 16) == 0;
+    }
+    bool found = false;
+    for (size_t len = min_len; ok && !found && len <= have; len++) {
+        ss_encrypt_bytes(want, buf, len, n);
+        found = mpz_cmp(c, want) == 0;
+    }
+    mpz_clears(c, want, NULL);
+    free(line);
+    free(buf);
+    return found;
+}
+
+bool ssio_encrypt_append(FILE *infile, FILE *cipher, const mpz_t n, const ssio_opts *opts) {
+    uint64_t k = ss_block_size(n);
+    ssio_reader r;
+    if (k < 2 || fseeko(cipher, 0, SEEK_END) != 0) {
+        return false;
+    }
+    mpz_t ns[1];
+    mpz_init_set(ns[0], n);
+
+    // nothing to keep: a plain encryption
+    if (ftello(cipher) == 0) {
+        mpz_clear(ns[0]);
+        return fseeko(infile, 0, SEEK_SET) == 0 && ssio_encrypt_file(infile, cipher, n, opts);
+    }
+
+    // keep every block but the last, which may be partial; it is redone with the new data
+    ssio_writer w;
+    memset(&w, 0, sizeof(w));
+    w.out = cipher;
+    w.k = k;
+    rewind(cipher);
+    bool ok = ssio_reader_open(&r, cipher) && !r.shard && !(r.flags & SSIO_COMPRESSED);
+    uint64_t cut = 0, covered = 0;     // plaintext bytes the old ciphertext is known to hold
+    ssio_entry check = { 0 };           // a block checked against infile, if any
+    size_t check_min = 0;               // bytes it carries at least
+    if (ok && r.indexed) {
+        // the kept index entries move into a spool; the index is rewritten behind the new blocks
+        ssio_entry last = { .plain_off = 0, .cipher_off = SSIO_HEADER_LEN, .plain_len = 0 };
+        ok = r.k == k && ssio_reader_load_index(&r) && (r.count == 0 || ssio_reader_entry(&r, r.count - 1, &last));
+        if (r.count > 0) {
+            check = last;               // the index knows its length
+            check_min = last.plain_len;
+        }
+        w.flags = r.flags;
+        w.spool = ok ? tmpfile() : NULL;
+        ok = ok && w.spool && fseeko(cipher, (off_t) (r.index_off + SSIO_INDEX_LINE_LEN), SEEK_SET) == 0;
+        uint64_t left = r.count ? (r.count - 1) * SSIO_ENTRY_LEN : 0;
+        char buf[4096];
+        while (ok && left > 0) {
+            size_t part = left < sizeof(buf) ? (size_t) left : sizeof(buf);
+            ok = fread(buf, 1, part, cipher) == part && fwrite(buf, 1, part, w.spool) == part;
+            left -= part;
+        }
+        w.count = r.count ? r.count - 1 : 0;
+        w.plain_off = last.plain_off;
+        w.cipher_off = cut = last.cipher_off;
+        covered = r.plain_total;
+    } else if (ok) {
+        // no index: every block but the last is taken to be full, as ss_encrypt_file
+        // writes them; the check below refuses a ciphertext that is not
+        uint64_t lines;
+        ok = scan_lines(cipher, &check.cipher_off, &cut, &lines);
+        w.count = lines ? lines - 1 : 0;
+        w.plain_off = w.count * (k - 1);
+        w.cipher_off = cut;
+        covered = w.plain_off;
+        if (w.count > 0) {
+            // the last kept block, which is full
+            check.plain_off = w.plain_off - (k - 1);
+            check.plain_len = (uint32_t) (k - 1);
+            check_min = k - 1;
+        } else if (lines > 0) {
+            // a lone block of unknown length: one of at most k - 1 prefixes
+            check.cipher_off = cut;
+            check.plain_len = (uint32_t) (k - 1);
+            check_min = 1;
+        }
+    }
+    ssio_reader_close(&r);
+    ok = ok && (check.plain_len == 0
+                || block_matches(infile, cipher, n, check.plain_off, check_min, check.plain_len, check.cipher_off));
+
+    // a plaintext shorter than before was rotated or rewritten, not appended to
+    ok = ok && fseeko(infile, 0, SEEK_END) == 0 && ftello(infile) >= (off_t) covered
+        && fseeko(infile, (off_t) w.plain_off, SEEK_SET) == 0
+        && fflush(cipher) == 0 && ftruncate(fileno(cipher), (off_t) cut) == 0
+        && fseeko(cipher, 0, SEEK_END) == 0;
+    if (ok) {
+        ok = encrypt_stream(infile, &cipher, ns, 1, opts, w.flags, UINT64_MAX, &w, NULL);
+    } else if (w.spool) {
+        fclose(w.spool);
+    }
+    mpz_clear(ns[0]);
+    return ok;
+}
+
+bool ssio_encrypt_delta(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts,
+                        FILE *manifest, FILE *base, FILE *base_manifest, uint64_t *reused) {
+    uint64_t k = ss_block_size(n), id = ss_fingerprint(n);
+    uint32_t flags = opts ? opts->flags : 0;
+    if (k < 2 || (flags & SSIO_COMPRESSED) || !base != !base_manifest) {
+        return false;
+    }
+    ssio_delta dl;
+    memset(&dl, 0, sizeof(dl));
+    dl.manifest = manifest;
+    bool ok = true;
+
+    // the base must be a plain block sequence under the same key
+    if (base) {
+        char hdr[SSIO_MANIFEST_HEADER_LEN + 1];
+        unsigned long long base_k, base_id;
+        ok = fgets(hdr, sizeof(hdr), base_manifest)
+            && sscanf(hdr, "#ssm1 k=%16llx key=%16llx", &base_k, &base_id) == 2
+            && base_k == k && base_id == id
+            && ssio_reader_open(&dl.base, base) && !dl.base.shard
+            && (!dl.base.indexed || (dl.base.k == k && !(dl.base.flags & SSIO_COMPRESSED)
+                                     && full_blocks(&dl.base)));
+        dl.base_manifest = base_manifest;
+    }
+    if (ok && manifest) {
+        fprintf(manifest, "#ssm1 k=%016" PRIx64 " key=%016" PRIx64 "\n", k, id);
+    }
+
+    mpz_t ns[1];
+    mpz_init_set(ns[0], n);
+    if (ok) {
+        ok = encrypt_stream(infile, &outfile, ns, 1, opts, flags, UINT64_MAX, NULL, &dl);
+    }
+    ok = ok && !dl.failed && !(manifest && (fflush(manifest) != 0 || ferror(manifest)));
+    if (reused) {
+        *reused = dl.reused;
+    }
+
+    // clean up
+    mpz_clear(ns[0]);
+    ssio_reader_close(&dl.base);
+    free(dl.digest);
+    free(dl.old);
+    free(dl.reuse);
+    return ok;
+}
+
+// first block of shard index: index * blocks / count without overflowing
+static uint64_t shard_first(uint64_t blocks, uint32_t index, uint32_t count) {
+    return blocks / count * index + blocks % count * index / count;
+}
+
+bool ssio_encrypt_shard(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts,
+                        uint32_t index, uint32_t count) {
+    uint32_t flags = opts ? opts->flags : 0;
+    uint64_t k = ss_block_size(n);
+    if ((flags & SSIO_COMPRESSED) || index >= count || k < 2 || fseeko(infile, 0, SEEK_END) != 0) {
+        return false;
+    }
+    off_t end = ftello(infile);
+    if (end < 0) {
+        return false;
+    }
+
+    // near-equal runs of whole blocks; only the last shard may end in a partial block
+    ssio_shard sh = { .index = index, .count = count, .flags = flags, .k = k, .total = (uint64_t) end };
+    uint64_t room = k - 1;
+    uint64_t blocks = (sh.total + room - 1) / room;
+    uint64_t first = shard_first(blocks, index, count);
+    uint64_t last = shard_first(blocks, index + 1, count);
+    sh.off = first * room < sh.total ? first * room : sh.total;
+    sh.len = (last * room < sh.total ? last * room : sh.total) - sh.off;
+    if (fseeko(infile, (off_t) sh.off, SEEK_SET) != 0) {
+        return false;
+    }
+
+    fprintf(outfile, "#sss1 %08" PRIx32 " %08" PRIx32 " flags=%08" PRIx32 " k=%016" PRIx64
+            " off=%016" PRIx64 " len=%016" PRIx64 " total=%016" PRIx64 "\n",
+            sh.index, sh.count, sh.flags, sh.k, sh.off, sh.len, sh.total);
+    mpz_t ns[1];
+    mpz_init_set(ns[0], n);
+    bool ok = encrypt_stream(infile, &outfile, ns, 1, opts, 0, sh.len, NULL, NULL);
+    mpz_clear(ns[0]);
+    return ok;
+}
+
+bool ssio_shard_read(FILE *in, ssio_shard *s) {
+    char hdr[SSIO_SHARD_HEADER_LEN + 1];
+    return fgets(hdr, sizeof(hdr), in) && shard_header(hdr, s);
+}
+
+// read every header and order the set; false unless the slices tile the input
+static bool shards_open(FILE **shards, size_t count, ssio_shard *hdr, size_t *order) {
+    for (size_t i = 0; i < count; i++) {
+        order[i] = SIZE_MAX;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!ssio_shard_read(shards[i], &hdr[i]) || hdr[i].count != count || hdr[i].index >= count || hdr[i].k < 2
+            || order[hdr[i].index] != SIZE_MAX) {
+            return false;
+        }
+        order[hdr[i].index] = i;
+    }
+    uint64_t next = 0;
+    for (size_t j = 0; j < count; j++) {
+        const ssio_shard *s = &hdr[order[j]];
+        if (s->flags != hdr[0].flags || s->k != hdr[0].k || s->total != hdr[0].total
+            || s->off != next || s->off % (s->k - 1) != 0) {
+            return false;
+        }
+        next += s->len;
+    }
+    return count > 0 && next == hdr[0].total;
+}
+
+bool ssio_merge_shards(FILE **shards, size_t count, FILE *outfile) {
+    ssio_shard *hdr = (ssio_shard *) malloc(count * sizeof(ssio_shard));
+    size_t *order = (size_t *) malloc(count * sizeof(size_t));
+    ssio_writer w;
+    bool ok = shards_open(shards, count, hdr, order)
+        && ssio_writer_init(&w, outfile, hdr[0].k, hdr[0].flags);
+    bool opened = ok;
+
+    // re-emit every line through one writer, so the index covers the whole set
+    mpz_t c;
+    mpz_init(c);
+    for (size_t j = 0; ok && j < count; j++) {
+        ssio_reader r;
+        memset(&r, 0, sizeof(r));
+        r.in = shards[order[j]];
+        uint64_t left = hdr[order[j]].len;
+        uint64_t room = hdr[order[j]].k - 1;
+        while (ok && left > 0) {
+            size_t len = left < room ? (size_t) left : (size_t) room;
+            ok = ssio_reader_next(&r, c);
+            if (ok) {
+                ssio_writer_put(&w, c, len);
+                left -= len;
+            }
+        }
+        ok = ok && !ssio_reader_next(&r, c) && !r.bad;     // no lines beyond the slice
+        ssio_reader_close(&r);
+    }
+    if (opened) {
+        ssio_writer_finish(&w);
+    }
+
+    // clean up
+    mpz_clear(c);
+    free(hdr);
+    free(order);
+    return ok && !ferror(outfile);
+}
+
+// one batch of ciphertext lines decrypted in parallel
+typedef struct {
+    mpz_t *c;
+    uint8_t *plain;         // cap bytes per line
+    size_t *len;
+    bool *ok;
+    size_t cap;
+    mpz_srcptr d;
+    mpz_srcptr pq;
+} ssio_unblock;
+
+static void decrypt_task(size_t i, unsigned tid, void *ctx) {
+    (void) tid;
+    ssio_unblock *u = (ssio_unblock *) ctx;
+    uint64_t tr = trace_begin();
+    u->ok[i] = ss_decrypt_bytes(u->plain + i * u->cap, &u->len[i], u->cap, u->c[i], u->d, u->pq);
+    trace_end("decrypt block", "ssio", tr);
+}
+
+bool ssio_rekey_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                     const mpz_t n, const ssio_opts *opts) {
+    unsigned threads = opts ? opts->threads : 1;
+    ssio_reader r;
+    if (!ssio_reader_open(&r, infile) || r.shard) {
+        return false;           // a shard set is merged first
+    }
+
+    // lines per batch: about one batch of payload bytes in flight at a time
+    ssio_unblock u = { .cap = (mpz_sizeinbase(pq, 2) + 7) / 8, .d = d, .pq = pq };
+    size_t lines = batch_bytes(opts) / u.cap + 1;
+    u.c = (mpz_t *) malloc(lines * sizeof(mpz_t));
+    u.plain = (uint8_t *) malloc(lines * u.cap);
+    u.len = (size_t *) malloc(lines * sizeof(size_t));
+    u.ok = (bool *) malloc(lines * sizeof(bool));
+    for (size_t i = 0; i < lines; i++) {
+        mpz_init(u.c[i]);
+    }
+
+    // the payload stream is re-blocked as is: compressed frames stay compressed
+    mpz_t ns[1];
+    mpz_init_set(ns[0], n);
+    size_t payload_cap = lines * u.cap;
+    ssio_batch batch;
+    bool ok = batch_open(&batch, &outfile, ns, 1, r.flags, payload_cap, NULL);
+
+    bool more = true;
+    while (ok && more) {
+        size_t got = 0;
+        uint64_t tr = trace_begin();
+        while (got < lines && (more = ssio_reader_next(&r, u.c[got]))) {
+            got++;
+        }
+        trace_end_arg("read", "io", tr, "blocks", got);
+        tr = trace_begin();
+        parallel_for(got, threads, decrypt_task, &u);
+        trace_end_arg("decrypt batch", "ssio", tr, "blocks", got);
+
+        ssio_blocker *b = &batch.b[0];
+        for (size_t i = 0; i < got && ok; i++) {
+            if (!(ok = u.ok[i])) {
+                break;          // len is unset for a line that failed
+            }
+            memcpy(b->buf + b->fill, u.plain + i * u.cap, u.len[i]);
+            b->fill += u.len[i];
+        }
+        if (ok) {
+            encrypt_batch(&batch, threads, false);
+        }
+    }
+    // a malformed line or a missing block must not pass for the end of the input
+    ok = ok && ssio_reader_complete(&r);
+    if (ok) {
+        encrypt_batch(&batch, threads, true);
+    }
+
+    // clean up
+    ok = batch_close(&batch, payload_cap) && ok;
+    mpz_clear(ns[0]);
+    for (size_t i = 0; i < lines; i++) {
+        mpz_clear(u.c[i]);
+    }
+    free(u.c);
+    free(u.plain);
+    free(u.len);
+    free(u.ok);
+    ssio_reader_close(&r);
+    return ok && !ferror(infile);
+}
+
+// plaintext sink: writes the window [skip, skip + left) of what it is given
+typedef struct {
+    FILE *out;
+    uint64_t skip;
+    uint64_t left;
+} ssio_window;
+
+static bool window_write(const uint8_t *buf, size_t len, void *ctx) {
+    ssio_window *win = (ssio_window *) ctx;
+    if (win->skip >= len) {
+        win->skip -= len;
+        return true;
+    }
+    buf += win->skip;
+    len -= win->skip;
+    win->skip = 0;
+    if (len > win->left) {
+        len = win->left;
+    }
+    win->left -= len;
+    return fwrite(buf, 1, len, win->out) == len;
+}
+
+// decrypt one line, reusing the plaintext of an identical earlier line
+static bool decrypt_block(uint8_t *buf, size_t *len, size_t cap, const mpz_t c,
+                          const mpz_t d, const mpz_t pq, sscache *cache) {
+    const mp_limb_t *limbs = mpz_limbs_read(c);
+    size_t klen = mpz_size(c) * sizeof(mp_limb_t);
+    if (cache && sscache_get(cache, limbs, klen, buf, len, cap)) {
+        return true;
+    }
+    if (!ss_decrypt_bytes(buf, len, cap, c, d, pq)) {
+        return false;
+    }
+    if (cache) {
+        sscache_put(cache, limbs, klen, buf, *len);
+    }
+    return true;
+}
+
+// decrypt consecutive lines into the window, inflating them first if needed
+static bool decrypt_lines(ssio_reader *r, ssio_window *win, const mpz_t d, const mpz_t pq,
+                          sscache *cache) {
+    size_t cap = (mpz_sizeinbase(pq, 2) + 7) / 8;   // any block decrypts to less than pq
+    uint8_t *arr = (uint8_t *) malloc(cap);
+    mpz_t c;
+    mpz_init(c);
+    size_t len;
+    bool ok = true;
+
+    lz_decoder dec;
+    bool compressed = r->flags & SSIO_COMPRESSED;
+    if (compressed) {
+        lz_decoder_init(&dec, window_write, win);
+    }
+
+    // iterate over ciphertext lines
+    uint64_t tr = trace_begin();
+    while (win->left > 0 && ssio_reader_next(r, c)) {
+        trace_end("read", "io", tr);
+        tr = trace_begin();
+        if (!decrypt_block(arr, &len, cap, c, d, pq, cache)) {
+            ok = false;
+            break;
+        }
+        trace_end("decrypt block", "ssio", tr);
+        tr = trace_begin();
+        if (!(compressed ? lz_decoder_feed(&dec, arr, len) : window_write(arr, len, win))) {
+            ok = false;
+            break;
+        }
+        trace_end("write", "io", tr);
+        tr = trace_begin();
+    }
+    ok = ok && !r->bad;
+    if (compressed) {
+        // a finished window may legitimately stop inside a frame
+        ok = lz_decoder_finish(&dec) ? ok : (ok && win->left == 0);
+    }
+
+    // clean up
+    mpz_clear(c);
+    free(arr);
+    return ok;
+}
+
+bool ssio_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                       const ssio_opts *opts) {
+    ssio_reader r;
+    if (!ssio_reader_open(&r, infile)) {
+        return false;
+    }
+    // a lone shard decrypts to exactly the input bytes of its slice
+    ssio_window win = { .out = outfile, .skip = 0, .left = r.shard ? r.plain_total : UINT64_MAX };
+    bool ok = decrypt_lines(&r, &win, d, pq, opts ? opts->cache : NULL)
+        && (r.shard ? win.left == 0 : ssio_reader_complete(&r));
+    ssio_reader_close(&r);
+    return ok && !ferror(outfile);
+}
+
+// one line of a live stream: a block to decrypt, or the container header
+// (first line only); index lines end the blocks
+typedef struct {
+    FILE *out;
+    mpz_srcptr d, pq;
+    sscache *cache;
+    uint8_t *arr;
+    size_t cap;
+    mpz_t c;
+    uint64_t lines;
+    bool blocks_done;
+} ssio_live;
+
+static bool live_line(ssio_live *lv, char *line, size_t len) {
+    while (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    line[len] = '\0';
+    if (len == 0 || lv->blocks_done) {
+        return true;
+    }
+    if (line[0] == '#') {
+        uint32_t flags;
+        unsigned long long k;
+        if (lv->lines++ > 0) {
+            lv->blocks_done = true;
+            return true;
+        }
+        return sscanf(line, "#ssx1 flags=%8" SCNx32 " k=%16llx", &flags, &k) == 2
+            && !(flags & SSIO_COMPRESSED);
+    }
+    lv->lines++;
+    size_t len_out;
+    return mpz_set_str(lv->c, line, 16) == 0
+        && decrypt_block(lv->arr, &len_out, lv->cap, lv->c, lv->d, lv->pq, lv->cache)
+        && fwrite(lv->arr, 1, len_out, lv->out) == len_out;
+}
+
+bool ssio_decrypt_live(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                       const ssio_opts *opts, unsigned flush_ms) {
+    ssio_live lv = { .out = outfile, .d = d, .pq = pq,
+                     .cache = opts ? opts->cache : NULL };
+    lv.cap = (mpz_sizeinbase(pq, 2) + 7) / 8;
+    lv.arr = (uint8_t *) malloc(lv.cap);
+    mpz_init(lv.c);
+    size_t line_cap = 4096, have = 0;
+    char *buf = (char *) malloc(line_cap);
+
+    // decrypt every complete line as it arrives; flush by the deadline
+    int fd = fileno(infile);
+    bool ok = true, held = false;
+    uint64_t since = 0;
+    ssize_t got;
+    do {
+        if (have + 1 >= line_cap) {
+            line_cap *= 2;
+            buf = (char *) realloc(buf, line_cap);
+        }
+        got = live_read(fd, buf + have, line_cap - have - 1, held, since, flush_ms);
+        if (got == LIVE_DEADLINE) {
+            ok = fflush(outfile) == 0;
+            held = false;
+            continue;
+        }
+        if (got == LIVE_ERROR) {
+            ok = false;
+            break;
+        }
+        have += (size_t) got;
+        size_t start = 0;
+        char *nl;
+        while (ok && (nl = memchr(buf + start, '\n', have - start)) != NULL) {
+            ok = live_line(&lv, buf + start, (size_t) (nl - (buf + start)));
+            start = (size_t) (nl - buf) + 1;
+        }
+        if (ok && got == 0 && start < have) {
+            ok = live_line(&lv, buf + start, have - start);     // unterminated last line
+            start = have;
+        }
+        memmove(buf, buf + start, have - start);
+        have -= start;
+        if (!held && start > 0) {
+            held = true;
+            since = now_ms();
+        }
+    } while (ok && got != 0);
+
+    // clean up
+    ok = fflush(outfile) == 0 && ok;
+    mpz_clear(lv.c);
+    free(lv.arr);
+    free(buf);
+    return ok && !ferror(outfile);
+}
+
+bool ssio_decrypt_shards(FILE **shards, size_t count, FILE *outfile, const mpz_t d, const mpz_t pq,
+                         const ssio_opts *opts) {
+    ssio_shard *hdr = (ssio_shard *) malloc(count * sizeof(ssio_shard));
+    size_t *order = (size_t *) malloc(count * sizeof(size_t));
+    bool ok = shards_open(shards, count, hdr, order);
+
+    // shards are never compressed: each slice decrypts to its own input bytes
+    for (size_t j = 0; ok && j < count; j++) {
+        ssio_reader r;
+        memset(&r, 0, sizeof(r));
+        r.in = shards[order[j]];
+        ssio_window win = { .out = outfile, .skip = 0, .left = hdr[order[j]].len };
+        mpz_t c;
+        mpz_init(c);
+        ok = decrypt_lines(&r, &win, d, pq, opts ? opts->cache : NULL) && win.left == 0 && !ssio_reader_next(&r, c)
+            && !r.bad;
+        mpz_clear(c);
+        ssio_reader_close(&r);
+    }
+    free(hdr);
+    free(order);
+    return ok && !ferror(outfile);
+}
+
+bool ssio_decrypt_range(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                        uint64_t start, uint64_t len) {
+    ssio_reader r;
+    if (!ssio_reader_open(&r, infile) || !ssio_reader_load_index(&r)) {
+        ssio_reader_close(&r);
+        return false;
+    }
+
+    // no plaintext index for compressed payloads: inflate from the start
+    if (r.flags & SSIO_COMPRESSED) {
+        ssio_window win = { .out = outfile, .skip = start, .left = len };
+        bool ok = fseek(r.in, SSIO_HEADER_LEN, SEEK_SET) == 0 && decrypt_lines(&r, &win, d, pq, NULL);
+        ssio_reader_close(&r);
+        return ok && !ferror(outfile);
+    }
+
+    // clip the range to the payload
+    if (start > r.plain_total) {
+        start = r.plain_total;
+    }
+    uint64_t end = (len > r.plain_total - start) ? r.plain_total : start + len;
+    if (start >= end) {
+        ssio_reader_close(&r);
+        return true;
+    }
+
+    // binary search for the first block ending after start
+    uint64_t lo = 0, hi = r.count;
+    ssio_entry e;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (!ssio_reader_entry(&r, mid, &e)) {
+            ssio_reader_close(&r);
+            return false;
+        }
+        if (e.plain_off + e.plain_len <= start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo >= r.count || !ssio_reader_entry(&r, lo, &e)
+        || fseek(r.in, (long) e.cipher_off, SEEK_SET) != 0) {
+        ssio_reader_close(&r);
+        return false;
+    }
+
+    // decrypt only the blocks covering [start, end)
+    ssio_window win = { .out = outfile, .skip = start - e.plain_off, .left = end - start };
+    bool ok = decrypt_lines(&r, &win, d, pq, NULL) && win.left == 0;
+    ssio_reader_close(&r);
+    return ok && !ferror(outfile);
+}
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "ss.h"
+#include "sscache.h"
+
+//
+// SS ciphertext I/O.
+//
+// Two on-disk layouts are understood:
+//
+//  legacy:  one lowercase hex ciphertext line per block (ss_encrypt_file)
+//
+//  indexed: a fixed-width header line, the same hex ciphertext lines, then a
+//           block index and a fixed-width footer so that any plaintext offset
+//           can be mapped to the ciphertext line holding it without parsing
+//           the lines before it:
+//
+//           #ssx1 flags=<8 hex> k=<16 hex>
+//           <hex ciphertext>                       one line per block
+//           #index <16 hex count>
+//           <16 hex plain_off> <16 hex cipher_off> <8 hex plain_len>
+//           #end <16 hex index_off> <16 hex plain_total>
+//
+//  All offsets are in bytes from the start of the file / payload stream.
+//
+//  With SSIO_COMPRESSED the payload stream is an lz frame stream (lz.h) of
+//  the input rather than the input itself; index offsets refer to it.
+//
+//  shard:   one block-aligned slice of a sharded encryption; the shards of a
+//           set merge into the unsharded output of the recorded layout:
+//
+//           #sss1 <8 hex index> <8 hex count> flags=<8 hex> k=<16 hex> off=<16 hex> len=<16 hex> total=<16 hex>
+//           <hex ciphertext>                       one line per block of the slice
+//
+//           off and len locate the slice in the input; total is the input size.
+//
+//  manifest: written next to a ciphertext (not inside it) for incremental
+//           re-encryption; one fingerprint per block, in block order:
+//
+//           #ssm1 k=<16 hex> key=<16 hex>
+//           <32 hex>                               one line per block
+//
+//           key is ss_fingerprint(n);
+//           each line is the first 16 bytes of SHA-256 over the block's
+//           payload bytes.
+//
+
+#define SSIO_INDEXED    0x1u    // write header, index and footer
+#define SSIO_COMPRESSED 0x2u    // compress before blocking; implies SSIO_INDEXED
+
+#define SSIO_HEADER_LEN 40      // strlen("#ssx1 flags=xxxxxxxx k=xxxxxxxxxxxxxxxx\n")
+#define SSIO_ENTRY_LEN  43      // strlen("xxxxxxxxxxxxxxxx xxxxxxxxxxxxxxxx xxxxxxxx\n")
+#define SSIO_FOOTER_LEN 39      // strlen("#end xxxxxxxxxxxxxxxx xxxxxxxxxxxxxxxx\n")
+#define SSIO_SHARD_HEADER_LEN 123
+#define SSIO_MANIFEST_HEADER_LEN 46     // strlen("#ssm1 k=xxxxxxxxxxxxxxxx key=xxxxxxxxxxxxxxxx\n")
+#define SSIO_DIGEST_LEN 16              // fingerprint bytes per block
+#define SSIO_FLUSH_MS_MAX 3600000       // longest live-stream deadline (one hour)
+#define SSIO_THREADS_MAX 1024           // most threads -t may ask for
+
+typedef struct {
+    uint64_t plain_off;         // payload offset of the block's first byte
+    uint64_t cipher_off;        // file offset of the block's hex line
+    uint32_t plain_len;         // payload bytes carried by the block
+} ssio_entry;
+
+typedef struct {
+    FILE *out;
+    FILE *spool;                // index entries, copied behind the blocks on finish
+    uint32_t flags;
+    uint64_t k;
+    uint64_t cipher_off;        // bytes written to out so far
+    uint64_t plain_off;         // payload bytes written so far
+    uint64_t count;             // blocks written so far
+} ssio_writer;
+
+typedef struct {
+    FILE *in;
+    uint32_t flags;
+    uint64_t k;
+    bool indexed;
+    bool shard;                 // a lone shard: one slice's blocks, no index
+    uint64_t index_off;         // indexed only, valid after ssio_reader_load_index
+    uint64_t count;             // indexed: blocks in the index, once loaded or reached
+    uint64_t lines;             // ciphertext lines read by ssio_reader_next
+    bool at_index;              // ssio_reader_next stopped at the index section
+    bool bad;                   // ssio_reader_next stopped at a malformed line
+    uint64_t plain_total;       // indexed: after ssio_reader_load_index; shard: the slice's length
+    char *line;                 // line buffer for ssio_reader_next
+    size_t line_cap;
+} ssio_reader;
+
+typedef struct {
+    uint32_t index;             // 0-based position in the set
+    uint32_t count;             // shards in the set
+    uint32_t flags;             // SSIO_* layout of the merged output
+    uint64_t k;
+    uint64_t off;               // input offset of the slice
+    uint64_t len;               // input bytes in the slice
+    uint64_t total;             // input size
+} ssio_shard;
+
+typedef struct {
+    uint32_t flags;             // SSIO_* layout flags
+    unsigned threads;           // encryption threads; 0 = all CPUs, 1 = serial
+    size_t batch;               // input bytes per parallel batch; 0 = 256 KiB
+    const ss_crt_key *crt;      // key owner's split key: recipients with its
+                                // modulus are encrypted through the CRT halves
+    sscache *cache;             // block cache of the one key used (single-recipient
+                                // encryption, or decryption); NULL = none
+} ssio_opts;
+
+//
+// Start writing ciphertext blocks
+//
+// Requires:
+//  w: writer to initialize
+//  out: open and writable file stream
+//  k: block size of the encrypting key (ss_block_size)
+//  flags: SSIO_* layout flags
+//
+// Returns false if the index spool could not be created
+//
+bool ssio_writer_init(ssio_writer *w, FILE *out, uint64_t k, uint32_t flags);
+
+//
+// Append one encrypted block
+//
+// Requires:
+//  c: encrypted integer
+//  plain_len: payload bytes carried by c
+//
+void ssio_writer_put(ssio_writer *w, const mpz_t c, size_t plain_len);
+
+//
+// Write index and footer (indexed layout) and release the writer
+//
+void ssio_writer_finish(ssio_writer *w);
+
+//
+// Detect the layout of a ciphertext stream: legacy, indexed, or a lone shard
+//
+// Provides:
+//  r: reader positioned at the first ciphertext line
+//
+// Requires:
+//  in: open and readable file stream; need not be seekable
+//
+// Returns false on a malformed header
+//
+bool ssio_reader_open(ssio_reader *r, FILE *in);
+
+//
+// Read the next ciphertext line
+//
+// Returns false at end of the ciphertext lines (EOF or the index section),
+// or at a line that is neither; r->bad tells the two apart
+//
+bool ssio_reader_next(ssio_reader *r, mpz_t c);
+
+//
+// Whether the ciphertext lines read so far are the whole stream: no
+// malformed line, and for the indexed layout every block of its index
+//
+// Requires:
+//  r: read with ssio_reader_next until it returned false
+//
+bool ssio_reader_complete(const ssio_reader *r);
+
+//
+// Locate the index of an indexed stream through its footer
+//
+// Requires:
+//  r: opened on an indexed, seekable stream
+//
+// Returns false if the stream is not seekable or the footer is malformed
+//
+bool ssio_reader_load_index(ssio_reader *r);
+
+//
+// Read index entry i (0 <= i < r->count) with a single seek
+//
+bool ssio_reader_entry(ssio_reader *r, uint64_t i, ssio_entry *e);
+
+//
+// Release the reader's buffers; does not close r->in
+//
+void ssio_reader_close(ssio_reader *r);
+
+//
+// Encrypt an arbitrary file in the layout selected by opts
+//
+// Provides:
+//  fills outfile with the encrypted contents of infile
+//
+// Requires:
+//  infile: open and readable file stream
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//  opts: layout options; NULL writes the legacy layout serially
+//
+// Returns false on an I/O or allocation failure
+//
+bool ssio_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts);
+
+//
+// Encrypt an arbitrary file for several recipients in a single pass
+//
+// The input is read (and compressed) once. Each batch of blocks, across all
+// recipients, is encrypted on opts->threads threads; each output is
+// byte-identical to ssio_encrypt_file with that recipient's key.
+//
+// Provides:
+//  fills outfiles[i] with infile encrypted under ns[i]
+//
+// Requires:
+//  infile: open and readable file stream
+//  outfiles: count open and writable file streams
+//  ns: count public moduli
+//  opts: layout options; NULL writes the legacy layout serially
+//
+// Returns false on an I/O or allocation failure
+//
+bool ssio_encrypt_multi(FILE *infile, FILE **outfiles, mpz_t *ns, size_t count, const ssio_opts *opts);
+
+//
+// Encrypt a live stream (a pipe or socket) for one or more recipients
+//
+// Input is encrypted as it arrives instead of waiting for whole blocks: no
+// byte is held longer than flush_ms after it was read. When the deadline
+// passes, the pending bytes are written as a short block and every output
+// is flushed. A short block decrypts to exactly its own bytes, so the
+// plaintext (and every record boundary in it) round-trips unchanged; only
+// the block count depends on timing. The output always has the indexed
+// layout, so that appending and range decryption can locate the blocks;
+// its index and footer follow the last block once the input ends.
+//
+// Provides:
+//  fills outfiles[i] with infile encrypted under ns[i]
+//
+// Requires:
+//  infile: open and readable; read through its descriptor, so nothing may
+//          have been read through the stream yet
+//  outfiles: count open and writable file streams
+//  ns: count public moduli
+//  opts: layout options; SSIO_INDEXED is implied, and SSIO_COMPRESSED is
+//        not supported, since an lz frame cannot be written before its
+//        input ends
+//  flush_ms: deadline, at most SSIO_FLUSH_MS_MAX; 0 flushes after every read
+//
+// Returns false on an I/O or allocation failure
+//
+bool ssio_encrypt_live(FILE *infile, FILE **outfiles, mpz_t *ns, size_t count, const ssio_opts *opts,
+                       unsigned flush_ms);
+
+//
+// Bring a ciphertext up to date with a plaintext that has grown
+//
+// Every block of cipher but the last is kept as is; the last block, which
+// may be partial, and everything after it are encrypted from infile, so
+// the cost follows the bytes appended. An indexed container keeps its
+// header and gets its index and footer rewritten behind the new blocks.
+// The result is byte-identical to encrypting the whole of infile, unless
+// cipher holds short blocks (ssio_encrypt_live); those are kept as they are.
+//
+// The index locates the kept blocks in infile; a legacy ciphertext has
+// none, so every block but its last must be full, as ss_encrypt_file and
+// ssio_encrypt_file write them. One block is re-encrypted from infile and
+// compared: the last one of an indexed container, the last kept one of a
+// legacy ciphertext, or each of the k - 1 prefixes a legacy ciphertext of a
+// single block may hold. This refuses another key, and a legacy ciphertext
+// whose blocks are not where full blocks would put them.
+//
+// Requires:
+//  infile: open, readable and seekable; its bytes covered by cipher are
+//          unchanged (append-only input)
+//  cipher: open for update ("r+") and seekable; empty, or infile's earlier
+//          contents encrypted under n in the legacy or indexed layout
+//  n: public exponent and modulus
+//  opts: threads and batch; flags only apply when cipher is empty
+//
+// Returns false for a compressed container, a key or block size mismatch, a
+// kept block that does not match infile, a torn ciphertext or an I/O failure
+//
+bool ssio_encrypt_append(FILE *infile, FILE *cipher, const mpz_t n, const ssio_opts *opts);
+
+//
+// Encrypt a file, reusing the blocks a previous run already encrypted
+//
+// Block i of infile whose fingerprint equals line i of base_manifest gets
+// line i of base copied instead of being encrypted again; only changed or
+// new blocks are encrypted, in parallel. Since encryption is deterministic
+// the output is byte-identical to ssio_encrypt_file with the same options.
+// Changes that shift data (inserts, deletes) make every later block differ.
+//
+// Provides:
+//  fills outfile with the ciphertext, and manifest (if not NULL) with the
+//  fingerprints of its blocks, to serve as the next run's base
+//
+// Requires:
+//  infile: open and readable file stream
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//  opts: layout options; SSIO_COMPRESSED is not supported, since the lz
+//        frames shift every later block when any input byte changes
+//  base, base_manifest: both NULL (a first run that only writes manifest),
+//        or a previous ciphertext under n in the legacy or indexed layout
+//        and the manifest written with it
+//  reused: if not NULL, set to the number of blocks copied from base
+//
+// Returns false for a base of another key, block size or layout, an indexed
+// base with short blocks (ssio_encrypt_live) or that cannot be seeked, a
+// base that disagrees with its manifest, or an I/O failure
+//
+bool ssio_encrypt_delta(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts,
+                        FILE *manifest, FILE *base, FILE *base_manifest, uint64_t *reused);
+
+//
+// Encrypt shard index of count of a file
+//
+// The input's blocks are split into count near-equal runs and only run
+// index is read and encrypted, so the shards of one file can be produced
+// on different machines. Merging the whole set gives output byte-identical
+// to ssio_encrypt_file with the same options.
+//
+// Provides:
+//  fills outfile with a shard header and the slice's ciphertext lines
+//
+// Requires:
+//  infile: open, readable and seekable file stream
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//  opts: layout options; SSIO_COMPRESSED is not supported, since the lz
+//        frame sizes before a slice depend on all the input before it
+//  index < count
+//
+// Returns false on bad arguments, a non-seekable input or an I/O failure
+//
+bool ssio_encrypt_shard(FILE *infile, FILE *outfile, const mpz_t n, const ssio_opts *opts,
+                        uint32_t index, uint32_t count);
+
+//
+// Read a shard header
+//
+// Returns false if in does not start with a shard header
+//
+bool ssio_shard_read(FILE *in, ssio_shard *s);
+
+//
+// Reassemble a complete shard set, in any order, into the unsharded output
+//
+// Requires:
+//  shards: count streams, each positioned at its shard header
+//  outfile: open and writable file stream
+//
+// Returns false if the set is incomplete, inconsistent or malformed
+//
+bool ssio_merge_shards(FILE **shards, size_t count, FILE *outfile);
+
+//
+// Re-encrypt a ciphertext stream under a new key in one streaming pass
+//
+// Blocks are decrypted and re-encrypted in batches on opts->threads threads
+// and re-blocked to the new key's block size on the fly; only about one
+// batch of payload is held in memory. The payload stream is carried over
+// as is, so the layout (and compression) of infile is kept and the output
+// is byte-identical to encrypting the original under n.
+//
+// Provides:
+//  fills outfile with infile re-encrypted under n
+//
+// Requires:
+//  infile: open and readable file stream to encrypted data
+//  outfile: open and writable file stream
+//  d, pq: private key infile was encrypted for
+//  n: new public modulus
+//  opts: only threads and batch are used; NULL runs serially
+//
+// Returns false on a malformed stream or an I/O failure
+//
+bool ssio_rekey_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                     const mpz_t n, const ssio_opts *opts);
+
+//
+// Decrypt a ciphertext stream of either layout, or a lone shard
+//
+// Provides:
+//  fills outfile with the unencrypted data from infile; for a shard, the
+//  input bytes of its slice
+//
+// Requires:
+//  infile: open and readable file stream to encrypted data
+//  outfile: open and writable file stream
+//  d: private exponent
+//  pq: private modulus
+//  opts: only cache is used; may be NULL
+//
+// Returns false on a malformed stream
+//
+bool ssio_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                       const ssio_opts *opts);
+
+//
+// Decrypt a live ciphertext stream, line by line as it arrives
+//
+// Every complete line is decrypted at once, and the output is flushed no
+// later than flush_ms after the first plaintext written since the last
+// flush (see ssio_encrypt_live).
+//
+// Provides:
+//  fills outfile with the unencrypted data from infile
+//
+// Requires:
+//  infile: open and readable, in the legacy or an uncompressed indexed
+//          layout; read through its descriptor, so nothing may have been
+//          read through the stream yet
+//  outfile: open and writable file stream
+//  d: private exponent
+//  pq: private modulus
+//  opts: only cache is used; may be NULL
+//  flush_ms: deadline, at most SSIO_FLUSH_MS_MAX; 0 flushes after every read
+//
+// Returns false on a malformed or compressed stream or an I/O failure
+//
+bool ssio_decrypt_live(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                       const ssio_opts *opts, unsigned flush_ms);
+
+//
+// Decrypt a complete shard set, in any order, without merging it first
+//
+// Requires:
+//  shards: count streams, each positioned at its shard header
+//  outfile: open and writable file stream
+//  d: private exponent
+//  pq: private modulus
+//  opts: only cache is used; may be NULL
+//
+// Returns false if the set is incomplete, inconsistent or malformed
+//
+bool ssio_decrypt_shards(FILE **shards, size_t count, FILE *outfile, const mpz_t d, const mpz_t pq,
+                         const ssio_opts *opts);
+
+//
+// Decrypt only the bytes [start, start + len) of an indexed stream
+//
+// Provides:
+//  writes the requested slice (clipped to the plaintext size) to outfile
+//
+// A compressed stream has no plaintext index; it is decoded from the start
+// and decoding stops once the slice is complete.
+//
+// Requires:
+//  infile: open, readable and seekable indexed stream
+//  outfile: open and writable file stream
+//  d: private exponent
+//  pq: private modulus
+//
+// Returns false if infile is not a seekable indexed stream or is malformed
+//
+bool ssio_decrypt_range(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq,
+                        uint64_t start, uint64_t len);
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <gmp.h>
+
+#include "keyring.h"
+#include "ss.h"
+
+#define OPTIONS "o:l:vh"
+
+int main(int argc, char** argv) {
+    char *out_name = NULL;
+    char *list_name = NULL;
+    int opt = 0;
+    int verb = 0;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'o': out_name = optarg; break;
+        case 'l': list_name = optarg; break;
+        case 'v': verb = 1; break;
+        case 'h':
+            printf(
+                "SYNOPSIS\n"
+                "  Builds a keyring of public keys that encrypt -K looks up by\n"
+                "  username or fingerprint, or lists one.\n\n"
+                "USAGE\n"
+                "  sskeyring [-hv] -o keyring pubkey...\n"
+                "  sskeyring -l keyring\n\n"
+                "OPTIONS\n"
+                "  -o keyring    Keyring to write; replaced atomically.\n"
+                "  pubkey...     Public key files (keygen -n); usernames and\n"
+                "                fingerprints must be unique.\n"
+                "  -l keyring    List fingerprint, bits and username of every key.\n"
+                "  -v            Verbose output.\n"
+                "  -h            Display program usage.\n");
+            return 0;
+        default:
+            return EXIT_FAILURE;
+        }
+    } // end of switch cases
+
+    // list
+    if (list_name) {
+        keyring *kr = keyring_open(list_name, 0);
+        if (!kr) {
+            fprintf(stderr, "sskeyring - Could not open keyring: %s\n", list_name);
+            return EXIT_FAILURE;
+        }
+        uint64_t cursor = 0, listed = 0;
+        const keyring_key *key;
+        while ((key = keyring_next(kr, &cursor)) != NULL) {
+            printf("%016" PRIx64 " %5zu %s\n", key->fingerprint, mpz_sizeinbase(key->n, 2), key->username);
+            keyring_release(kr, key);
+            listed++;
+        }
+        int status = listed == keyring_count(kr) ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (status != EXIT_SUCCESS) {
+            fprintf(stderr, "sskeyring - Damaged keyring: %s\n", list_name);
+        }
+        keyring_close(kr);
+        return status;
+    }
+
+    size_t count = (size_t) (argc - optind);
+    if (!out_name || count == 0) {
+        fprintf(stderr, "sskeyring - Needs -o <keyring> and at least one public key file\n");
+        return EXIT_FAILURE;
+    }
+
+    // read every public key
+    mpz_t *ns = (mpz_t *) malloc(count * sizeof(mpz_t));
+    char **users = (char **) malloc(count * sizeof(char *));
+    int status = EXIT_SUCCESS;
+    size_t ready = 0;
+    for (; ready < count && status == EXIT_SUCCESS; ready++) {
+        mpz_init(ns[ready]);
+        users[ready] = (char *) calloc(SS_USERNAME_MAX, 1);
+        FILE *pub = fopen(argv[optind + ready], "r");
+        if (!pub) {
+            fprintf(stderr, "sskeyring - Could not open public key file: %s\n", argv[optind + ready]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        ss_read_pub(ns[ready], users[ready], pub);
+        fclose(pub);
+        if (verb) {
+            fprintf(stderr, "%016" PRIx64 " %s: %s\n", ss_fingerprint(ns[ready]), users[ready], argv[optind + ready]);
+        }
+    }
+
+    // write next to the keyring, then move it into place
+    if (status == EXIT_SUCCESS) {
+        size_t len = strlen(out_name) + 5;
+        char *tmp = (char *) malloc(len);
+        snprintf(tmp, len, "%s.tmp", out_name);
+        FILE *out = fopen(tmp, "w");
+        bool ok = out && keyring_write(out, ns, users, count);
+        ok = (out && fclose(out) == 0) && ok;
+        if (!ok || rename(tmp, out_name) != 0) {
+            fprintf(stderr, "sskeyring - Could not write keyring (repeated username or key?): %s\n", out_name);
+            remove(tmp);
+            status = EXIT_FAILURE;
+        } else if (verb) {
+            fprintf(stderr, "Keyring: %zu keys -> %s\n", count, out_name);
+        }
+        free(tmp);
+    }
+
+    // clean up
+    for (size_t i = 0; i < ready; i++) {
+        mpz_clear(ns[i]);
+        free(users[i]);
+    }
+    free(ns);
+    free(users);
+    return status;
+}
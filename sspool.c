@@ -0,0 +1,545 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sspool.h"
+#include "lz.h"
+#include "parallel.h"
+#include "ss.h"
+#include "ssio.h"
+#include "trace.h"
+
+typedef struct {
+    ss_job *job;
+    size_t idx;                 // task index within the job
+} ss_task;
+
+// ring buffer of tasks; the owner pops the newest, thieves take the oldest
+typedef struct {
+    pthread_mutex_t lock;
+    ss_task *buf;
+    size_t cap, head, count;
+} ss_deque;
+
+typedef struct {
+    ss_pool *pool;
+    unsigned id;
+} ss_worker;
+
+struct ss_pool {
+    unsigned nworkers;
+    unsigned started;           // threads actually running
+    pthread_t *tids;
+    ss_worker *workers;
+    ss_deque *deques;
+    atomic_long queued;         // tasks sitting in deques; may dip below 0 briefly
+    atomic_uint next;           // deque receiving the next submission
+
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t work;        // tasks were queued, or stop
+    pthread_cond_t ready;       // a job completed
+    bool stop;
+    size_t outstanding;         // submitted jobs not yet completed
+    size_t awaited;             // outstanding jobs without a callback
+    ss_job *done_head, *done_tail;
+    int pipefd[2];              // holds one byte while the completion queue is non-empty
+};
+
+//
+// jobs
+//
+
+static void job_init(ss_job *job, int kind) {
+    memset(job, 0, sizeof(*job));
+    job->kind = kind;
+    job->ok = false;
+    mpz_init(job->c);
+}
+
+void ss_job_encrypt_block(ss_job *job, const uint8_t *buf, size_t len, const mpz_t n) {
+    job_init(job, SS_JOB_ENCRYPT_BLOCK);
+    job->in = buf;
+    job->in_len = len;
+    job->n = n;
+    job->blocks = 1;
+    if (ss_block_size(n) < 2) {
+        atomic_store(&job->failed, true);
+    }
+}
+
+void ss_job_decrypt_block(ss_job *job, const mpz_t c, const mpz_t d, const mpz_t pq) {
+    job_init(job, SS_JOB_DECRYPT_BLOCK);
+    mpz_set(job->c, c);
+    job->d = d;
+    job->pq = pq;
+    job->room = (mpz_sizeinbase(pq, 2) + 7) / 8;
+    job->blocks = 1;
+}
+
+void ss_job_encrypt_buffer(ss_job *job, const uint8_t *buf, size_t len, const mpz_t n, uint32_t flags) {
+    job_init(job, SS_JOB_ENCRYPT_BUFFER);
+    job->flags = (flags & SSIO_COMPRESSED) ? flags | SSIO_INDEXED : flags;
+    job->in = buf;
+    job->in_len = len;
+    job->n = n;
+
+    // same frames as ssio_encrypt_file: one per LZ_FRAME_MAX input bytes
+    if (flags & SSIO_COMPRESSED) {
+        size_t frames = (len + LZ_FRAME_MAX - 1) / LZ_FRAME_MAX;
+        job->payload = (uint8_t *) malloc(frames * (LZ_FRAME_HEADER + lz_bound(LZ_FRAME_MAX)) + 1);
+        job->in_len = 0;
+        for (size_t off = 0; off < len; off += LZ_FRAME_MAX) {
+            size_t part = len - off < LZ_FRAME_MAX ? len - off : LZ_FRAME_MAX;
+            job->in_len += lz_frame(buf + off, part, job->payload + job->in_len);
+        }
+        job->in = job->payload;
+        len = job->in_len;
+    }
+    // a key with blocks of under 2 bytes carries no payload; as in ssio, refuse it
+    uint64_t k = ss_block_size(n);
+    job->room = k < 2 ? 1 : k - 1;
+    job->blocks = k < 2 ? 0 : (len + job->room - 1) / job->room;
+    if (k < 2) {
+        atomic_store(&job->failed, true);
+    }
+    job->parts = (mpz_t *) malloc((job->blocks ? job->blocks : 1) * sizeof(mpz_t));
+    for (size_t i = 0; i < job->blocks; i++) {
+        mpz_init(job->parts[i]);
+    }
+}
+
+void ss_job_decrypt_buffer(ss_job *job, const char *text, size_t len, const mpz_t d, const mpz_t pq) {
+    job_init(job, SS_JOB_DECRYPT_BUFFER);
+    job->d = d;
+    job->pq = pq;
+    job->room = (mpz_sizeinbase(pq, 2) + 7) / 8;
+
+    // split into lines up front; parsing is cheap next to decryption
+    bool first = true;
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        lines += text[i] == '\n' || (i + 1 == len);
+    }
+    job->parts = (mpz_t *) malloc((lines ? lines : 1) * sizeof(mpz_t));
+    char *line = (char *) malloc(len + 1);
+    size_t at = 0;
+    while (at < len) {
+        size_t end = at;
+        while (end < len && text[end] != '\n') end++;
+        size_t l = end - at;
+        while (l > 0 && text[at + l - 1] == '\r') l--;
+        memcpy(line, text + at, l);
+        line[l] = '\0';
+        at = end + 1;
+        if (l == 0) {
+            continue;           // tolerate blank lines
+        }
+        if (line[0] == '#') {
+            // container header first, index section last; anything else is not ours
+            if (first && sscanf(line, "#ssx1 flags=%8" SCNx32, &job->flags) == 1) {
+                first = false;
+                continue;
+            }
+            if (first || strncmp(line, "#index ", 7) != 0) {
+                atomic_store(&job->failed, true);
+            }
+            break;              // index section, or not a ciphertext stream
+        }
+        first = false;
+        mpz_init(job->parts[job->blocks]);
+        if (mpz_set_str(job->parts[job->blocks], line, 16) != 0) {
+            atomic_store(&job->failed, true);
+        }
+        job->blocks++;
+    }
+    free(line);
+    job->plain = (uint8_t *) malloc((job->blocks ? job->blocks : 1) * job->room);
+    job->plain_len = (size_t *) calloc(job->blocks ? job->blocks : 1, sizeof(size_t));
+}
+
+void ss_job_clear(ss_job *job) {
+    mpz_clear(job->c);
+    if (job->parts) {
+        for (size_t i = 0; i < job->blocks; i++) {
+            mpz_clear(job->parts[i]);
+        }
+        free(job->parts);
+    }
+    free(job->plain);
+    free(job->plain_len);
+    free(job->payload);
+    free(job->out);
+    job->payload = NULL;
+    job->parts = NULL;
+    job->plain = NULL;
+    job->plain_len = NULL;
+    job->out = NULL;
+}
+
+static void encrypt_bytes(const ss_job *job, mpz_t c, const uint8_t *buf, size_t len) {
+    if (job->crt) {
+        ss_encrypt_bytes_crt(c, buf, len, job->crt);
+    } else {
+        ss_encrypt_bytes(c, buf, len, job->n);
+    }
+}
+
+// run block idx of job
+static void job_run(ss_job *job, size_t idx) {
+    switch (job->kind) {
+    case SS_JOB_ENCRYPT_BLOCK:
+        if (!atomic_load(&job->failed)) {
+            encrypt_bytes(job, job->c, job->in, job->in_len);
+        }
+        break;
+    case SS_JOB_DECRYPT_BLOCK:
+        job->out = (uint8_t *) malloc(job->room);
+        if (!ss_decrypt_bytes(job->out, &job->out_len, job->room, job->c, job->d, job->pq)) {
+            atomic_store(&job->failed, true);
+        }
+        break;
+    case SS_JOB_ENCRYPT_BUFFER: {
+        size_t off = idx * job->room;
+        size_t len = job->in_len - off < job->room ? job->in_len - off : job->room;
+        encrypt_bytes(job, job->parts[idx], job->in + off, len);
+        break;
+    }
+    case SS_JOB_DECRYPT_BUFFER:
+        if (!atomic_load(&job->failed)
+            && !ss_decrypt_bytes(job->plain + idx * job->room, &job->plain_len[idx], job->room,
+                                 job->parts[idx], job->d, job->pq)) {
+            atomic_store(&job->failed, true);
+        }
+        break;
+    }
+}
+
+static size_t job_grain(const ss_job *job) {
+    return job->grain ? job->grain : 1;
+}
+
+// run the blocks of task t; an empty buffer's lone task only finishes the job
+static void task_run(ss_job *job, size_t t) {
+    uint64_t tr = trace_begin();
+    size_t end = (t + 1) * job_grain(job);
+    size_t i = t * job_grain(job);
+    for (; i < end && i < job->blocks; i++) {
+        job_run(job, i);
+    }
+    trace_end_arg("pool task", "sspool", tr, "blocks", i - t * job_grain(job));
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len, cap;
+} ss_sink;
+
+static bool sink_write(const uint8_t *buf, size_t len, void *ctx) {
+    ss_sink *s = (ss_sink *) ctx;
+    if (s->len + len > s->cap) {
+        s->cap = 2 * (s->len + len);
+        s->buf = (uint8_t *) realloc(s->buf, s->cap);
+    }
+    memcpy(s->buf + s->len, buf, len);
+    s->len += len;
+    return true;
+}
+
+// container layouts go through ssio's writer, so the bytes match ssio_encrypt_file
+static void finish_container(ss_job *job) {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&text, &len);
+    ssio_writer w;
+    if (!mem || !ssio_writer_init(&w, mem, job->room + 1, job->flags)) {
+        atomic_store(&job->failed, true);
+        if (mem) fclose(mem);
+        free(text);
+        return;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < job->blocks; i++) {
+        size_t part = job->in_len - used < job->room ? job->in_len - used : job->room;
+        ssio_writer_put(&w, job->parts[i], part);
+        used += part;
+    }
+    ssio_writer_finish(&w);
+    fclose(mem);
+    job->out = (uint8_t *) text;
+    job->out_len = len;
+}
+
+// assemble the output of a buffer job once every block is done
+static void job_finish(ss_job *job) {
+    if (atomic_load(&job->failed)) {
+        // nothing to assemble
+    } else if (job->kind == SS_JOB_ENCRYPT_BUFFER && job->flags) {
+        finish_container(job);
+    } else if (job->kind == SS_JOB_ENCRYPT_BUFFER) {
+        size_t total = 0;
+        for (size_t i = 0; i < job->blocks; i++) {
+            total += mpz_sizeinbase(job->parts[i], 16) + 1;     // exact for base 16
+        }
+        job->out = (uint8_t *) malloc(total + 1);
+        for (size_t i = 0; i < job->blocks; i++) {
+            mpz_get_str((char *) job->out + job->out_len, 16, job->parts[i]);
+            job->out_len += mpz_sizeinbase(job->parts[i], 16);
+            job->out[job->out_len++] = '\n';
+        }
+    } else if (job->kind == SS_JOB_DECRYPT_BUFFER) {
+        job->out = (uint8_t *) malloc(job->blocks * job->room + 1);
+        for (size_t i = 0; i < job->blocks; i++) {
+            memcpy(job->out + job->out_len, job->plain + i * job->room, job->plain_len[i]);
+            job->out_len += job->plain_len[i];
+        }
+        if (job->flags & SSIO_COMPRESSED) {
+            ss_sink sink = { 0 };
+            lz_decoder dec;
+            lz_decoder_init(&dec, sink_write, &sink);
+            bool ok = lz_decoder_feed(&dec, job->out, job->out_len);
+            ok = lz_decoder_finish(&dec) && ok;
+            free(job->out);
+            job->out = sink.buf;
+            job->out_len = sink.len;
+            if (!ok) {
+                atomic_store(&job->failed, true);
+            }
+        }
+    }
+    job->ok = !atomic_load(&job->failed);
+}
+
+//
+// pool
+//
+
+static void deque_push(ss_deque *q, ss_task t) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->cap) {
+        size_t cap = q->cap ? 2 * q->cap : 64;
+        ss_task *buf = (ss_task *) malloc(cap * sizeof(ss_task));
+        for (size_t i = 0; i < q->count; i++) {
+            buf[i] = q->buf[(q->head + i) % q->cap];
+        }
+        free(q->buf);
+        q->buf = buf;
+        q->cap = cap;
+        q->head = 0;
+    }
+    q->buf[(q->head + q->count) % q->cap] = t;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static bool deque_take(ss_deque *q, ss_task *t, bool newest) {
+    pthread_mutex_lock(&q->lock);
+    bool got = q->count > 0;
+    if (got && newest) {
+        *t = q->buf[(q->head + q->count - 1) % q->cap];
+        q->count--;
+    } else if (got) {
+        *t = q->buf[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return got;
+}
+
+// own deque first, then steal round the others
+static bool pool_take(ss_pool *pool, unsigned id, ss_task *t) {
+    for (unsigned i = 0; i < pool->nworkers; i++) {
+        unsigned victim = (id + i) % pool->nworkers;
+        if (deque_take(&pool->deques[victim], t, i == 0)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void pool_complete(ss_pool *pool, ss_job *job) {
+    job_finish(job);
+    bool queue = job->done == NULL;
+    if (!queue) {
+        job->done(job, job->ctx);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (queue) {
+        job->next = NULL;
+        if (pool->done_tail) {
+            pool->done_tail->next = job;
+        } else {
+            pool->done_head = job;
+            ssize_t w = write(pool->pipefd[1], "", 1);     // queue became non-empty
+            (void) w;
+        }
+        pool->done_tail = job;
+        pool->awaited--;
+    }
+    pool->outstanding--;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *pool_worker(void *arg) {
+    ss_worker *w = (ss_worker *) arg;
+    ss_pool *pool = w->pool;
+    ss_task t;
+    trace_lane(TRACE_POOL_LANE + w->id);
+    for (;;) {
+        if (pool_take(pool, w->id, &t)) {
+            task_run(t.job, t.idx);
+            if (atomic_fetch_sub(&t.job->left, 1) == 1) {
+                pool_complete(pool, t.job);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) <= 0 && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        bool quit = pool->stop && atomic_load(&pool->queued) <= 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (quit) {
+            trace_release();
+            return NULL;
+        }
+    }
+}
+
+ss_pool *ss_pool_create(unsigned threads) {
+    if (threads == 0) {
+        threads = parallel_ncpus();
+    }
+    ss_pool *pool = (ss_pool *) calloc(1, sizeof(ss_pool));
+    if (pipe(pool->pipefd) != 0) {
+        free(pool);
+        return NULL;
+    }
+    fcntl(pool->pipefd[0], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->next, 0);
+
+    pool->deques = (ss_deque *) calloc(threads, sizeof(ss_deque));
+    pool->workers = (ss_worker *) malloc(threads * sizeof(ss_worker));
+    pool->tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    pool->nworkers = threads;
+    for (unsigned i = 0; i < threads; i++) {
+        pool->workers[i] = (ss_worker) { .pool = pool, .id = i };
+        if (pthread_create(&pool->tids[i], NULL, pool_worker, &pool->workers[i]) != 0) {
+            ss_pool_destroy(pool);  // stops the workers started so far
+            return NULL;
+        }
+        pool->started++;
+    }
+    return pool;
+}
+
+void ss_pool_submit_batch(ss_pool *pool, ss_job **jobs, size_t count) {
+    long tasks = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (size_t j = 0; j < count; j++) {
+        pool->outstanding++;
+        pool->awaited += jobs[j]->done == NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    // deal tasks round the deques; empty jobs still get one task to finish them.
+    // Each job reserves its run of deques at once, so concurrent submitters
+    // (or callbacks submitting more work) never race on next
+    for (size_t j = 0; j < count; j++) {
+        ss_job *job = jobs[j];
+        size_t n = job->blocks ? (job->blocks + job_grain(job) - 1) / job_grain(job) : 1;
+        atomic_store(&job->left, n);
+        unsigned first = atomic_fetch_add(&pool->next, (unsigned) n);
+        for (size_t i = 0; i < n; i++) {
+            deque_push(&pool->deques[(first + i) % pool->nworkers], (ss_task) { .job = job, .idx = i });
+        }
+        tasks += (long) n;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->queued, tasks);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ss_pool_submit(ss_pool *pool, ss_job *job) {
+    ss_pool_submit_batch(pool, &job, 1);
+}
+
+// pop up to max jobs; pool->lock held
+static size_t pop_done(ss_pool *pool, ss_job **done, size_t max) {
+    size_t got = 0;
+    while (got < max && pool->done_head) {
+        done[got++] = pool->done_head;
+        pool->done_head = pool->done_head->next;
+    }
+    if (got > 0 && !pool->done_head) {
+        pool->done_tail = NULL;
+        char b;
+        ssize_t r = read(pool->pipefd[0], &b, 1);  // queue became empty
+        (void) r;
+    }
+    return got;
+}
+
+size_t ss_pool_poll(ss_pool *pool, ss_job **done, size_t max) {
+    pthread_mutex_lock(&pool->lock);
+    size_t got = pop_done(pool, done, max);
+    pthread_mutex_unlock(&pool->lock);
+    return got;
+}
+
+size_t ss_pool_wait(ss_pool *pool, ss_job **done, size_t max) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->done_head && pool->awaited > 0) {
+        pthread_cond_wait(&pool->ready, &pool->lock);
+    }
+    size_t got = pop_done(pool, done, max);
+    pthread_mutex_unlock(&pool->lock);
+    return got;
+}
+
+int ss_pool_fd(const ss_pool *pool) {
+    return pool->pipefd[0];
+}
+
+void ss_pool_destroy(ss_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->outstanding > 0) {
+        pthread_cond_wait(&pool->ready, &pool->lock);
+    }
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->started; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    for (unsigned i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].buf);
+    }
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->tids);
+    close(pool->pipefd[0]);
+    close(pool->pipefd[1]);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->ready);
+    free(pool);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "ss.h"
+
+//
+// Asynchronous SS jobs on a work-stealing thread pool.
+//
+// A job encrypts or decrypts one block, or a whole in-memory buffer in any
+// ssio.h layout. Buffer jobs are split into tasks of grain blocks (one by
+// default), so a single large buffer still spreads over every worker while
+// a small one can run as a single task.
+// Each worker owns a task deque: it pops its newest task and, when out of
+// work, steals the oldest task of another worker.
+//
+// A finished job either runs its completion callback on the worker thread
+// that finished it, or, without a callback, goes to the pool's completion
+// queue. ss_pool_fd is readable whenever that queue is not empty, so event
+// loops can poll(2) it and collect jobs with ss_pool_poll without blocking.
+//
+// SS encryption is deterministic and jobs never touch the global random
+// state, so any number of jobs may run at once.
+//
+
+#define SS_JOB_ENCRYPT_BLOCK  1
+#define SS_JOB_DECRYPT_BLOCK  2
+#define SS_JOB_ENCRYPT_BUFFER 3
+#define SS_JOB_DECRYPT_BUFFER 4
+
+typedef struct ss_job {
+    // results; valid once the job has completed
+    bool ok;                    // false: malformed input or allocation failure
+    mpz_t c;                    // encrypt block: the ciphertext
+    uint8_t *out;               // other kinds: plaintext, or ciphertext text
+    size_t out_len;
+
+    // completion callback; NULL queues the job for ss_pool_poll/ss_pool_wait
+    void (*done)(struct ss_job *job, void *ctx);
+    void *ctx;
+    size_t grain;               // blocks per task of a buffer job; 0 means 1
+    const ss_crt_key *crt;      // encrypt: the owner's split key for n, for
+                                // the faster CRT path; NULL uses n alone
+
+    // internal
+    int kind;
+    uint32_t flags;             // SSIO_* layout of the ciphertext
+    uint8_t *payload;           // compressed input, owned
+    const uint8_t *in;
+    size_t in_len;
+    mpz_srcptr n, d, pq;
+    size_t room;                // payload bytes per block (encrypt), plaintext cap (decrypt)
+    size_t blocks;
+    mpz_t *parts;               // per-block ciphertexts of buffer jobs
+    uint8_t *plain;             // per-block plaintexts of decrypt jobs
+    size_t *plain_len;
+    atomic_size_t left;         // tasks still running
+    atomic_bool failed;
+    struct ss_job *next;        // completion queue link
+} ss_job;
+
+typedef struct ss_pool ss_pool;
+
+//
+// Prepare a job; the key and input must stay valid until it completes
+//
+// Requires:
+//  encrypt block: len <= ss_block_size(n) - 1
+//  encrypt buffer: flags selects the output layout, as for ssio_encrypt_file
+//  decrypt buffer: text holds ciphertext in any layout; it need not outlive the call
+//
+void ss_job_encrypt_block(ss_job *job, const uint8_t *buf, size_t len, const mpz_t n);
+void ss_job_decrypt_block(ss_job *job, const mpz_t c, const mpz_t d, const mpz_t pq);
+void ss_job_encrypt_buffer(ss_job *job, const uint8_t *buf, size_t len, const mpz_t n, uint32_t flags);
+void ss_job_decrypt_buffer(ss_job *job, const char *text, size_t len, const mpz_t d, const mpz_t pq);
+
+//
+// Release a job's results; the job must have completed (or never been submitted)
+//
+void ss_job_clear(ss_job *job);
+
+//
+// Start a pool
+//
+// Requires:
+//  threads: worker count; 0 means parallel_ncpus()
+//
+// Returns NULL if a worker could not be started
+//
+ss_pool *ss_pool_create(unsigned threads);
+
+//
+// Wait for every submitted job, then stop the workers and free the pool
+//
+// Jobs still in the completion queue are dropped from it (not cleared).
+//
+void ss_pool_destroy(ss_pool *pool);
+
+//
+// Queue one job, or a batch of jobs with a single wake-up of the workers
+//
+void ss_pool_submit(ss_pool *pool, ss_job *job);
+void ss_pool_submit_batch(ss_pool *pool, ss_job **jobs, size_t count);
+
+//
+// Take up to max completed jobs from the completion queue
+//
+// ss_pool_poll never blocks; ss_pool_wait blocks until at least one job is
+// available, unless no queued job is outstanding.
+//
+// Returns the number of jobs stored in done
+//
+size_t ss_pool_poll(ss_pool *pool, ss_job **done, size_t max);
+size_t ss_pool_wait(ss_pool *pool, ss_job **done, size_t max);
+
+//
+// File descriptor that is readable while the completion queue is not empty
+//
+int ss_pool_fd(const ss_pool *pool);
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <gmp.h>
+
+#include "numtheory.h"
+#include "parallel.h"
+#include "randstate.h"
+#include "ss.h"
+#include "ssio.h"
+#include "tune.h"
+
+#define OPTIONS "b:n:o:vh"
+
+#define MAX_SIZES 16
+#define MIN_SECS  0.05      // time each candidate for at least this long
+#define SLACK     1.03      // prefer the earlier candidate unless 3% slower
+
+static int verb = 0;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// seconds per pow_mod on a random odd modulus of each size
+static double time_pow_mod(const uint64_t *sizes, size_t nsizes) {
+    mpz_t a, d, n, o;
+    mpz_inits(a, d, n, o, NULL);
+    double total = 0;
+    for (size_t i = 0; i < nsizes; i++) {
+        rng_urandomb(randstate(), n, sizes[i]);
+        mpz_setbit(n, sizes[i] - 1);
+        mpz_setbit(n, 0);
+        rng_urandomm(randstate(), a, n);
+        rng_urandomb(randstate(), d, sizes[i]);
+        uint64_t reps = 0;
+        double t0 = now(), t;
+        do {
+            pow_mod(o, a, d, n);
+            reps++;
+        } while ((t = now() - t0) < MIN_SECS);
+        total += t / reps;
+    }
+    mpz_clears(a, d, n, o, NULL);
+    return total;
+}
+
+// seconds to encrypt len bytes under each size with the given options
+static double time_encrypt(const uint64_t *sizes, size_t nsizes, const uint8_t *data, size_t len,
+                           const ssio_opts *opts) {
+    FILE *in = tmpfile();
+    fwrite(data, 1, len, in);
+    mpz_t n;
+    mpz_init(n);
+    double total = 0;
+    for (size_t i = 0; i < nsizes; i++) {
+        rng_urandomb(randstate(), n, sizes[i]);
+        mpz_setbit(n, sizes[i] - 1);
+        mpz_setbit(n, 0);
+        FILE *out = tmpfile();
+        rewind(in);
+        double t0 = now();
+        ssio_encrypt_file(in, out, n, opts);
+        total += now() - t0;
+        fclose(out);
+    }
+    mpz_clear(n);
+    fclose(in);
+    return total;
+}
+
+// seconds to write and re-read count ciphertext lines through a buffer of size bytes
+static double time_io(uint64_t bits, size_t count, size_t size) {
+    mpz_t c;
+    mpz_init(c);
+    rng_urandomb(randstate(), c, bits);
+    double t0 = now();
+    FILE *f = tmpfile();
+    setvbuf(f, NULL, _IOFBF, size);
+    for (size_t i = 0; i < count; i++) {
+        gmp_fprintf(f, "%Zx\n", c);
+    }
+    rewind(f);
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        mpz_set_str(c, line, 16);
+    }
+    free(line);
+    fclose(f);
+    mpz_clear(c);
+    return now() - t0;
+}
+
+// index of the fastest time, favoring earlier entries within SLACK
+static size_t pick(const double *t, size_t count) {
+    size_t best = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (t[i] * SLACK < t[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static uint64_t parse_bits(const char *arg) {
+    for (const char *t = arg; *t; t++) {
+        if (!isdigit((unsigned char)*t)) {
+            return 0;
+        }
+    }
+    return strtoull(arg, NULL, 10);
+}
+
+int main(int argc, char **argv) {
+    uint64_t sizes[MAX_SIZES];
+    size_t nsizes = 0;
+    const char *out_name = getenv("SS_TUNE");
+    int opt = 0;
+
+    if (!out_name || !*out_name) {
+        out_name = TUNE_DEFAULT_PATH;
+    }
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'b': {
+            uint64_t b = parse_bits(optarg);
+            if (b < 16) {
+                fprintf(stderr, "sstune: invalid -b <bits>: \"%s\"\n", optarg);
+                return EXIT_FAILURE;
+            }
+            if (nsizes < MAX_SIZES) sizes[nsizes++] = b;
+            break;
+        }
+        case 'n': {
+            FILE *pub = fopen(optarg, "r");
+            if (!pub) {
+                fprintf(stderr, "sstune - Could not open public key file: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            mpz_t n;
+            char username[100];
+            mpz_init(n);
+            ss_read_pub(n, username, pub);
+            fclose(pub);
+            if (nsizes < MAX_SIZES && mpz_sizeinbase(n, 2) >= 16) sizes[nsizes++] = mpz_sizeinbase(n, 2);
+            mpz_clear(n);
+            break;
+        }
+        case 'o': out_name = optarg; break;
+        case 'v': verb = 1; break;
+        case 'h':
+            printf(
+                "SYNOPSIS\n"
+                "  Measures arithmetic backends, pow_mod windows, thread counts, batch\n"
+                "  sizes and I/O buffer sizes on this machine for the given key sizes\n"
+                "  and writes the fastest choices as a tuning profile.\n\n"
+                "USAGE\n"
+                "  sstune [-hv] [-b bits]... [-n pubkey]... [-o profile]\n\n"
+                "OPTIONS\n"
+                "  -b bits       Key size to tune for; repeatable.\n"
+                "  -n pubkey     Tune for the size of this public key; repeatable\n"
+                "                (default: ss.pub if present, else 1024 and 2048 bits).\n"
+                "  -o profile    Profile to write (default: $SS_TUNE, else ss.tune).\n"
+                "  -v            Print every measurement.\n"
+                "  -h            Display program usage.\n");
+            return 0;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+
+    // default to the installed key
+    if (nsizes == 0) {
+        FILE *pub = fopen("ss.pub", "r");
+        if (pub) {
+            mpz_t n;
+            char username[100];
+            mpz_init(n);
+            ss_read_pub(n, username, pub);
+            fclose(pub);
+            if (mpz_sizeinbase(n, 2) >= 16) sizes[nsizes++] = mpz_sizeinbase(n, 2);
+            mpz_clear(n);
+        }
+    }
+    if (nsizes == 0) {
+        sizes[nsizes++] = 1024;
+        sizes[nsizes++] = 2048;
+    }
+
+    randstate_init(1);
+    tune_profile prof;
+    memset(&prof, 0, sizeof(prof));
+    size_t used = 0;
+    for (size_t i = 0; i < nsizes && used + 22 < sizeof(prof.bits); i++) {
+        used += snprintf(prof.bits + used, sizeof(prof.bits) - used, "%s%" PRIu64, i ? "," : "", sizes[i]);
+    }
+
+    // 1) arithmetic: backend, and the window when the native backend wins
+    const char *names[] = { "fast", "gmp", "native" };
+    double t[16];
+    size_t nb = 0;
+    for (; nb < 2; nb++) {
+        nt_backend_select(names[nb]);
+        t[nb] = time_pow_mod(sizes, nsizes);
+        if (verb) fprintf(stderr, "pow_mod  %-10s %10.1f us\n", names[nb], t[nb] * 1e6);
+    }
+    nt_backend_select("native");
+    unsigned best_w = 1;
+    double best_wt = 0;
+    for (unsigned w = 1; w <= 6; w++) {
+        nt_set_pow_window(w);
+        double tw = time_pow_mod(sizes, nsizes);
+        if (verb) fprintf(stderr, "pow_mod  native/w=%u %10.1f us\n", w, tw * 1e6);
+        if (w == 1 || tw * SLACK < best_wt) {
+            best_w = w;
+            best_wt = tw;
+        }
+    }
+    t[nb++] = best_wt;
+    size_t b = pick(t, nb);
+    snprintf(prof.backend, sizeof(prof.backend), "%s", names[b]);
+    prof.pow_window = best_w;
+    nt_backend_select(prof.backend);
+    nt_set_pow_window(best_w);
+
+    // 2) threads, then batch size; measured at the smallest size on about
+    //    2048 blocks, since both only trade scheduling overhead for balance
+    uint64_t low = sizes[0];
+    for (size_t i = 1; i < nsizes; i++) low = sizes[i] < low ? sizes[i] : low;
+    size_t len = 2048 * (size_t) ((low / 2 - 1) / 8);
+    uint8_t *data = (uint8_t *) malloc(len);
+    rng_bytes(randstate(), data, len);
+    unsigned cands[16];
+    size_t nc = 0;
+    unsigned ncpus = parallel_ncpus();
+    for (unsigned th = 1; th < ncpus && nc < 15; th *= 2) {
+        cands[nc++] = th;
+    }
+    cands[nc++] = ncpus;
+    prof.threads = ncpus;
+    prof.batch = 256 * 1024;
+    if (nc > 1) {
+        for (size_t i = 0; i < nc; i++) {
+            ssio_opts o = { .threads = cands[i] };
+            t[i] = time_encrypt(&low, 1, data, len, &o);
+            if (verb) fprintf(stderr, "threads  %-10u %10.3f s\n", cands[i], t[i]);
+        }
+        prof.threads = cands[pick(t, nc)];
+
+        size_t batches[] = { 256 * 1024, 64 * 1024, 1024 * 1024 };
+        for (size_t i = 0; i < 3; i++) {
+            ssio_opts o = { .threads = prof.threads, .batch = batches[i] };
+            t[i] = time_encrypt(&low, 1, data, len, &o);
+            if (verb) fprintf(stderr, "batch    %-10zu %10.3f s\n", batches[i], t[i]);
+        }
+        prof.batch = batches[pick(t, 3)];
+    } else if (verb) {
+        fprintf(stderr, "threads  single CPU: 1 thread, default batch\n");
+    }
+    free(data);
+
+    // 3) stdio buffer for ciphertext lines of the largest key
+    uint64_t top = sizes[0];
+    for (size_t i = 1; i < nsizes; i++) top = sizes[i] > top ? sizes[i] : top;
+    size_t bufs[] = { BUFSIZ, 64 * 1024, 1024 * 1024 };
+    for (size_t i = 0; i < 3; i++) {
+        t[i] = time_io(top, 20000, bufs[i]);
+        if (verb) fprintf(stderr, "io_buffer %-9zu %10.3f s\n", bufs[i], t[i]);
+    }
+    prof.io_buffer = bufs[pick(t, 3)];
+    randstate_clear();
+
+    if (!tune_save(out_name, &prof)) {
+        fprintf(stderr, "sstune - Could not write profile: %s\n", out_name);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Wrote %s: backend %s, pow_window %u, threads %u, batch %zu, io_buffer %zu (bits %s)\n",
+            out_name, prof.backend, prof.pow_window, prof.threads, prof.batch, prof.io_buffer, prof.bits);
+    return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <gmp.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "numtheory.h"
 #include "randstate.h"
@@ -169,14 +170,223 @@ static bool test_make_prime_bitlen(void) {
     return true;
 }
 
+// prime_screen must never call a prime composite, and must agree with
+// is_prime wherever it claims a definite answer
+static bool test_prime_screen(void) {
+    printf("[prime_screen] agreement with is_prime, strong pseudoprimes...\n");
+    mpz_t n; mpz_init(n);
+    rng st; rng_init(&st, 7, 0);
+
+    for (unsigned long i = 0; i < 20000; i++) {
+        mpz_set_ui(n, i);
+        int v = prime_screen(n);
+        bool p = is_prime_r(n, 25, &st);
+        if ((v == SCREEN_PRIME && !p) || ((v == SCREEN_TRIAL || v == SCREEN_BASE2) && p)) {
+            gmp_fprintf(stderr, "NOTE: prime_screen(%Zd) = %d disagrees with is_prime\n", n, v);
+            mpz_clear(n); return false;
+        }
+    }
+
+    // 149491*747451*34233211 is a strong pseudoprime to base 2 without small factors
+    mpz_set_str(n, "3825123056546413051", 10);
+    if (prime_screen(n) != SCREEN_PASSED || is_prime_r(n, 25, &st)) {
+        fprintf(stderr, "NOTE: strong base-2 pseudoprime must reach Miller-Rabin and fail it\n");
+        mpz_clear(n); return false;
+    }
+
+    // 2^127 - 1 is prime
+    mpz_ui_pow_ui(n, 2, 127); mpz_sub_ui(n, n, 1);
+    if (prime_screen(n) != SCREEN_PASSED || !is_prime_r(n, 25, &st)) {
+        fprintf(stderr, "NOTE: 2^127-1 should pass the screen and Miller-Rabin\n");
+        mpz_clear(n); return false;
+    }
+
+    mpz_clear(n);
+    printf("PASS\n");
+    return true;
+}
+
+// Differential check: every backend must agree with native on random inputs,
+// including negative operands, non-invertible pairs and prime/composite mixes.
+static bool test_backends_agree(void) {
+    printf("[backends] differential check against native...\n");
+    gmp_randstate_t st;
+    gmp_randinit_mt(st);
+    gmp_randseed_ui(st, 4242);
+    mpz_t a, b, n, want, got;
+    mpz_inits(a, b, n, want, got, NULL);
+    const nt_backend *ref = nt_backend_find("native");
+    ASSERT_MSG(ref != NULL, "no native backend");
+
+    bool ok = true;
+    for (size_t k = 1; ok && nt_backend_at(k); k++) {
+        const nt_backend *be = nt_backend_at(k);
+        for (int i = 0; ok && i < 2000; i++) {
+            mp_bitcnt_t bits = 2 + (i % 300);
+            mpz_urandomb(a, st, bits);
+            mpz_urandomb(b, st, bits);
+            mpz_urandomb(n, st, bits);
+            mpz_add_ui(n, n, 2);                    // modulus >= 2
+            if (i % 3 == 0) mpz_neg(a, a);
+            if (i % 5 == 0) mpz_set_ui(b, 0);
+
+            ref->gcd(want, a, b); be->gcd(got, a, b);
+            ok &= mpz_cmp(want, got) == 0;
+            ref->mod_inverse(want, a, n); be->mod_inverse(got, a, n);
+            ok &= mpz_cmp(want, got) == 0;
+            mpz_abs(b, b);
+            ref->pow_mod(want, a, b, n); be->pow_mod(got, a, b, n);
+            ok &= mpz_cmp(want, got) == 0;
+
+            // mostly composites from the odd random values, plus real primes
+            mpz_setbit(n, 0);
+            if (i % 4 == 0) mpz_nextprime(n, n);
+            rng s1, s2;
+            rng_init(&s1, (uint64_t) i, k);
+            s2 = s1;
+            ok &= ref->is_prime(n, 25, &s1) == be->is_prime(n, 25, &s2);
+            if (!ok) gmp_fprintf(stderr, "FAIL: %s disagrees with native (n=%Zd)\n", be->name, n);
+        }
+    }
+
+    // a seed gives the same prime on native and fast
+    const char *prev = nt_backend_name();
+    mpz_t p1, p2; mpz_inits(p1, p2, NULL);
+    nt_backend_select("native"); randstate_init(7); make_prime(p1, 256, 25); randstate_clear();
+    nt_backend_select("fast");   randstate_init(7); make_prime(p2, 256, 25); randstate_clear();
+    nt_backend_select(prev);
+    ok &= mpz_cmp(p1, p2) == 0;
+    if (mpz_cmp(p1, p2) != 0) fprintf(stderr, "FAIL: native and fast draw different primes from one seed\n");
+
+    mpz_clears(a, b, n, want, got, p1, p2, NULL);
+    gmp_randclear(st);
+    if (ok) printf("PASS\n");
+    return ok;
+}
+
+// Every pow_mod window of the native backend computes the same powers.
+static bool test_pow_window(void) {
+    printf("[pow_mod] native exponent windows 1..8...\n");
+    gmp_randstate_t st;
+    gmp_randinit_mt(st);
+    gmp_randseed_ui(st, 99);
+    mpz_t a, d, n, want, got;
+    mpz_inits(a, d, n, want, got, NULL);
+    const nt_backend *native = nt_backend_find("native");
+    unsigned prev = nt_pow_window();
+    bool ok = true;
+    for (int i = 0; ok && i < 200; i++) {
+        mpz_urandomb(n, st, 2 + i * 5);
+        mpz_add_ui(n, n, 2);
+        mpz_urandomb(a, st, 2 + i * 5);
+        mpz_urandomb(d, st, 1 + i * 3);
+        if (i % 7 == 0) mpz_neg(a, a);
+        mpz_powm(want, a, d, n);
+        for (unsigned w = 1; ok && w <= 8; w++) {
+            nt_set_pow_window(w);
+            native->pow_mod(got, a, d, n);
+            ok = mpz_cmp(want, got) == 0;
+            if (!ok) gmp_fprintf(stderr, "FAIL: window %u: %Zd^%Zd mod %Zd\n", w, a, d, n);
+        }
+    }
+    nt_set_pow_window(prev);
+    mpz_clears(a, d, n, want, got, NULL);
+    gmp_randclear(st);
+    if (ok) printf("PASS\n");
+    return ok;
+}
+
+// The generator is ChaCha20, its streams are independent, and its helpers
+// stay in range; every thread draws from a stream of its own.
+static void *first_draw(void *out) {
+    *(uint64_t *) out = rng_u64(randstate());
+    return NULL;
+}
+
+static bool test_rng(void) {
+    printf("[rng] ChaCha20 vectors, streams, helpers, per-thread state...\n");
+    // RFC 8439 A.1 test vectors #1 and #2: zero key and nonce, counters 0 and 1
+    static const uint8_t block0[16] = { 0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+                                        0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28 };
+    static const uint8_t block1[16] = { 0x9f, 0x07, 0xe7, 0xbe, 0x55, 0x51, 0x38, 0x7a,
+                                        0x98, 0xba, 0x97, 0x7c, 0x73, 0x2d, 0x08, 0x0d };
+    rng r, s;
+    rng_init(&r, 0, 0);
+    memset(r.key, 0, sizeof(r.key));
+    uint8_t out[128];
+    rng_bytes(&r, out, sizeof(out));
+    ASSERT_MSG(memcmp(out, block0, 16) == 0 && memcmp(out + 64, block1, 16) == 0, "ChaCha20 test vector");
+
+    // equal seeds and streams repeat, other streams do not; copies replay
+    rng_init(&r, 5, 0);
+    rng_init(&s, 5, 0);
+    ASSERT_MSG(rng_u64(&r) == rng_u64(&s), "same seed and stream differ");
+    rng_init(&s, 5, 1);
+    ASSERT_MSG(rng_u64(&r) != rng_u64(&s), "streams 0 and 1 agree");
+    s = r;
+    ASSERT_MSG(rng_u64(&r) == rng_u64(&s), "copy does not replay");
+
+    mpz_t a, n;
+    mpz_inits(a, n, NULL);
+    bool seen[4] = { false };
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_MSG(rng_below(&r, 7) < 7, "rng_below out of range");
+        uint64_t bits = 2 + (uint64_t) i % 200;
+        rng_candidate(&r, a, bits, i % 2);
+        ASSERT_MSG(mpz_sizeinbase(a, 2) == bits && mpz_odd_p(a) && (i % 2 == 0 || mpz_tstbit(a, bits - 2)),
+                   "bad prime candidate");
+        mpz_set_ui(n, 5);
+        rng_witness(&r, a, n);
+        ASSERT_MSG(mpz_cmp_ui(a, 2) >= 0 && mpz_cmp_ui(a, 3) <= 0, "witness outside [2, n-2]");
+        seen[mpz_get_ui(a)] = true;
+        rng_urandomb(&r, n, 1 + (uint64_t) i % 300);
+        mpz_add_ui(n, n, 1);
+        rng_urandomm(&r, a, n);
+        ASSERT_MSG(mpz_sgn(a) >= 0 && mpz_cmp(a, n) < 0, "rng_urandomm out of range");
+    }
+    ASSERT_MSG(seen[2] && seen[3], "witnesses miss part of [2, n-2]");
+    mpz_clears(a, n, NULL);
+
+    // the seeding thread draws stream 0, other threads streams of their own
+    uint64_t main_draw, draws[2];
+    randstate_init(11);
+    rng_init(&r, 11, 0);
+    main_draw = rng_u64(randstate());
+    ASSERT_MSG(main_draw == rng_u64(&r), "seeding thread is not on stream 0");
+    pthread_t t[2];
+    for (int i = 0; i < 2; i++) pthread_create(&t[i], NULL, first_draw, &draws[i]);
+    for (int i = 0; i < 2; i++) pthread_join(t[i], NULL);
+    randstate_clear();
+    ASSERT_MSG(draws[0] != draws[1] && draws[0] != main_draw && draws[1] != main_draw, "threads share a stream");
+
+    rng_clear(&r);
+    rng_clear(&s);
+    printf("PASS\n");
+    return true;
+}
+
 int main(int argc, char **argv) {
     (void)argc; (void)argv;
     int failures = 0;
-    if (!test_gcd()) failures++;
-    if (!test_pow_mod()) failures++;
-    if (!test_mod_inverse()) failures++;
+
+    // the edge cases hold on every backend
+    const char *active = nt_backend_name();
+    for (size_t i = 0; nt_backend_at(i); i++) {
+        nt_backend_select(nt_backend_at(i)->name);
+        printf("== backend %s ==\n", nt_backend_name());
+        if (!test_gcd()) failures++;
+        if (!test_pow_mod()) failures++;
+        if (!test_mod_inverse()) failures++;
+    }
+    nt_backend_select(active);
+    printf("== backend %s ==\n", nt_backend_name());
+
+    if (!test_backends_agree()) failures++;
+    if (!test_pow_window()) failures++;
     if (!test_is_prime_flaky()) failures++;
     if (!test_make_prime_bitlen()) failures++;
+    if (!test_prime_screen()) failures++;
+    if (!test_rng()) failures++;
     if (failures == 0) {
         printf("\nALL TESTS PASSED\n");
         return 0;
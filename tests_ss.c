@@ -2,11 +2,20 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
 #include <gmp.h>
 
 #include "randstate.h"
 #include "numtheory.h"
 #include "ss.h"
+#include "sha256.h"
+#include "ssio.h"
+#include "sspool.h"
+#include "keyring.h"
 
 static size_t enc_k_from_n(const mpz_t n) {
     mpz_t root; mpz_init(root);
@@ -55,6 +64,725 @@ static int roundtrip(const uint8_t *data, size_t len, const mpz_t n, const mpz_t
     return ok ? 0 : 2;
 }
 
+// indexed container: full decrypt and a few random-access slices
+static int roundtrip_indexed(const uint8_t *data, size_t len, uint32_t flags,
+                             const mpz_t n, const mpz_t d, const mpz_t pq) {
+    FILE *fin = tmpfile();
+    FILE *fenc = tmpfile();
+    if (!fin || !fenc) { perror("tmpfile"); return 1; }
+
+    if (len) fwrite(data, 1, len, fin);
+    rewind(fin);
+    ssio_opts opts = { .flags = flags };
+    if (!ssio_encrypt_file(fin, fenc, n, &opts)) { fclose(fin); fclose(fenc); return 2; }
+
+    int bad = 0;
+
+    // whole file
+    rewind(fenc);
+    FILE *fdec = tmpfile();
+    size_t out_len = 0;
+    bad |= !ssio_decrypt_file(fenc, fdec, d, pq, NULL);
+    rewind(fdec);
+    uint8_t *out = read_all(fdec, &out_len);
+    bad |= (out_len != len) || (len && memcmp(out, data, len) != 0);
+    free(out); fclose(fdec);
+
+    // slices: start, middle across a block edge, tail, past the end
+    size_t starts[] = {0, len / 3, len ? len - 1 : 0, len + 10};
+    size_t lens[] = {1, len / 2 + 7, 5, 3};
+    for (size_t i = 0; i < sizeof(starts)/sizeof(starts[0]); i++) {
+        size_t st = starts[i], ln = lens[i];
+        size_t want = st >= len ? 0 : (ln > len - st ? len - st : ln);
+        rewind(fenc);
+        fdec = tmpfile();
+        bad |= !ssio_decrypt_range(fenc, fdec, d, pq, st, ln);
+        rewind(fdec);
+        out = read_all(fdec, &out_len);
+        bad |= (out_len != want) || (want && memcmp(out, data + st, want) != 0);
+        free(out); fclose(fdec);
+    }
+
+    fclose(fin); fclose(fenc);
+    return bad ? 2 : 0;
+}
+
+// one pass for several keys must match a separate serial run per key
+static int multi_matches(const uint8_t *data, size_t len, uint32_t flags, mpz_t *ns, size_t count) {
+    FILE *fin = tmpfile();
+    FILE **outs = (FILE **) malloc(count * sizeof(FILE *));
+    if (len) fwrite(data, 1, len, fin);
+    for (size_t i = 0; i < count; i++) outs[i] = tmpfile();
+
+    rewind(fin);
+    ssio_opts multi = { .flags = flags, .threads = 4 };
+    int bad = !ssio_encrypt_multi(fin, outs, ns, count, &multi);
+
+    for (size_t i = 0; i < count; i++) {
+        FILE *single = tmpfile();
+        ssio_opts serial = { .flags = flags, .threads = 1 };
+        rewind(fin);
+        bad |= !ssio_encrypt_file(fin, single, ns[i], &serial);
+
+        size_t a_len = 0, b_len = 0;
+        rewind(outs[i]); rewind(single);
+        uint8_t *a = read_all(outs[i], &a_len);
+        uint8_t *b = read_all(single, &b_len);
+        bad |= a_len != b_len || memcmp(a, b, a_len) != 0;
+        free(a); free(b);
+        fclose(single); fclose(outs[i]);
+    }
+    free(outs);
+    fclose(fin);
+    if (bad) printf("ss: multi-recipient output differs (flags %u)\n", (unsigned) flags);
+    return bad;
+}
+
+// rekeying from (d, pq) to n2 must match encrypting the original under n2
+static int rekey_matches(const uint8_t *data, size_t len, uint32_t flags, const mpz_t n,
+                         const mpz_t d, const mpz_t pq, const mpz_t n2) {
+    FILE *fin = tmpfile(), *fold = tmpfile(), *fnew = tmpfile(), *fwant = tmpfile();
+    if (len) fwrite(data, 1, len, fin);
+    ssio_opts opts = { .flags = flags, .threads = 3 };
+
+    rewind(fin);
+    int bad = !ssio_encrypt_file(fin, fold, n, &opts);
+    rewind(fin);
+    bad |= !ssio_encrypt_file(fin, fwant, n2, &opts);
+    rewind(fold);
+    bad |= !ssio_rekey_file(fold, fnew, d, pq, n2, &opts);
+
+    size_t a_len = 0, b_len = 0;
+    rewind(fnew); rewind(fwant);
+    uint8_t *a = read_all(fnew, &a_len);
+    uint8_t *b = read_all(fwant, &b_len);
+    bad |= a_len != b_len || memcmp(a, b, a_len) != 0;
+    free(a); free(b);
+    fclose(fin); fclose(fold); fclose(fnew); fclose(fwant);
+    if (bad) printf("ss: rekeyed output differs (flags %u)\n", (unsigned) flags);
+    return bad;
+}
+
+// rekeying a ciphertext whose line at offset at is overwritten with byte
+// (a malformed line, or a '#' that drops the rest) must fail, not truncate
+static int rekey_refuses(const uint8_t *data, size_t len, uint32_t flags, size_t at, char byte,
+                         const mpz_t n, const mpz_t d, const mpz_t pq, const mpz_t n2) {
+    FILE *fin = tmpfile(), *fold = tmpfile(), *fnew = tmpfile();
+    if (len) fwrite(data, 1, len, fin);
+    ssio_opts opts = { .flags = flags, .threads = 3 };
+
+    rewind(fin);
+    int bad = !ssio_encrypt_file(fin, fold, n, &opts);
+    bad |= fseek(fold, (long) at, SEEK_SET) != 0 || fputc(byte, fold) == EOF;
+    rewind(fold);
+    bad |= ssio_rekey_file(fold, fnew, d, pq, n2, &opts);
+    fclose(fin); fclose(fold); fclose(fnew);
+    if (bad) printf("ss: rekey accepted a corrupted ciphertext (flags %u, '%c' at %zu)\n",
+                    (unsigned) flags, byte, at);
+    return bad;
+}
+
+// merging a shard set (given out of order) must match an unsharded run
+static int shards_match(const uint8_t *data, size_t len, uint32_t flags, uint32_t count,
+                        const mpz_t n, const mpz_t d, const mpz_t pq) {
+    FILE *fin = tmpfile(), *fwant = tmpfile(), *fmerged = tmpfile(), *fdec = tmpfile();
+    if (len) fwrite(data, 1, len, fin);
+    ssio_opts opts = { .flags = flags, .threads = 2 };
+    rewind(fin);
+    int bad = !ssio_encrypt_file(fin, fwant, n, &opts);
+
+    FILE **shards = (FILE **) malloc(count * sizeof(FILE *));
+    for (uint32_t i = 0; i < count; i++) {
+        shards[count - 1 - i] = tmpfile();
+        bad |= !ssio_encrypt_shard(fin, shards[count - 1 - i], n, &opts, i, count);
+    }
+    for (uint32_t i = 0; i < count; i++) rewind(shards[i]);
+    bad |= !ssio_merge_shards(shards, count, fmerged);
+    for (uint32_t i = 0; i < count; i++) rewind(shards[i]);
+    bad |= !ssio_decrypt_shards(shards, count, fdec, d, pq, NULL);
+
+    size_t a_len = 0, b_len = 0, c_len = 0;
+    rewind(fwant); rewind(fmerged); rewind(fdec);
+    uint8_t *a = read_all(fwant, &a_len);
+    uint8_t *b = read_all(fmerged, &b_len);
+    uint8_t *c = read_all(fdec, &c_len);
+    bad |= a_len != b_len || memcmp(a, b, a_len) != 0;
+    bad |= c_len != len || (len && memcmp(c, data, len) != 0);
+
+    // a set missing a shard is refused
+    if (count > 1) {
+        for (uint32_t i = 0; i < count; i++) rewind(shards[i]);
+        FILE *fnull = tmpfile();
+        bad |= ssio_merge_shards(shards, count - 1, fnull);
+        fclose(fnull);
+    }
+    free(a); free(b); free(c);
+    for (uint32_t i = 0; i < count; i++) fclose(shards[i]);
+    free(shards);
+    fclose(fin); fclose(fwant); fclose(fmerged); fclose(fdec);
+    if (bad) printf("ss: sharded output differs (len %zu, flags %u, %u shards)\n", len, (unsigned) flags, count);
+    return bad;
+}
+
+// encrypting a prefix, then appending the rest, must match encrypting it all
+static int append_matches(const uint8_t *data, size_t prefix, size_t len, uint32_t flags, const mpz_t n) {
+    FILE *fin = tmpfile(), *fout = tmpfile(), *fwant = tmpfile();
+    ssio_opts opts = { .flags = flags, .threads = 2 };
+    if (prefix) fwrite(data, 1, prefix, fin);
+    fflush(fin);
+    int bad = !ssio_encrypt_append(fin, fout, n, &opts);    // empty cipher: plain encryption
+    if (len > prefix) fwrite(data + prefix, 1, len - prefix, fin);
+    fflush(fin);
+    bad |= !ssio_encrypt_append(fin, fout, n, &opts);
+    rewind(fin);
+    bad |= !ssio_encrypt_file(fin, fwant, n, &opts);
+
+    size_t a_len = 0, b_len = 0;
+    fflush(fout);
+    uint8_t *a = read_all(fout, &a_len);
+    uint8_t *b = read_all(fwant, &b_len);
+    bad |= a_len != b_len || memcmp(a, b, a_len) != 0;
+    free(a); free(b);
+    fclose(fin); fclose(fout); fclose(fwant);
+    if (bad) printf("ss: appended output differs (%zu + %zu bytes, flags %u)\n", prefix, len - prefix, (unsigned) flags);
+    return bad;
+}
+
+static void count_done(ss_job *job, void *ctx) {
+    (void) job;
+    __atomic_add_fetch((int *) ctx, 1, __ATOMIC_SEQ_CST);
+}
+
+// jobs whose callbacks submit the next job, racing the submitting thread
+typedef struct {
+    ss_pool *pool;
+    ss_job *jobs;
+    size_t count;
+    atomic_size_t next;         // next job to submit
+    atomic_size_t finished;
+} ss_chain;
+
+static void chain_done(ss_job *job, void *ctx) {
+    (void) job;
+    ss_chain *ch = (ss_chain *) ctx;
+    size_t i = atomic_fetch_add(&ch->next, 1);
+    if (i < ch->count) {
+        ss_pool_submit(ch->pool, &ch->jobs[i]);
+    }
+    atomic_fetch_add(&ch->finished, 1);
+}
+
+// pool jobs must match the synchronous calls, whichever way they complete
+static int async_matches(const uint8_t *data, size_t len, uint32_t flags,
+                         const mpz_t n, const mpz_t d, const mpz_t pq) {
+    int bad = 0;
+    FILE *fin = tmpfile(), *fenc = tmpfile();
+    if (len) fwrite(data, 1, len, fin);
+    rewind(fin);
+    ssio_opts opts = { .flags = flags, .threads = 1 };
+    ssio_encrypt_file(fin, fenc, n, &opts);
+    size_t want_len = 0;
+    rewind(fenc);
+    uint8_t *want = read_all(fenc, &want_len);
+    fclose(fin); fclose(fenc);
+
+    ss_pool *pool = ss_pool_create(3);
+    if (!pool) return 1;
+
+    // whole buffer, collected with ss_pool_wait
+    ss_job enc, blk, got_blk;
+    ss_job_encrypt_buffer(&enc, data, len, n, flags);
+    enc.grain = 7;
+    size_t room = ss_block_size(n) - 1;
+    ss_job_encrypt_block(&blk, data, len < room ? len : room, n);
+    int calls = 0;
+    blk.done = count_done;
+    blk.ctx = &calls;
+    ss_job *batch[] = { &enc, &blk };
+    ss_pool_submit_batch(pool, batch, 2);
+    ss_job *done[2];
+    size_t got = 0;
+    while (got == 0) got = ss_pool_wait(pool, done, 2);
+    bad |= got != 1 || done[0] != &enc || !enc.ok;
+    bad |= enc.out_len != want_len || (want_len && memcmp(enc.out, want, want_len) != 0);
+
+    // and back, collected by polling
+    ss_job dec;
+    ss_job_decrypt_buffer(&dec, (const char *) enc.out, enc.out_len, d, pq);
+    ss_pool_submit(pool, &dec);
+    while (ss_pool_poll(pool, done, 2) == 0) ss_pool_wait(pool, NULL, 0);
+    bad |= done[0] != &dec || !dec.ok || dec.out_len != len || (len && memcmp(dec.out, data, len) != 0);
+
+    // single block, against ss_encrypt_bytes
+    ss_pool_destroy(pool);
+    mpz_t c; mpz_init(c);
+    ss_encrypt_bytes(c, data, len < room ? len : room, n);
+    bad |= calls != 1 || !blk.ok || mpz_cmp(c, blk.c) != 0;
+    ss_job_decrypt_block(&got_blk, blk.c, d, pq);
+    pool = ss_pool_create(0);
+    ss_pool_submit(pool, &got_blk);
+    bad |= ss_pool_wait(pool, done, 1) != 1 || !got_blk.ok || got_blk.out_len != (len < room ? len : room)
+        || (got_blk.out_len && memcmp(got_blk.out, data, got_blk.out_len) != 0);
+
+    // garbage is reported, not decrypted; a key without payload room is refused
+    ss_job junk, tiny_job;
+    ss_job_decrypt_buffer(&junk, "zz\n", 3, d, pq);
+    ss_pool_submit(pool, &junk);
+    bad |= ss_pool_wait(pool, done, 1) != 1 || junk.ok;
+    mpz_t tiny;
+    mpz_init_set_ui(tiny, 1000);
+    ss_job_encrypt_buffer(&tiny_job, data, len, tiny, flags);
+    ss_pool_submit(pool, &tiny_job);
+    bad |= ss_pool_wait(pool, done, 1) != 1 || tiny_job.ok;
+
+    // submissions from callbacks and from this thread at once
+    ss_chain ch = { .pool = pool, .count = 64 };
+    ch.jobs = (ss_job *) malloc(ch.count * sizeof(ss_job));
+    for (size_t i = 0; i < ch.count; i++) {
+        ss_job_encrypt_block(&ch.jobs[i], data, len < room ? len : room, n);
+        ch.jobs[i].done = chain_done;
+        ch.jobs[i].ctx = &ch;
+    }
+    atomic_init(&ch.finished, 0);
+    atomic_init(&ch.next, 0);
+    for (size_t i; (i = atomic_fetch_add(&ch.next, 1)) < ch.count; ) {
+        ss_pool_submit(pool, &ch.jobs[i]);
+    }
+    while (atomic_load(&ch.finished) < ch.count) {
+        sched_yield();
+    }
+    ss_pool_destroy(pool);
+    for (size_t i = 0; i < ch.count; i++) {
+        bad |= !ch.jobs[i].ok || mpz_cmp(ch.jobs[i].c, c) != 0;
+        ss_job_clear(&ch.jobs[i]);
+    }
+    free(ch.jobs);
+    ss_job_clear(&tiny_job);
+    mpz_clear(tiny);
+
+    mpz_clear(c);
+    ss_job_clear(&enc); ss_job_clear(&blk); ss_job_clear(&dec); ss_job_clear(&got_blk); ss_job_clear(&junk);
+    free(want);
+    if (bad) printf("ss: async jobs differ (len %zu, flags %u)\n", len, (unsigned) flags);
+    return bad;
+}
+
+// the CRT halves must agree with the full exponentiation, threaded or not
+static int crt_matches(const mpz_t n, const mpz_t d, const mpz_t pq, const mpz_t other_n) {
+    int bad = 0;
+    ss_crt_key k;
+    if (!ss_crt_init(&k, d, pq, n)) {
+        printf("ss: CRT key split failed\n");
+        return 1;
+    }
+    mpz_t c, want, got;
+    mpz_inits(c, want, got, NULL);
+    for (int i = 0; i < 200 && !bad; i++) {
+        if (i == 0) mpz_set_ui(c, 0);
+        else if (i == 1) mpz_set(c, k.p);           // shares a factor with pq
+        else rng_urandomm(randstate(), c, n);
+        ss_decrypt(want, c, d, pq);
+        ss_decrypt_crt(got, c, &k, false);
+        bad |= mpz_cmp(want, got) != 0;
+        ss_decrypt_crt(got, c, &k, true);
+        bad |= mpz_cmp(want, got) != 0;
+    }
+
+    // bytes interface, and a mismatched public key is refused
+    uint8_t msg[16] = "crt latency mode", out[64];
+    size_t len = 0;
+    ss_encrypt_bytes(c, msg, sizeof(msg), n);
+    bad |= !ss_decrypt_bytes_crt(out, &len, sizeof(out), c, &k, true) || len != sizeof(msg)
+        || memcmp(out, msg, len) != 0;
+    ss_crt_key wrong;
+    if (ss_crt_init(&wrong, d, pq, other_n)) {
+        ss_crt_clear(&wrong);
+        bad = 1;
+    }
+    mpz_clears(c, want, got, NULL);
+    ss_crt_clear(&k);
+    if (bad) printf("ss: CRT decryption differs\n");
+    return bad;
+}
+
+// key-owner encryption: same numbers, same files, same pool jobs
+static int owner_matches(const uint8_t *data, size_t len, const mpz_t n, const mpz_t d, const mpz_t pq) {
+    int bad = 0;
+    ss_crt_key k;
+    if (!ss_crt_init(&k, d, pq, n)) {
+        printf("ss: CRT key split failed\n");
+        return 1;
+    }
+    mpz_t m, want, got;
+    mpz_inits(m, want, got, NULL);
+    for (int i = 0; i < 200 && !bad; i++) {
+        if (i == 0) mpz_set_ui(m, 0);
+        else if (i == 1) mpz_set_ui(m, 1);
+        else if (i == 2) mpz_set(m, k.p);           // not coprime to p^2
+        else if (i == 3) mpz_set(m, k.q);           // not coprime to q
+        else if (i == 4) mpz_mul(m, k.p, k.q);
+        else if (i == 5) mpz_set(m, k.p2);
+        else rng_urandomm(randstate(), m, n);
+        ss_encrypt(want, m, n);
+        ss_encrypt_crt(got, m, &k);
+        bad |= mpz_cmp(want, got) != 0;
+    }
+
+    // whole files in both layouts, and a buffer job on the pool
+    for (uint32_t flags = 0; flags <= SSIO_INDEXED && !bad; flags += SSIO_INDEXED) {
+        uint8_t *out[2];
+        size_t out_len[2];
+        for (int owner = 0; owner < 2; owner++) {
+            FILE *fin = tmpfile(), *fenc = tmpfile();
+            if (len) fwrite(data, 1, len, fin);
+            rewind(fin);
+            ssio_opts opts = { .flags = flags, .threads = 2, .crt = owner ? &k : NULL };
+            bad |= !ssio_encrypt_file(fin, fenc, n, &opts);
+            rewind(fenc);
+            out[owner] = read_all(fenc, &out_len[owner]);
+            fclose(fin); fclose(fenc);
+        }
+        bad |= out_len[0] != out_len[1] || memcmp(out[0], out[1], out_len[0]) != 0;
+
+        ss_pool *pool = ss_pool_create(2);
+        if (!pool) return 1;
+        ss_job job;
+        ss_job_encrypt_buffer(&job, data, len, n, flags);
+        job.crt = &k;
+        ss_pool_submit(pool, &job);
+        ss_job *done[1];
+        while (ss_pool_wait(pool, done, 1) == 0) {}
+        bad |= !job.ok || job.out_len != out_len[0] || memcmp(job.out, out[0], out_len[0]) != 0;
+        ss_job_clear(&job);
+        ss_pool_destroy(pool);
+        free(out[0]);
+        free(out[1]);
+    }
+    mpz_clears(m, want, got, NULL);
+    ss_crt_clear(&k);
+    if (bad) printf("ss: key-owner encryption differs\n");
+    return bad;
+}
+
+// block cache: same bytes both ways, with repeats served from the cache
+static int cache_matches(const uint8_t *rnd, const mpz_t n, const mpz_t d, const mpz_t pq) {
+    int bad = 0;
+
+    // the cache itself: a full key compare, and a slot holds one entry
+    sscache *c = sscache_create(1);
+    uint8_t v[8];
+    size_t vlen = 0;
+    sscache_put(c, "abc", 3, "123", 3);
+    bad |= !sscache_get(c, "abc", 3, v, &vlen, sizeof(v)) || vlen != 3 || memcmp(v, "123", 3) != 0;
+    bad |= sscache_get(c, "abd", 3, v, &vlen, sizeof(v)) || sscache_get(c, "ab", 2, v, &vlen, sizeof(v));
+    bad |= sscache_get(c, "abc", 3, v, &vlen, 2);          // does not fit
+    sscache_put(c, "xyz", 3, "", 0);
+    bad |= sscache_get(c, "abc", 3, v, &vlen, sizeof(v)) || !sscache_get(c, "xyz", 3, v, &vlen, 0);
+    sscache_stats st = sscache_get_stats(c);
+    bad |= st.lookups != 6 || st.hits != 2 || st.inserts != 2 || st.evictions != 1;
+    sscache_destroy(c);
+    bad |= sscache_create(0) != NULL;
+
+    // a mostly zero "disk image" with a few random blocks, in both layouts
+    size_t len = 200000;
+    uint8_t *img = (uint8_t *) calloc(len, 1);
+    for (size_t off = 0; off + 512 <= len; off += 50000) memcpy(img + off, rnd, 512);
+    for (uint32_t flags = 0; flags <= SSIO_INDEXED && !bad; flags += SSIO_INDEXED) {
+        uint8_t *out[2];
+        size_t out_len[2];
+        for (int cached = 0; cached < 2; cached++) {
+            FILE *fin = tmpfile(), *fenc = tmpfile(), *fdec = tmpfile();
+            fwrite(img, 1, len, fin);
+            rewind(fin);
+            ssio_opts opts = { .flags = flags, .threads = 2, .cache = cached ? sscache_create(64) : NULL };
+            bad |= !ssio_encrypt_file(fin, fenc, n, &opts);
+            rewind(fenc);
+            out[cached] = read_all(fenc, &out_len[cached]);
+            if (cached) {
+                st = sscache_get_stats(opts.cache);
+                bad |= st.hits < st.lookups / 10 * 9;       // all but a few blocks repeat
+                sscache_destroy(opts.cache);
+
+                // and back, with a cache of its own
+                opts.cache = sscache_create(64);
+                rewind(fenc);
+                bad |= !ssio_decrypt_file(fenc, fdec, d, pq, &opts);
+                rewind(fdec);
+                size_t dec_len = 0;
+                uint8_t *dec = read_all(fdec, &dec_len);
+                bad |= dec_len != len || memcmp(dec, img, len) != 0;
+                st = sscache_get_stats(opts.cache);
+                bad |= st.hits < st.lookups / 10 * 9;
+                free(dec);
+                sscache_destroy(opts.cache);
+            }
+            fclose(fin); fclose(fenc); fclose(fdec);
+        }
+        bad |= out_len[0] != out_len[1] || memcmp(out[0], out[1], out_len[0]) != 0;
+        free(out[0]);
+        free(out[1]);
+    }
+    free(img);
+    if (bad) printf("ss: block cache differs\n");
+    return bad;
+}
+
+// encrypt a whole buffer with ssio_encrypt_file
+static uint8_t *encrypt_all(const uint8_t *data, size_t len, uint32_t flags, const mpz_t n, size_t *out_len) {
+    FILE *fin = tmpfile(), *fenc = tmpfile();
+    if (len) fwrite(data, 1, len, fin);
+    rewind(fin);
+    ssio_opts opts = { .flags = flags, .threads = 2 };
+    ssio_encrypt_file(fin, fenc, n, &opts);
+    rewind(fenc);
+    uint8_t *out = read_all(fenc, out_len);
+    fclose(fin); fclose(fenc);
+    return out;
+}
+
+// incremental re-encryption: a run against the previous one matches a full run
+static int delta_matches(const uint8_t *data, size_t len, const mpz_t n, const mpz_t other_n) {
+    int bad = 0;
+    uint8_t digest[SHA256_LEN];
+    sha256("abc", 3, digest);
+    bad |= memcmp(digest, "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae\x22\x23"
+                          "\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61\xf2\x00\x15\xad", SHA256_LEN) != 0;
+    sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, digest);
+    bad |= memcmp(digest, "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e\x60\x39"
+                          "\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4\x19\xdb\x06\xc1", SHA256_LEN) != 0;
+
+    // the changed copy: a few bytes patched, and a tail appended
+    size_t room = ss_block_size(n) - 1, len2 = len + 3 * room + 7;
+    uint8_t *data2 = (uint8_t *) malloc(len2);
+    memcpy(data2, data, len);
+    memcpy(data2 + len, data, len2 - len);
+    data2[10] ^= 1;
+    data2[len / 2] ^= 0x80;
+
+    for (uint32_t flags = 0; flags <= SSIO_INDEXED && !bad; flags += SSIO_INDEXED) {
+        // first run: no base, writes the manifest
+        FILE *fin = tmpfile(), *base = tmpfile(), *man = tmpfile();
+        fwrite(data, 1, len, fin);
+        rewind(fin);
+        ssio_opts opts = { .flags = flags, .threads = 2, .batch = 4096 };
+        uint64_t reused = 1;
+        bad |= !ssio_encrypt_delta(fin, base, n, &opts, man, NULL, NULL, &reused) || reused != 0;
+        size_t want_len, got_len;
+        uint8_t *want = encrypt_all(data, len, flags, n, &want_len);
+        rewind(base);
+        uint8_t *got = read_all(base, &got_len);
+        bad |= got_len != want_len || memcmp(got, want, want_len) != 0;
+        free(want); free(got);
+
+        // second run against it, into the other layout
+        FILE *fin2 = tmpfile(), *out = tmpfile(), *man2 = tmpfile();
+        fwrite(data2, 1, len2, fin2);
+        rewind(fin2);
+        rewind(base); rewind(man);
+        opts.flags = flags ^ SSIO_INDEXED;
+        bad |= !ssio_encrypt_delta(fin2, out, n, &opts, man2, base, man, &reused);
+        bad |= reused != len / room - 2;        // all full blocks but the two patched ones
+        want = encrypt_all(data2, len2, opts.flags, n, &want_len);
+        rewind(out);
+        got = read_all(out, &got_len);
+        bad |= got_len != want_len || memcmp(got, want, want_len) != 0;
+        free(want); free(got);
+
+        // a manifest of another key is refused
+        fclose(out);
+        out = tmpfile();
+        rewind(fin2); rewind(base); rewind(man);
+        FILE *fother = tmpfile(), *man_other = tmpfile();
+        bad |= !ssio_encrypt_delta(fin2, fother, other_n, &opts, man_other, NULL, NULL, NULL);
+        rewind(man_other);
+        bad |= ssio_encrypt_delta(fin2, out, n, &opts, NULL, base, man_other, NULL);
+        fclose(fin); fclose(base); fclose(man); fclose(fin2); fclose(out); fclose(man2);
+        fclose(fother); fclose(man_other);
+    }
+    free(data2);
+    if (bad) printf("ss: incremental re-encryption differs\n");
+    return bad;
+}
+
+// keyring: lookups by username and fingerprint, a bounded context cache
+static int keyring_matches(mpz_t *ns, size_t count) {
+    int bad = 0;
+    char path[] = "/tmp/tests_ss_ringXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+
+    char *users[] = { "alice", "bob", "carol", "dave" };
+    char *dup[] = { "alice", "alice" };
+    FILE *out = fopen(path, "w");
+    bad |= keyring_write(out, ns, dup, 2);      // repeated username
+    rewind(out);
+    bad |= !keyring_write(out, ns, users, count);
+    fclose(out);
+
+    keyring *kr = keyring_open(path, 2);
+    bad |= !kr || keyring_count(kr) != count;
+    for (int round = 0; kr && round < 2 && !bad; round++) {
+        for (size_t i = 0; i < count; i++) {
+            const keyring_key *key = keyring_find(kr, users[i]);
+            bad |= !key || mpz_cmp(key->n, ns[i]) != 0 || key->k != ss_block_size(ns[i])
+                || strcmp(key->username, users[i]) != 0;
+            if (!key) continue;
+            char fp[17];
+            snprintf(fp, sizeof(fp), "%016" PRIx64, key->fingerprint);
+            const keyring_key *again = keyring_find(kr, fp);
+            bad |= again != key;        // held, so the same context
+            keyring_release(kr, again);
+            keyring_release(kr, key);
+        }
+    }
+    if (kr) {
+        bad |= keyring_find(kr, "mallory") != NULL || keyring_find(kr, "0123456789abcdef") != NULL;
+        keyring_stats st = keyring_get_stats(kr);
+        bad |= st.hits < 2 * count || st.evictions < count;     // cache of 2, cycled twice
+
+        uint64_t cursor = 0, walked = 0;
+        const keyring_key *key;
+        while ((key = keyring_next(kr, &cursor)) != NULL) {
+            bad |= mpz_cmp(key->n, ns[walked]) != 0;
+            keyring_release(kr, key);
+            walked++;
+        }
+        bad |= walked != count;
+        keyring_close(kr);
+    }
+    remove(path);
+    if (bad) printf("ss: keyring lookup failed\n");
+    return bad;
+}
+
+// live stream: input reaches the output by the deadline, before the input
+// ends, and the whole stream round-trips through short blocks
+typedef struct {
+    FILE *in, *out;
+    const mpz_t *n;
+    uint32_t flags;
+    bool ok;
+} live_job;
+
+static void *live_encrypt(void *arg) {
+    live_job *job = (live_job *) arg;
+    mpz_t ns[1];
+    mpz_init_set(ns[0], *job->n);
+    ssio_opts opts = { .flags = job->flags, .threads = 2 };
+    job->ok = ssio_encrypt_live(job->in, &job->out, ns, 1, &opts, 20);
+    mpz_clear(ns[0]);
+    return NULL;
+}
+
+static int live_matches(const uint8_t *data, size_t len, uint32_t flags,
+                        const mpz_t n, const mpz_t d, const mpz_t pq) {
+    int bad = 0, fds[2];
+    if (pipe(fds) != 0) return 1;
+    live_job job = { .in = fdopen(fds[0], "r"), .out = tmpfile(), .n = (const mpz_t *) n, .flags = flags };
+    pthread_t t;
+    pthread_create(&t, NULL, live_encrypt, &job);
+
+    // a short record must come out while the pipe is still open
+    size_t head = len < 5 ? len : 5;
+    bad |= write(fds[1], data, head) != (ssize_t) head;
+    struct stat st = { 0 };
+    for (int i = 0; i < 400 && st.st_size == 0; i++) {
+        usleep(5000);
+        fstat(fileno(job.out), &st);
+    }
+    bad |= st.st_size == 0;
+    bad |= write(fds[1], data + head, len - head) != (ssize_t) (len - head);
+    close(fds[1]);
+    pthread_join(t, NULL);
+    fclose(job.in);
+    bad |= !job.ok;
+
+    // both decryptors give back the exact input
+    for (int live = 0; live < 2 && !bad; live++) {
+        FILE *dec = tmpfile();
+        rewind(job.out);
+        bad |= !(live ? ssio_decrypt_live(job.out, dec, d, pq, NULL, 0)
+                      : ssio_decrypt_file(job.out, dec, d, pq, NULL));
+        rewind(dec);
+        size_t got_len;
+        uint8_t *got = read_all(dec, &got_len);
+        bad |= got_len != len || (len && memcmp(got, data, len) != 0);
+        free(got);
+        fclose(dec);
+    }
+    fclose(job.out);
+    if (bad) printf("ss: live stream (flags %u) failed\n", flags);
+    return bad;
+}
+
+// n must reach the requested size on the first attempt, for every seed
+static int keygen_sizes(void) {
+    int bad = 0;
+    mpz_t p, q, n, t;
+    mpz_inits(p, q, n, t, NULL);
+    uint64_t sizes[] = {16, 64, 100, 257};
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        for (uint64_t seed = 1; seed <= 20; seed++) {
+            randstate_init(seed);
+            ss_keygen_stats st;
+            ss_make_pub_split(p, q, n, sizes[i], ss_pick_pbits(sizes[i]), 25, &st);
+            randstate_clear();
+
+            size_t bits = mpz_sizeinbase(n, 2);
+            bad |= bits < sizes[i] || bits > sizes[i] + 1;
+            bad |= mpz_sizeinbase(p, 2) != st.pbits || mpz_sizeinbase(q, 2) != st.qbits;
+            mpz_sub_ui(t, q, 1);
+            bad |= mpz_divisible_p(t, p) != 0;
+            mpz_sub_ui(t, p, 1);
+            bad |= mpz_divisible_p(t, q) != 0;
+        }
+    }
+    mpz_clears(p, q, n, t, NULL);
+    if (bad) printf("ss: key sizing violated\n");
+    return bad;
+}
+
+// split profiles: the fast split has the smallest pq, and pq targets are met
+static int split_profiles(void) {
+    int bad = 0;
+    mpz_t p, q, n, d, pq;
+    mpz_inits(p, q, n, d, pq, NULL);
+    uint64_t sizes[] = {64, 100, 257};
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        uint64_t nbits = sizes[i];
+        uint64_t fast = ss_pick_pbits_fast(nbits);
+        bad |= fast < nbits / 5 || fast >= (2 * nbits) / 5;
+        for (uint64_t seed = 1; seed <= 10; seed++) {
+            randstate_init(seed);
+            bad |= ss_pick_pbits(nbits) > fast;
+            randstate_clear();
+        }
+
+        // every reachable pq size maps back to its p, anything else to 0
+        bad |= ss_pbits_for_pq(nbits, nbits + 1 - fast) != fast;
+        bad |= ss_pbits_for_pq(nbits, nbits - fast) != 0;
+        bad |= ss_pbits_for_pq(nbits, nbits + 1 - nbits / 5) != nbits / 5;
+        bad |= ss_pbits_for_pq(nbits, nbits + 2 - nbits / 5) != 0;
+        bad |= ss_pbits_for_pq(nbits, 0) != 0 || ss_pbits_for_pq(nbits, nbits + 1) != 0;
+
+        uint64_t target = (nbits + 1 - fast + nbits + 1 - nbits / 5) / 2;
+        uint64_t pbits = ss_pbits_for_pq(nbits, target);
+        for (uint64_t seed = 1; seed <= 5; seed++) {
+            randstate_init(seed);
+            ss_keygen_stats st;
+            ss_make_pub_split(p, q, n, nbits, pbits, 25, &st);
+            ss_make_priv(d, pq, p, q);
+            randstate_clear();
+            size_t got = mpz_sizeinbase(pq, 2);
+            bad |= got != target && got != target - 1;
+        }
+    }
+    mpz_clears(p, q, n, d, pq, NULL);
+    if (bad) printf("ss: split profiles violated\n");
+    return bad;
+}
+
 int main(void) {
     // deterministic RNG so failures are reproducible
     randstate_init(1337);
@@ -69,7 +797,7 @@ int main(void) {
     size_t k = enc_k_from_n(n);
     size_t cases[] = {0, 1, 5, (k ? k-1 : 1), (k ? k : 2), (k ? (2*(k-1)+3) : 10), 1024};
     uint8_t *rnd = (uint8_t *) malloc(2048);
-    for (size_t i = 0; i < 2048; i++) rnd[i] = (uint8_t)(random() & 0xFF);
+    rng_bytes(randstate(), rnd, 2048);
 
     int failures = 0;
 
@@ -84,12 +812,99 @@ int main(void) {
     for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
         size_t L = cases[i];
         failures += roundtrip(rnd, L > 2048 ? 2048 : L, n, d, pq);
+        failures += roundtrip_indexed(rnd, L > 2048 ? 2048 : L, SSIO_INDEXED, n, d, pq);
+        failures += roundtrip_indexed(rnd, L > 2048 ? 2048 : L, SSIO_COMPRESSED, n, d, pq);
+    }
+
+    // 4) compressible text spanning several lz frames
+    size_t text_len = 3 * 64 * 1024 + 123;
+    uint8_t *text = (uint8_t *) malloc(text_len);
+    for (size_t i = 0; i < text_len; i++) {
+        text[i] = (uint8_t) "{\"level\":\"info\",\"msg\":\"request served\"}\n"[i % 43] ^ (i % 997 == 0);
+    }
+    failures += roundtrip_indexed(text, text_len, SSIO_COMPRESSED, n, d, pq);
+
+    // 5) several recipients of different key sizes, across input batches
+    mpz_t ns[3], kp, kq;
+    mpz_inits(kp, kq, NULL);
+    mpz_init_set(ns[0], n);
+    mpz_init(ns[1]);
+    mpz_init(ns[2]);
+    ss_make_pub(kp, kq, ns[1], 200, 25);
+    ss_make_pub(kp, kq, ns[2], 320, 25);
+    uint8_t *big = (uint8_t *) malloc(300000);
+    rng_bytes(randstate(), big, 300000);
+    failures += multi_matches(NULL, 0, 0, ns, 3);
+    failures += multi_matches(rnd, 1024, 0, ns, 3);
+    failures += multi_matches(big, 300000, SSIO_INDEXED, ns, 3);
+    failures += multi_matches(text, text_len, SSIO_COMPRESSED, ns, 3);
+
+    // 6) key rotation, to a larger and to a smaller block size
+    failures += rekey_matches(NULL, 0, 0, n, d, pq, ns[2]);
+    failures += rekey_matches(big, 300000, 0, n, d, pq, ns[2]);
+    failures += rekey_matches(big, 300000, 0, n, d, pq, ns[1]);
+    failures += rekey_matches(big, 300000, SSIO_INDEXED, n, d, pq, ns[2]);
+    failures += rekey_matches(big, 300000, SSIO_INDEXED, n, d, pq, ns[1]);
+    failures += rekey_matches(text, text_len, SSIO_COMPRESSED, n, d, pq, ns[1]);
+    failures += rekey_refuses(big, 300000, 0, 3 * (2 * k + 1), 'g', n, d, pq, ns[1]);
+    failures += rekey_refuses(big, 300000, SSIO_INDEXED, SSIO_HEADER_LEN + 3 * (2 * k + 1), 'g', n, d, pq, ns[1]);
+    failures += rekey_refuses(big, 300000, SSIO_INDEXED, SSIO_HEADER_LEN + 3 * (2 * k + 1), '#', n, d, pq, ns[1]);
+
+    // 7) asynchronous jobs on the pool
+    failures += async_matches(NULL, 0, 0, n, d, pq);
+    failures += async_matches(rnd, 5, 0, n, d, pq);
+    failures += async_matches(big, 300000, 0, n, d, pq);
+    failures += async_matches(NULL, 0, SSIO_INDEXED, n, d, pq);
+    failures += async_matches(big, 300000, SSIO_INDEXED, n, d, pq);
+    failures += async_matches(text, text_len, SSIO_COMPRESSED, n, d, pq);
+
+    // 8) shard sets, including more shards than blocks
+    failures += shards_match(NULL, 0, 0, 3, n, d, pq);
+    failures += shards_match(rnd, 5, SSIO_INDEXED, 4, n, d, pq);
+    failures += shards_match(rnd, 1024, 0, 1, n, d, pq);
+    failures += shards_match(big, 300000, 0, 7, n, d, pq);
+    failures += shards_match(big, 300000, SSIO_INDEXED, 5, n, d, pq);
+
+    // 9) appending to a ciphertext, from block boundaries and from inside blocks
+    size_t room = k - 1;
+    size_t prefixes[] = { 0, 1, room - 1, room, 3 * room, 3 * room + 2, 50000 };
+    for (size_t i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+        failures += append_matches(big, prefixes[i], 60000, 0, n);
+        failures += append_matches(big, prefixes[i], 60000, SSIO_INDEXED, n);
     }
+    failures += append_matches(big, 60000, 60000, SSIO_INDEXED, n);
+
+    // 10) CRT decryption, the latency mode
+    failures += crt_matches(n, d, pq, ns[1]);
+    failures += owner_matches(big, 100000, n, d, pq);
+
+    // 11) block cache for repetitive inputs
+    failures += cache_matches(big, n, d, pq);
+
+    // 12) incremental re-encryption against a previous run
+    failures += delta_matches(big, 50000, n, ns[1]);
+
+    // 13) keyring of the recipients
+    failures += keyring_matches(ns, 3);
+
+    // 14) live streams, flushed on a deadline
+    failures += live_matches(big, 100000, 0, n, d, pq);
+    failures += live_matches(big, 3000, SSIO_INDEXED, n, d, pq);
+    free(big);
+    for (size_t i = 0; i < 3; i++) mpz_clear(ns[i]);
+    mpz_clears(kp, kq, NULL);
+    free(text);
 
     free(rnd);
     mpz_clears(p, q, n, d, pq, NULL);
     randstate_clear();
 
+    // 15) key sizing without whole-key restarts
+    failures += keygen_sizes();
+
+    // 16) p/q split profiles
+    failures += split_profiles();
+
     if (failures == 0) {
         printf("ss: ALL ROUNDTRIPS PASSED\n");
         return 0;
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_CHUNK_MIN 64      // events in a buffer's first chunk
+#define TRACE_CHUNK_MAX 4096    // chunks double up to this many events
+
+typedef struct {
+    const char *name;
+    const char *cat;
+    const char *key;        // NULL if the span has no argument
+    uint64_t val;
+    uint64_t t0, t1;        // ns, CLOCK_MONOTONIC
+} trace_event;
+
+typedef struct trace_chunk {
+    struct trace_chunk *next;
+    size_t count, cap;
+    trace_event ev[];
+} trace_chunk;
+
+typedef struct trace_buf {
+    struct trace_buf *next;     // registration list
+    trace_chunk *head, *tail;
+    unsigned lane;              // fixed at registration
+    atomic_bool busy;           // owned by a thread
+} trace_buf;
+
+static atomic_bool trace_on;
+static _Atomic(trace_buf *) trace_bufs;     // every buffer ever registered
+static FILE *trace_out;
+static uint64_t trace_epoch;
+static _Thread_local trace_buf *trace_mine;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// a free buffer of the lane, or a new one registered for it; buffers are
+// never unregistered before trace_close, so the list can be walked freely
+static trace_buf *acquire(unsigned lane) {
+    for (trace_buf *b = atomic_load(&trace_bufs); b; b = b->next) {
+        bool idle = false;
+        if (b->lane == lane && atomic_compare_exchange_strong(&b->busy, &idle, true)) {
+            return b;
+        }
+    }
+    trace_buf *b = (trace_buf *) calloc(1, sizeof(trace_buf));
+    b->lane = lane;
+    atomic_init(&b->busy, true);
+    b->next = atomic_load(&trace_bufs);
+    while (!atomic_compare_exchange_weak(&trace_bufs, &b->next, b)) {
+    }
+    return b;
+}
+
+// this thread's buffer; lane 0 unless trace_lane said otherwise
+static trace_buf *my_buf(void) {
+    if (!trace_mine) {
+        trace_mine = acquire(0);
+    }
+    return trace_mine;
+}
+
+bool trace_open(const char *path) {
+    trace_out = fopen(path, "w");
+    if (!trace_out) {
+        return false;
+    }
+    trace_epoch = now_ns();
+    atomic_store(&trace_on, true);
+    return true;
+}
+
+uint64_t trace_begin(void) {
+    return atomic_load_explicit(&trace_on, memory_order_relaxed) ? now_ns() : 0;
+}
+
+void trace_end_arg(const char *name, const char *cat, uint64_t t0, const char *key, uint64_t val) {
+    if (t0 == 0) {
+        return;
+    }
+    uint64_t t1 = now_ns();
+    trace_buf *b = my_buf();
+    if (!b->tail || b->tail->count == b->tail->cap) {
+        size_t cap = b->tail ? 2 * b->tail->cap : TRACE_CHUNK_MIN;
+        cap = cap > TRACE_CHUNK_MAX ? TRACE_CHUNK_MAX : cap;
+        trace_chunk *c = (trace_chunk *) malloc(sizeof(trace_chunk) + cap * sizeof(trace_event));
+        c->next = NULL;
+        c->count = 0;
+        c->cap = cap;
+        if (b->tail) {
+            b->tail->next = c;
+        } else {
+            b->head = c;
+        }
+        b->tail = c;
+    }
+    b->tail->ev[b->tail->count++] = (trace_event) {
+        .name = name, .cat = cat, .key = key, .val = val, .t0 = t0, .t1 = t1,
+    };
+}
+
+void trace_end(const char *name, const char *cat, uint64_t t0) {
+    trace_end_arg(name, cat, t0, NULL, 0);
+}
+
+void trace_lane(unsigned lane) {
+    if (!atomic_load_explicit(&trace_on, memory_order_relaxed)) {
+        return;
+    }
+    if (trace_mine && trace_mine->lane == lane) {
+        return;
+    }
+    trace_release();
+    trace_mine = acquire(lane);
+}
+
+void trace_release(void) {
+    if (trace_mine && atomic_load_explicit(&trace_on, memory_order_relaxed)) {
+        atomic_store(&trace_mine->busy, false);
+        trace_mine = NULL;
+    }
+}
+
+bool trace_close(void) {
+    if (!atomic_exchange(&trace_on, false)) {
+        return true;
+    }
+
+    // complete ("X") events; timestamps in microseconds since trace_open
+    bool first = true;
+    fprintf(trace_out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    trace_buf *bufs = atomic_exchange(&trace_bufs, NULL);
+    for (trace_buf *b = bufs; b; b = b->next) {
+        trace_chunk *c = b->head;
+        while (c) {
+            for (size_t i = 0; i < c->count; i++) {
+                trace_event *e = &c->ev[i];
+                fprintf(trace_out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                        "\"ts\":%.3f,\"dur\":%.3f",
+                        first ? "" : ",", e->name, e->cat, b->lane,
+                        (e->t0 - trace_epoch) / 1e3, (e->t1 - e->t0) / 1e3);
+                if (e->key) {
+                    fprintf(trace_out, ",\"args\":{\"%s\":%llu}", e->key, (unsigned long long) e->val);
+                }
+                fputc('}', trace_out);
+                first = false;
+            }
+            trace_chunk *next = c->next;
+            free(c);
+            c = next;
+        }
+    }
+
+    // name each row once, at the first buffer of its lane
+    for (trace_buf *b = bufs; b; b = b->next) {
+        bool named = false;
+        for (trace_buf *o = bufs; o != b && !named; o = o->next) {
+            named = o->lane == b->lane;
+        }
+        if (!named) {
+            unsigned l = b->lane >= TRACE_POOL_LANE ? b->lane - TRACE_POOL_LANE : b->lane;
+            const char *kind = b->lane >= TRACE_POOL_LANE ? "pool" : l ? "worker" : "main";
+            fprintf(trace_out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                    "\"args\":{\"name\":\"%s %u\"}}", first ? "" : ",", b->lane, kind, l);
+            first = false;
+        }
+    }
+    while (bufs) {
+        trace_buf *next = bufs->next;
+        free(bufs);
+        bufs = next;
+    }
+    fprintf(trace_out, "\n]}\n");
+    trace_mine = NULL;
+    bool ok = !ferror(trace_out);
+    ok = (fclose(trace_out) == 0) && ok;
+    trace_out = NULL;
+    return ok;
+}
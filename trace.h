@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Timeline tracing in Chrome trace-event JSON (chrome://tracing, Perfetto).
+//
+// Spans are appended to a buffer owned by the calling thread, so recording
+// takes no locks. Each thread reports under its lane: the worker index
+// parallel_for gave it (0 for the main thread), or TRACE_POOL_LANE plus the
+// index of an sspool worker. Buffers belong to lanes, not threads: a thread
+// that finishes hands its buffer back (trace_release) and the next thread
+// on that lane reuses it, so the short-lived workers of successive batches
+// share one row and one buffer. Buffers start small and grow with use.
+// While tracing is off every call returns immediately.
+//
+// Span names and categories must be string literals (they are not copied).
+//
+
+//
+// Start tracing; the trace is written to path by trace_close
+//
+// Returns false if path cannot be created
+//
+bool trace_open(const char *path);
+
+//
+// Write all spans recorded so far and stop tracing
+//
+// Requires:
+//  no other thread still recording
+//
+// Returns false on a write failure
+//
+bool trace_close(void);
+
+//
+// Timestamp for the start of a span; 0 while tracing is off
+//
+uint64_t trace_begin(void);
+
+//
+// Record a span from t0 (trace_begin) to now; no-op if t0 is 0
+//
+void trace_end(const char *name, const char *cat, uint64_t t0);
+
+//
+// Same as trace_end, with one numeric argument shown on the span
+//
+void trace_end_arg(const char *name, const char *cat, uint64_t t0, const char *key, uint64_t val);
+
+#define TRACE_POOL_LANE 1024    // lane of sspool worker 0
+
+//
+// Report the calling thread's spans under the given lane from now on
+//
+void trace_lane(unsigned lane);
+
+//
+// Hand the calling thread's buffer back for reuse by its lane; call before a
+// worker thread exits
+//
+void trace_release(void);
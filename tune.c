@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "tune.h"
+#include "numtheory.h"
+
+tune_profile tune;
+
+bool tune_load(const char *path, tune_profile *p) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    memset(p, 0, sizeof(*p));
+
+    char key[32], val[64];
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        if (line[0] == '#' || sscanf(line, "%31s %63s", key, val) != 2) {
+            continue;
+        }
+        unsigned long long num = strtoull(val, NULL, 10);
+        if (strcmp(key, "bits") == 0) {
+            snprintf(p->bits, sizeof(p->bits), "%s", val);
+        } else if (strcmp(key, "backend") == 0) {
+            snprintf(p->backend, sizeof(p->backend), "%.15s", val);
+        } else if (strcmp(key, "pow_window") == 0) {
+            p->pow_window = (unsigned) num;
+        } else if (strcmp(key, "threads") == 0) {
+            p->threads = (unsigned) num;
+        } else if (strcmp(key, "batch") == 0) {
+            p->batch = (size_t) num;
+        } else if (strcmp(key, "io_buffer") == 0) {
+            p->io_buffer = (size_t) num;
+        }
+    }
+    free(line);
+    fclose(f);
+    return true;
+}
+
+bool tune_save(const char *path, const tune_profile *p) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "# ss tuning profile, written by sstune\n");
+    if (p->bits[0]) fprintf(f, "bits %s\n", p->bits);
+    if (p->backend[0]) fprintf(f, "backend %s\n", p->backend);
+    fprintf(f, "pow_window %u\n", p->pow_window);
+    fprintf(f, "threads %u\n", p->threads);
+    fprintf(f, "batch %zu\n", p->batch);
+    fprintf(f, "io_buffer %zu\n", p->io_buffer);
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+const char *tune_startup(void) {
+    const char *path = getenv("SS_TUNE");
+    if (!path || !*path) {
+        path = access(TUNE_DEFAULT_PATH, R_OK) == 0 ? TUNE_DEFAULT_PATH : NULL;
+    }
+    if (!path || !tune_load(path, &tune)) {
+        return NULL;
+    }
+
+    const char *env = getenv("SS_BACKEND");
+    if (tune.backend[0] && !(env && *env) && !nt_backend_select(tune.backend)) {
+        fprintf(stderr, "tune: unknown backend \"%s\" in %s\n", tune.backend, path);
+    }
+    if (tune.pow_window) {
+        nt_set_pow_window(tune.pow_window);
+    }
+    return path;
+}
+
+void tune_buffer(FILE *f) {
+    if (f && tune.io_buffer) {
+        setvbuf(f, NULL, _IOFBF, tune.io_buffer);
+    }
+}
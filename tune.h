@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Per-machine tuning profile written by sstune.
+//
+// The profile is a text file of "<key> <value>" lines; unknown keys are
+// ignored and a zero or missing value keeps the built-in default:
+//
+//  bits <n>[,<n>...]   key sizes the profile was measured for (informational)
+//  backend <name>      numtheory backend (see numtheory.h)
+//  pow_window <bits>   native pow_mod window
+//  threads <n>         encryption threads
+//  batch <bytes>       input bytes per parallel batch
+//  io_buffer <bytes>   stdio buffer size for the data files
+//
+// keygen, encrypt, decrypt and rekey load it at startup from $SS_TUNE, or
+// from ss.tune in the working directory if that exists. SS_BACKEND still
+// overrides the backend, and command-line options override the rest.
+//
+
+#define TUNE_DEFAULT_PATH "ss.tune"
+
+typedef struct {
+    char bits[64];
+    char backend[16];
+    unsigned pow_window;
+    unsigned threads;
+    size_t batch;
+    size_t io_buffer;
+} tune_profile;
+
+// the profile loaded by tune_startup; all zero if there was none
+extern tune_profile tune;
+
+//
+// Read a profile
+//
+// Returns false if path cannot be read
+//
+bool tune_load(const char *path, tune_profile *p);
+
+//
+// Write a profile
+//
+// Returns false on a write failure
+//
+bool tune_save(const char *path, const tune_profile *p);
+
+//
+// Load the profile (if any) into tune and apply the arithmetic settings
+//
+// Returns the path loaded, or NULL if there was no profile
+//
+const char *tune_startup(void);
+
+//
+// Give a data stream the profile's buffer size; call before any I/O on f
+//
+void tune_buffer(FILE *f);